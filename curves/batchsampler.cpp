@@ -0,0 +1,194 @@
+/*
+  batchsampler.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cmath>
+#include <cstdio>
+
+#include "arclength.h"
+#include "batchsampler.h"
+
+namespace {
+
+// Curves sampled together; small enough that the samples stay in L1
+const size_t SAMPLE_BLOCK = 64;
+
+/*!
+  Writes the decimal form of v at p and returns the new end.
+*/
+char *appendInt(char *p, int v) {
+    char tmp[12];
+    unsigned int u = (v < 0) ? 0u - unsigned(v) : unsigned(v);
+    int n = 0;
+    do {
+        tmp[n++] = char('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (v < 0) *p++ = '-';
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+}
+
+PointMap makePointMap(Point2D oll, Point2D our, Point2D nll, Point2D nur) {
+    PointMap m;
+    m.ax = (nur.x - nll.x)/(our.x - oll.x);
+    m.bx = nll.x - m.ax*oll.x;
+    m.ay = (nll.y - nur.y)/(oll.y - our.y);
+    m.by = nur.y - m.ay*our.y;
+    return m;
+}
+
+BatchSampler::BatchSampler(size_t steps) : nSteps(steps ? steps : 1), basis(4*(nSteps + 1)) {
+    for (size_t i=0; i<=nSteps; ++i) {
+        double t = double(i)/nSteps;
+        double s = 1.0 - t;
+        basis[4*i] = s*s*s;
+        basis[4*i+1] = 3.0*s*s*t;
+        basis[4*i+2] = 3.0*s*t*t;
+        basis[4*i+3] = t*t*t;
+    }
+}
+
+void BatchSampler::sample(const CubicBatch &batch, size_t first, size_t count,
+                          const PointMap &map, int *xs, int *ys) const {
+    const double *x0 = &batch.x[0][first], *x1 = &batch.x[1][first];
+    const double *x2 = &batch.x[2][first], *x3 = &batch.x[3][first];
+    const double *y0 = &batch.y[0][first], *y1 = &batch.y[1][first];
+    const double *y2 = &batch.y[2][first], *y3 = &batch.y[3][first];
+
+    for (size_t i=0; i<=nSteps; ++i) {
+        // Fold the pixel mapping into the weights
+        const double *b = &basis[4*i];
+        double bx0 = map.ax*b[0], bx1 = map.ax*b[1], bx2 = map.ax*b[2], bx3 = map.ax*b[3];
+        double by0 = map.ay*b[0], by1 = map.ay*b[1], by2 = map.ay*b[2], by3 = map.ay*b[3];
+        int *xo = xs + i*count;
+        int *yo = ys + i*count;
+        for (size_t c=0; c<count; ++c) {
+            xo[c] = int(bx0*x0[c] + bx1*x1[c] + bx2*x2[c] + bx3*x3[c] + map.bx);
+            yo[c] = int(by0*y0[c] + by1*y1[c] + by2*y2[c] + by3*y3[c] + map.by);
+        }
+    }
+}
+
+void BatchSampler::sampleByLength(const CubicBatch &batch, size_t first, size_t count,
+                                  const PointMap &map, int *xs, int *ys) const {
+    const size_t numPts = nSteps + 1;
+    std::vector<double> ts(numPts*count);
+    ArcLengthTable table;
+    for (size_t c=0; c<count; ++c) {
+        // Hodograph control points of curve c
+        const size_t k = first + c;
+        double dx0 = 3.0*(batch.x[1][k] - batch.x[0][k]), dy0 = 3.0*(batch.y[1][k] - batch.y[0][k]);
+        double dx1 = 3.0*(batch.x[2][k] - batch.x[1][k]), dy1 = 3.0*(batch.y[2][k] - batch.y[1][k]);
+        double dx2 = 3.0*(batch.x[3][k] - batch.x[2][k]), dy2 = 3.0*(batch.y[3][k] - batch.y[2][k]);
+        // Lengths are measured in pixels, since that's what gets drawn
+        dx0 *= map.ax; dx1 *= map.ax; dx2 *= map.ax;
+        dy0 *= map.ay; dy1 *= map.ay; dy2 *= map.ay;
+        table.build([=](const double *t, double *speed, size_t n) {
+                for (size_t i=0; i<n; ++i) {
+                    double s = 1.0 - t[i];
+                    double b0 = s*s, b1 = 2.0*s*t[i], b2 = t[i]*t[i];
+                    double dx = b0*dx0 + b1*dx1 + b2*dx2;
+                    double dy = b0*dy0 + b1*dy1 + b2*dy2;
+                    speed[i] = std::sqrt(dx*dx + dy*dy);
+                }
+            }, 0.0, 1.0, 1.0e-5, 2);
+        table.uniformParams(numPts, &ts[c*numPts]);
+    }
+
+    const double *x0 = &batch.x[0][first], *x1 = &batch.x[1][first];
+    const double *x2 = &batch.x[2][first], *x3 = &batch.x[3][first];
+    const double *y0 = &batch.y[0][first], *y1 = &batch.y[1][first];
+    const double *y2 = &batch.y[2][first], *y3 = &batch.y[3][first];
+    for (size_t i=0; i<numPts; ++i) {
+        int *xo = xs + i*count;
+        int *yo = ys + i*count;
+        for (size_t c=0; c<count; ++c) {
+            double t = ts[c*numPts + i];
+            double s = 1.0 - t;
+            double b0 = s*s*s, b1 = 3.0*s*s*t, b2 = 3.0*s*t*t, b3 = t*t*t;
+            xo[c] = int(map.ax*(b0*x0[c] + b1*x1[c] + b2*x2[c] + b3*x3[c]) + map.bx);
+            yo[c] = int(map.ay*(b0*y0[c] + b1*y1[c] + b2*y2[c] + b3*y3[c]) + map.by);
+        }
+    }
+}
+
+CurveRenderer::CurveRenderer(size_t steps, size_t format, int w, int h) :
+    sampler(steps), outFormat(format), sampleSpacing(SPACING_PARAMETER), width(w), height(h) {
+    // The same margins bezier.go uses
+    map = makePointMap(makePoint(-0.01, -0.01), makePoint(1.01, 1.01),
+                       makePoint(0.0, 0.0), makePoint(w, h));
+}
+
+void CurveRenderer::header(std::string &out) const {
+    if (outFormat != FORMAT_SVG) return;
+    char buf[256];
+    std::snprintf(buf, sizeof(buf),
+                  "<?xml version=\"1.0\"?>\n"
+                  "<svg width=\"%d\" height=\"%d\"\n"
+                  "     xmlns=\"http://www.w3.org/2000/svg\"\n"
+                  "     xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n"
+                  "<title>Bezier Curve</title>\n", width, height);
+    out += buf;
+}
+
+void CurveRenderer::footer(std::string &out) const {
+    if (outFormat != FORMAT_SVG) return;
+    out += "</svg>\n";
+}
+
+void CurveRenderer::render(const CubicBatch &batch, std::string &out) const {
+    static const char prefix[] = "<polyline points=\"";
+    static const char suffix[] = "\" style=\"stroke:rgb(0,0,0);fill:none;width:1px;\"/>\n";
+    const size_t numPts = sampler.steps() + 1;
+    const bool svg = (outFormat == FORMAT_SVG);
+
+    std::vector<int> xs(numPts*SAMPLE_BLOCK), ys(numPts*SAMPLE_BLOCK);
+    // Worst case per point is two 11 character ints, a comma and a space
+    std::vector<char> line(sizeof(prefix) + sizeof(suffix) + 24*numPts);
+
+    for (size_t first=0; first<batch.size(); first+=SAMPLE_BLOCK) {
+        size_t count = batch.size() - first;
+        if (count > SAMPLE_BLOCK) count = SAMPLE_BLOCK;
+        if (sampleSpacing == SPACING_ARC_LENGTH) {
+            sampler.sampleByLength(batch, first, count, map, &xs[0], &ys[0]);
+        } else {
+            sampler.sample(batch, first, count, map, &xs[0], &ys[0]);
+        }
+
+        for (size_t c=0; c<count; ++c) {
+            char *p = &line[0];
+            if (svg) {
+                for (const char *s=prefix; *s; ++s) *p++ = *s;
+            }
+            for (size_t i=0; i<numPts; ++i) {
+                if (i) *p++ = ' ';
+                p = appendInt(p, xs[i*count + c]);
+                *p++ = ',';
+                p = appendInt(p, ys[i*count + c]);
+            }
+            if (svg) {
+                for (const char *s=suffix; *s; ++s) *p++ = *s;
+            } else {
+                *p++ = '\n';
+            }
+            out.append(&line[0], p - &line[0]);
+        }
+    }
+}
@@ -0,0 +1,108 @@
+/*
+  batchsampler.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef BATCHSAMPLER_H
+#define BATCHSAMPLER_H
+
+#include <string>
+#include <vector>
+
+#include "bezier.h"
+
+// Output formats
+static const size_t FORMAT_SVG=0;
+static const size_t FORMAT_POLYLINE=1;
+
+// How samples are spread along each curve
+static const size_t SPACING_PARAMETER=0;
+static const size_t SPACING_ARC_LENGTH=1;
+
+/*!
+  Affine map from curve space to output pixels, as in bezier.go's
+  mapPoint: screen = a*p + b on each axis.
+*/
+struct PointMap {
+    double ax, bx;
+    double ay, by;
+};
+
+// Maps the box oll-our onto nll-nur
+PointMap makePointMap(Point2D oll, Point2D our, Point2D nll, Point2D nur);
+
+/*!
+  Evaluates batches of cubics at steps+1 evenly spaced parameter values.
+  The Bernstein weights for each step are computed once, and each step
+  is then a multiply-add sweep over the batch's coordinate arrays.
+*/
+class BatchSampler {
+public:
+    BatchSampler(size_t steps);
+
+    size_t steps() const { return nSteps; }
+
+    /*!
+      Samples curves first .. first+count-1 of batch and maps them to
+      pixels.  xs and ys need (steps+1)*count entries and are filled step
+      major: sample i of curve c is at i*count + c.
+    */
+    void sample(const CubicBatch &batch, size_t first, size_t count,
+                const PointMap &map, int *xs, int *ys) const;
+
+    /*!
+      Like sample, but each curve's samples are spaced equally by arc
+      length instead of by parameter.
+    */
+    void sampleByLength(const CubicBatch &batch, size_t first, size_t count,
+                        const PointMap &map, int *xs, int *ys) const;
+
+private:
+    size_t nSteps;
+    std::vector<double> basis;
+};
+
+/*!
+  Turns batches of curves into SVG polylines or plain "x,y x,y ..."
+  lines.  Stateless apart from its settings, so several threads can
+  render different batches at once.
+*/
+class CurveRenderer {
+public:
+    CurveRenderer(size_t steps, size_t format, int width, int height);
+
+    size_t format() const { return outFormat; }
+    size_t steps() const { return sampler.steps(); }
+
+    void setSpacing(size_t spacing) { sampleSpacing = spacing; }
+    size_t spacing() const { return sampleSpacing; }
+
+    void header(std::string &out) const;
+    void footer(std::string &out) const;
+
+    // Appends one polyline per curve in batch to out
+    void render(const CubicBatch &batch, std::string &out) const;
+
+private:
+    BatchSampler sampler;
+    size_t outFormat;
+    size_t sampleSpacing;
+    int width;
+    int height;
+    PointMap map;
+};
+
+#endif
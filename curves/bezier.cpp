@@ -0,0 +1,72 @@
+/*
+  bezier.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include "bezier.h"
+
+void randomChain(size_t numCurves, std::mt19937 &rng, CurveChain &chain) {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    chain.points.clear();
+    if (numCurves == 0) return;
+    chain.points.reserve(3*numCurves + 1);
+
+    Point2D p1 = makePoint(unit(rng), unit(rng));
+    chain.points.push_back(p1);
+    Point2D p2 = makePoint(unit(rng), unit(rng));
+    Point2D p3 = makePoint(unit(rng), unit(rng));
+    Point2D p4 = makePoint(unit(rng), unit(rng));
+    for (size_t i=0; i<numCurves; ++i) {
+        chain.points.push_back(p2);
+        chain.points.push_back(p3);
+        chain.points.push_back(p4);
+        // linearPoint(p3, p4) in bezier.go
+        p2 = makePoint(p4.x + 0.25*(p4.x - p3.x), p4.y + 0.25*(p4.y - p3.y));
+        p3 = makePoint(unit(rng), unit(rng));
+        p4 = makePoint(unit(rng), unit(rng));
+    }
+}
+
+void CubicBatch::clear() {
+    for (size_t k=0; k<4; ++k) {
+        x[k].clear();
+        y[k].clear();
+    }
+}
+
+void CubicBatch::reserve(size_t n) {
+    for (size_t k=0; k<4; ++k) {
+        x[k].reserve(n);
+        y[k].reserve(n);
+    }
+}
+
+void CubicBatch::add(const Point2D *p) {
+    for (size_t k=0; k<4; ++k) {
+        x[k].push_back(p[k].x);
+        y[k].push_back(p[k].y);
+    }
+}
+
+void CubicBatch::addChain(const CurveChain &chain) {
+    addCurves(chain, 0, chain.numCurves());
+}
+
+void CubicBatch::addCurves(const CurveChain &chain, size_t first, size_t count) {
+    for (size_t i=first; i<first+count; ++i) {
+        add(&chain.points[3*i]);
+    }
+}
@@ -0,0 +1,71 @@
+/*
+  bezier.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef BEZIER_H
+#define BEZIER_H
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+struct Point2D {
+    double x;
+    double y;
+};
+
+inline Point2D makePoint(double x, double y) {
+    Point2D p = { x, y };
+    return p;
+}
+
+/*!
+  Cubic curves joined end to end.  Holds 3n+1 control points for n
+  curves; curve i uses points 3i .. 3i+3.
+*/
+struct CurveChain {
+    std::vector<Point2D> points;
+
+    size_t numCurves() const { return points.size() < 4 ? 0 : (points.size() - 1)/3; }
+};
+
+/*!
+  Builds a random chain the way bezier.go's show_beziers does: points in
+  the unit square, with each curve's second control point continuing
+  the previous curve's last segment.
+*/
+void randomChain(size_t numCurves, std::mt19937 &rng, CurveChain &chain);
+
+/*!
+  Cubic curves in structure of arrays form.  Coordinate k of every curve
+  is stored contiguously, so evaluating one parameter value across a
+  batch of curves is a straight vectorizable loop.
+*/
+struct CubicBatch {
+    std::vector<double> x[4];
+    std::vector<double> y[4];
+
+    size_t size() const { return x[0].size(); }
+    void clear();
+    void reserve(size_t n);
+    void add(const Point2D *p);
+    void addChain(const CurveChain &chain);
+    // Adds curves first .. first+count-1 of chain
+    void addCurves(const CurveChain &chain, size_t first, size_t count);
+};
+
+#endif
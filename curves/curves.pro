@@ -0,0 +1,19 @@
+######################################################################
+# Batch Bezier curve sampler and SVG server
+######################################################################
+
+TEMPLATE = app
+TARGET = curves
+CONFIG += console
+CONFIG -= qt app_bundle
+DEPENDPATH += .
+INCLUDEPATH += . ../surfview
+QMAKE_CXXFLAGS += -std=c++0x
+LIBS += -lpthread
+
+# Input
+HEADERS += bezier.h batchsampler.h curvesource.h curvestream.h output.h \
+           httpserver.h loadtest.h ../surfview/parallel.h \
+           ../surfview/arclength.h
+SOURCES += main.cpp bezier.cpp batchsampler.cpp curvesource.cpp curvestream.cpp \
+           output.cpp httpserver.cpp loadtest.cpp ../surfview/arclength.cpp
@@ -0,0 +1,172 @@
+/*
+  curvesource.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "curvesource.h"
+
+RandomCurveSource::RandomCurveSource(size_t numChains, size_t curves, unsigned int seed) :
+    chainsLeft(numChains), curvesPerChain(curves), rng(seed), chainPos(0) {
+}
+
+bool RandomCurveSource::next(CubicBatch &batch, size_t maxCurves) {
+    bool added = false;
+    while (batch.size() < maxCurves) {
+        if (chainPos == chain.numCurves()) {
+            if (!chainsLeft) break;
+            randomChain(curvesPerChain, rng, chain);
+            chainPos = 0;
+            --chainsLeft;
+        }
+        size_t count = std::min(chain.numCurves() - chainPos, maxCurves - batch.size());
+        batch.addCurves(chain, chainPos, count);
+        chainPos += count;
+        added = true;
+    }
+    return added;
+}
+
+LineReader::LineReader(int f, const std::string &prefix, size_t limit, size_t maxLen) :
+    fd(f), buffer(prefix.begin(), prefix.end()), pos(0), end(prefix.size()),
+    remaining(limit), maxLine(maxLen), numLong(0) {
+    if (remaining != size_t(-1)) {
+        remaining = (limit > end) ? limit - end : 0;
+        if (end > limit) end = limit;
+    }
+    if (buffer.size() < (1 << 16)) buffer.resize(1 << 16);
+}
+
+bool LineReader::fill() {
+    if (remaining == 0) return false;
+    if (pos > 0) {
+        std::copy(buffer.begin() + pos, buffer.begin() + end, buffer.begin());
+        end -= pos;
+        pos = 0;
+    }
+    if (end == buffer.size()) buffer.resize(2*buffer.size());
+
+    size_t want = buffer.size() - end;
+    if (want > remaining) want = remaining;
+    ssize_t got;
+    do {
+        got = ::read(fd, &buffer[end], want);
+    } while (got < 0 && errno == EINTR);
+    if (got < 0) {
+        throw std::runtime_error(std::string("read failed: ") + std::strerror(errno));
+    }
+    if (got == 0) {
+        remaining = 0;
+        return false;
+    }
+    end += got;
+    if (remaining != size_t(-1)) remaining -= got;
+    return true;
+}
+
+bool LineReader::getLine(std::string &line) {
+    size_t scan = pos;
+    bool skipping = false;
+    for (;;) {
+        for (; scan<end; ++scan) {
+            if (buffer[scan] == '\n') {
+                if (skipping) {
+                    // The end of a line that was too long; start over after it
+                    skipping = false;
+                    pos = scan + 1;
+                    continue;
+                }
+                size_t len = scan - pos;
+                if (len && buffer[scan-1] == '\r') --len;
+                line.assign(&buffer[pos], len);
+                pos = scan + 1;
+                return true;
+            }
+        }
+        if (skipping || scan - pos > maxLine) {
+            // Throw away what's been read of it instead of growing the buffer
+            if (!skipping) ++numLong;
+            skipping = true;
+            pos = end;
+        }
+        scan -= pos;
+        if (!fill()) break;
+        scan += pos;
+    }
+    if (skipping) return false;
+    // Last line without a newline
+    if (pos == end) return false;
+    line.assign(&buffer[pos], end - pos);
+    pos = end;
+    return true;
+}
+
+TextCurveSource::TextCurveSource(LineReader &input) : in(input), chainPos(0), numBad(0) {
+}
+
+bool TextCurveSource::parse(const std::string &text) {
+    chain.points.clear();
+    const char *p = text.c_str();
+    for (;;) {
+        while (*p == ',') ++p;
+        char *e;
+        double x = std::strtod(p, &e);
+        if (e == p) break;
+        p = e;
+        while (*p == ',') ++p;
+        double y = std::strtod(p, &e);
+        if (e == p) return false;
+        p = e;
+        // Also false for nan
+        if (!(std::fabs(x) <= MAX_COORDINATE && std::fabs(y) <= MAX_COORDINATE)) return false;
+        chain.points.push_back(makePoint(x, y));
+    }
+    // Only trailing whitespace is allowed
+    for (; *p; ++p) {
+        if (*p != ' ' && *p != '\t' && *p != ',') return false;
+    }
+    return chain.points.size() >= 4 && (chain.points.size() - 1) % 3 == 0;
+}
+
+bool TextCurveSource::next(CubicBatch &batch, size_t maxCurves) {
+    bool added = false;
+    while (batch.size() < maxCurves) {
+        if (chainPos == chain.numCurves()) {
+            chainPos = 0;
+            chain.points.clear();
+            if (!in.getLine(line)) break;
+            size_t first = line.find_first_not_of(" \t");
+            if (first == std::string::npos || line[first] == '#') continue;
+            if (!parse(line)) {
+                chain.points.clear();
+                ++numBad;
+                continue;
+            }
+        }
+        size_t count = std::min(chain.numCurves() - chainPos, maxCurves - batch.size());
+        batch.addCurves(chain, chainPos, count);
+        chainPos += count;
+        added = true;
+    }
+    return added;
+}
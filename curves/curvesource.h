@@ -0,0 +1,124 @@
+/*
+  curvesource.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef CURVESOURCE_H
+#define CURVESOURCE_H
+
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bezier.h"
+
+// Lines longer than this are skipped rather than buffered
+static const size_t MAX_LINE_BYTES=1 << 20;
+
+// Coordinates further than this from the origin are rejected, which
+// keeps every sample well inside an int once mapped to pixels
+static const double MAX_COORDINATE=1000.0;
+
+/*!
+  Produces curves a batch at a time, so callers never need every curve
+  in memory at once.
+*/
+class CurveSource {
+public:
+    virtual ~CurveSource() {}
+
+    /*!
+      Appends curves to batch until it holds maxCurves curves or the
+      source runs dry.  Long chains are split across batches, so a
+      batch never grows past maxCurves.  Returns false once nothing
+      more was added.
+    */
+    virtual bool next(CubicBatch &batch, size_t maxCurves) = 0;
+};
+
+/*!
+  Random chains, generated on demand like bezier.go's show_beziers.
+*/
+class RandomCurveSource : public CurveSource {
+public:
+    RandomCurveSource(size_t numChains, size_t curvesPerChain, unsigned int seed);
+
+    bool next(CubicBatch &batch, size_t maxCurves);
+
+private:
+    size_t chainsLeft;
+    size_t curvesPerChain;
+    std::mt19937 rng;
+    CurveChain chain;
+    // Next curve of chain to hand out
+    size_t chainPos;
+};
+
+/*!
+  Reads lines from a file descriptor.  limit caps the number of bytes
+  read, for HTTP bodies with a Content-Length, and prefix holds bytes
+  that were already read past the headers.  Lines longer than maxLine
+  are skipped and counted, so one endless line can't use up memory.
+*/
+class LineReader {
+public:
+    LineReader(int fd, const std::string &prefix = std::string(),
+               size_t limit = size_t(-1), size_t maxLine = MAX_LINE_BYTES);
+
+    // Reads the next line without its terminator.  False at end of input.
+    bool getLine(std::string &line);
+
+    size_t longLines() const { return numLong; }
+
+private:
+    bool fill();
+
+    int fd;
+    std::vector<char> buffer;
+    size_t pos;
+    size_t end;
+    size_t remaining;
+    size_t maxLine;
+    size_t numLong;
+};
+
+/*!
+  Chains given as text, one per line: "x0 y0 x1 y1 ..." with 3n+1
+  points in the unit square.  Blank lines and lines starting with '#'
+  are skipped, and so are malformed lines, which are counted.  Lines
+  with coordinates that aren't finite or are beyond MAX_COORDINATE, or
+  that are too long to read, are malformed.
+*/
+class TextCurveSource : public CurveSource {
+public:
+    TextCurveSource(LineReader &in);
+
+    bool next(CubicBatch &batch, size_t maxCurves);
+
+    size_t badLines() const { return numBad + in.longLines(); }
+
+private:
+    bool parse(const std::string &line);
+
+    LineReader &in;
+    std::string line;
+    CurveChain chain;
+    size_t chainPos;
+    size_t numBad;
+};
+
+#endif
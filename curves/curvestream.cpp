@@ -0,0 +1,118 @@
+/*
+  curvestream.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "curvestream.h"
+
+namespace {
+
+struct Window {
+    std::vector<CubicBatch> batches;
+    std::vector<std::string> text;
+    size_t used;
+};
+
+/*!
+  Writes one window on its own thread.  The thread is always joined
+  before the window is reused or the stream unwinds.
+*/
+class WindowWriter {
+public:
+    WindowWriter(ByteSink &s) : sink(s) {}
+    ~WindowWriter() { if (thread.joinable()) thread.join(); }
+
+    void start(const Window &w) {
+        thread = std::thread([this, &w]() {
+                try {
+                    for (size_t i=0; i<w.used; ++i) {
+                        sink.write(w.text[i]);
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            });
+    }
+
+    void wait() {
+        if (thread.joinable()) thread.join();
+        if (error) std::rethrow_exception(error);
+    }
+
+private:
+    ByteSink &sink;
+    std::thread thread;
+    std::exception_ptr error;
+};
+
+}
+
+size_t streamCurves(CurveSource &source, const CurveRenderer &renderer,
+                    ByteSink &sink, size_t blockCurves, size_t windowBlocks) {
+    blockCurves = std::min(blockCurves, STREAM_BLOCK_SAMPLES/(renderer.steps() + 1));
+    if (blockCurves == 0) blockCurves = 1;
+    if (windowBlocks == 0) windowBlocks = 1;
+    Window windows[2];
+    for (size_t i=0; i<2; ++i) {
+        windows[i].batches.resize(windowBlocks);
+        windows[i].text.resize(windowBlocks);
+        windows[i].used = 0;
+    }
+
+    std::string text;
+    renderer.header(text);
+    sink.write(text);
+
+    size_t total = 0;
+    size_t cur = 0;
+    WindowWriter writer(sink);
+    for (;;) {
+        Window &w = windows[cur];
+        w.used = 0;
+        while (w.used < windowBlocks) {
+            CubicBatch &batch = w.batches[w.used];
+            batch.clear();
+            if (!source.next(batch, blockCurves)) break;
+            total += batch.size();
+            ++w.used;
+        }
+        if (w.used == 0) break;
+
+        parallelFor(0, w.used, 1, [&](size_t lo, size_t hi) {
+                for (size_t i=lo; i<hi; ++i) {
+                    w.text[i].clear();
+                    renderer.render(w.batches[i], w.text[i]);
+                }
+            });
+
+        writer.wait();
+        writer.start(w);
+        cur ^= 1;
+    }
+    writer.wait();
+
+    text.clear();
+    renderer.footer(text);
+    sink.write(text);
+    sink.flush();
+    return total;
+}
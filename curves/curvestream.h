@@ -0,0 +1,50 @@
+/*
+  curvestream.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef CURVESTREAM_H
+#define CURVESTREAM_H
+
+#include <cstddef>
+
+#include "batchsampler.h"
+#include "curvesource.h"
+#include "output.h"
+#include "parallel.h"
+
+static const size_t STREAM_BLOCK_CURVES=1024;
+
+// Most samples in one block; blocks of finely sampled curves get fewer
+// curves, so a block's text stays around a megabyte whatever the steps
+static const size_t STREAM_BLOCK_SAMPLES=1 << 16;
+
+/*!
+  Renders everything source produces and writes it to sink as it goes.
+
+  Curves are pulled in blocks of blockCurves, or fewer if that would
+  be more than STREAM_BLOCK_SAMPLES samples.  A window of windowBlocks
+  blocks is rendered in parallel while a writer thread sends the
+  previous window, so at most two windows of text are held at once no
+  matter how long the input is.  A window of one block is rendered on
+  the calling thread.  Returns the number of curves written.
+  Exceptions from the sink or source are passed on.
+*/
+size_t streamCurves(CurveSource &source, const CurveRenderer &renderer,
+                    ByteSink &sink, size_t blockCurves = STREAM_BLOCK_CURVES,
+                    size_t windowBlocks = parallelThreadCount());
+
+#endif
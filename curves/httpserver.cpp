@@ -0,0 +1,372 @@
+/*
+  httpserver.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "curvestream.h"
+#include "httpserver.h"
+
+namespace {
+
+// Longest request line plus headers we accept
+const size_t MAX_HEADER_BYTES = 16384;
+
+bool parseSize(const std::string &value, size_t lo, size_t hi, size_t &out) {
+    if (value.empty()) return false;
+    char *end;
+    errno = 0;
+    unsigned long long v = std::strtoull(value.c_str(), &end, 10);
+    if (*end || errno || value[0] == '-' || v < lo || v > hi) return false;
+    out = size_t(v);
+    return true;
+}
+
+void sendAll(int fd, const std::string &s) {
+    size_t done = 0;
+    while (done < s.size()) {
+        ssize_t rc = ::send(fd, s.data() + done, s.size() - done, MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) return;
+        done += size_t(rc);
+    }
+}
+
+void sendError(int fd, const char *status, const std::string &message) {
+    std::string body = message + "\n";
+    char header[256];
+    std::snprintf(header, sizeof(header),
+                  "HTTP/1.1 %s\r\n"
+                  "Content-Type: text/plain\r\n"
+                  "Content-Length: %zu\r\n"
+                  "Connection: close\r\n\r\n", status, body.size());
+    sendAll(fd, header + body);
+}
+
+/*!
+  FdSink can't be used on sockets directly because a closed peer would
+  raise SIGPIPE.
+*/
+class SocketSink : public ByteSink {
+public:
+    SocketSink(int f) : fd(f), used(0), buffer(1 << 16) {}
+
+    void write(const char *data, size_t n) {
+        if (used + n > buffer.size()) flush();
+        if (n >= buffer.size()) {
+            sendRaw(data, n);
+            return;
+        }
+        std::memcpy(&buffer[used], data, n);
+        used += n;
+    }
+
+    void flush() {
+        size_t n = used;
+        used = 0;
+        sendRaw(&buffer[0], n);
+    }
+
+private:
+    void sendRaw(const char *data, size_t n) {
+        size_t done = 0;
+        while (done < n) {
+            ssize_t rc = ::send(fd, data + done, n - done, MSG_NOSIGNAL);
+            if (rc < 0 && errno == EINTR) continue;
+            if (rc <= 0) throw std::runtime_error(std::string("send failed: ") + std::strerror(errno));
+            done += size_t(rc);
+        }
+    }
+
+    int fd;
+    size_t used;
+    std::vector<char> buffer;
+};
+
+}
+
+CurveRequest::CurveRequest() : chains(1), curves(20), steps(40), seed(0), randomSeed(true),
+                               format(FORMAT_SVG), spacing(SPACING_PARAMETER), width(800), height(600) {
+}
+
+bool parseQuery(const std::string &query, CurveRequest &req, std::string &error) {
+    size_t start = 0;
+    while (start < query.size()) {
+        size_t amp = query.find('&', start);
+        if (amp == std::string::npos) amp = query.size();
+        std::string pair = query.substr(start, amp - start);
+        start = amp + 1;
+
+        size_t eq = pair.find('=');
+        std::string key = pair.substr(0, eq);
+        std::string value = (eq == std::string::npos) ? std::string() : pair.substr(eq + 1);
+        size_t v = 0;
+        bool ok = true;
+        if (key == "chains") {
+            ok = parseSize(value, 1, MAX_CHAINS, req.chains);
+        } else if (key == "curves") {
+            ok = parseSize(value, 1, MAX_CURVES_PER_CHAIN, req.curves);
+        } else if (key == "steps") {
+            ok = parseSize(value, 1, MAX_STEPS, req.steps);
+        } else if (key == "seed") {
+            ok = parseSize(value, 0, 0xffffffffu, v);
+            req.seed = (unsigned int)v;
+            req.randomSeed = false;
+        } else if (key == "width") {
+            ok = parseSize(value, 1, 100000, v);
+            req.width = int(v);
+        } else if (key == "height") {
+            ok = parseSize(value, 1, 100000, v);
+            req.height = int(v);
+        } else if (key == "format") {
+            ok = (value == "svg" || value == "polyline");
+            req.format = (value == "polyline") ? FORMAT_POLYLINE : FORMAT_SVG;
+        } else if (key == "spacing") {
+            ok = (value == "parameter" || value == "arclength");
+            req.spacing = (value == "arclength") ? SPACING_ARC_LENGTH : SPACING_PARAMETER;
+        }
+        if (!ok) {
+            error = "Bad value for " + key + ": '" + value + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+CurveServer::CurveServer(const CurveRequest &defs, size_t nworkers) :
+    defaults(defs), listenFd(-1), boundPort(0), numWorkers(nworkers ? nworkers : 1),
+    stopping(false) {
+}
+
+CurveServer::~CurveServer() {
+    if (listenFd >= 0) ::close(listenFd);
+}
+
+void CurveServer::listen(int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("socket failed: ") + std::strerror(errno));
+    }
+    int yes = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(fd, 128) < 0) {
+        std::string msg = std::string("bind failed: ") + std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error(msg);
+    }
+    socklen_t len = sizeof(addr);
+    ::getsockname(fd, (sockaddr*)&addr, &len);
+
+    if (listenFd >= 0) ::close(listenFd);
+    listenFd = fd;
+    boundPort = ntohs(addr.sin_port);
+}
+
+void CurveServer::run() {
+    for (size_t i=0; i<numWorkers; ++i) {
+        workers.push_back(std::thread(&CurveServer::work, this));
+    }
+    for (;;) {
+        int fd = ::accept(listenFd, 0, 0);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::string msg = std::string("accept failed: ") + std::strerror(errno);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            connectionReady.notify_all();
+            for (size_t i=0; i<workers.size(); ++i) {
+                workers[i].join();
+            }
+            workers.clear();
+            throw std::runtime_error(msg);
+        }
+        timeval timeout;
+        timeout.tv_sec = CONNECTION_TIMEOUT_SECONDS;
+        timeout.tv_usec = 0;
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        bool queued = false;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (pending.size() < MAX_PENDING_CONNECTIONS) {
+                pending.push_back(fd);
+                queued = true;
+            }
+        }
+        if (queued) {
+            connectionReady.notify_one();
+        } else {
+            sendError(fd, "503 Service Unavailable", "Too many connections");
+            ::close(fd);
+        }
+    }
+}
+
+/*!
+  A worker: serves queued connections one at a time until the server
+  stops and the queue is empty
+*/
+void CurveServer::work() {
+    for (;;) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (pending.empty() && !stopping) {
+                connectionReady.wait(guard);
+            }
+            if (pending.empty()) return;
+            fd = pending.front();
+            pending.pop_front();
+        }
+        try {
+            handle(fd);
+        } catch (...) {
+            // Nothing one connection does may take down the server; the
+            // client just sees the connection close
+        }
+        ::close(fd);
+    }
+}
+
+void CurveServer::handle(int fd) const {
+    // Read up to the end of the headers; anything after is body
+    std::string head;
+    size_t headerEnd;
+    char buf[4096];
+    for (;;) {
+        headerEnd = head.find("\r\n\r\n");
+        if (headerEnd != std::string::npos) break;
+        if (head.size() > MAX_HEADER_BYTES) {
+            sendError(fd, "431 Request Header Fields Too Large", "Headers too large");
+            return;
+        }
+        ssize_t got = ::recv(fd, buf, sizeof(buf), 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            sendError(fd, "408 Request Timeout", "Timed out waiting for the request");
+            return;
+        }
+        if (got <= 0) return;
+        head.append(buf, size_t(got));
+    }
+    std::string body = head.substr(headerEnd + 4);
+    head.resize(headerEnd);
+
+    // Request line: METHOD TARGET VERSION
+    size_t sp1 = head.find(' ');
+    size_t sp2 = (sp1 == std::string::npos) ? sp1 : head.find(' ', sp1 + 1);
+    if (sp2 == std::string::npos) {
+        sendError(fd, "400 Bad Request", "Malformed request line");
+        return;
+    }
+    std::string method = head.substr(0, sp1);
+    std::string target = head.substr(sp1 + 1, sp2 - sp1 - 1);
+    size_t qmark = target.find('?');
+    std::string path = target.substr(0, qmark);
+    std::string query = (qmark == std::string::npos) ? std::string() : target.substr(qmark + 1);
+
+    if (path != "/") {
+        sendError(fd, "404 Not Found", "Not found");
+        return;
+    }
+    if (method != "GET" && method != "POST") {
+        sendError(fd, "405 Method Not Allowed", "Only GET and POST are supported");
+        return;
+    }
+
+    CurveRequest req = defaults;
+    std::string error;
+    if (!parseQuery(query, req, error)) {
+        sendError(fd, "400 Bad Request", error);
+        return;
+    }
+    if (req.randomSeed) {
+        std::random_device entropy;
+        req.seed = entropy();
+    }
+
+    size_t contentLength = 0;
+    if (method == "POST") {
+        // Header names are case insensitive
+        std::string lower = head;
+        for (size_t i=0; i<lower.size(); ++i) {
+            if (lower[i] >= 'A' && lower[i] <= 'Z') lower[i] += 'a' - 'A';
+        }
+        size_t cl = lower.find("\r\ncontent-length:");
+        if (cl == std::string::npos) {
+            sendError(fd, "411 Length Required", "POST needs a Content-Length");
+            return;
+        }
+        size_t vstart = lower.find_first_not_of(" \t", cl + 17);
+        size_t vend = lower.find("\r\n", cl + 17);
+        std::string value = (vstart == std::string::npos) ? std::string() : lower.substr(vstart, vend - vstart);
+        if (!parseSize(value, 0, size_t(-1) >> 1, contentLength)) {
+            sendError(fd, "400 Bad Request", "Bad Content-Length");
+            return;
+        }
+    }
+
+    SocketSink socket(fd);
+    char header[256];
+    std::snprintf(header, sizeof(header),
+                  "HTTP/1.1 200 OK\r\n"
+                  "Content-Type: %s\r\n"
+                  "Transfer-Encoding: chunked\r\n"
+                  "Connection: close\r\n\r\n",
+                  req.format == FORMAT_SVG ? "image/svg+xml" : "text/plain");
+    CurveRenderer renderer(req.steps, req.format, req.width, req.height);
+    renderer.setSpacing(req.spacing);
+    try {
+        socket.write(header, std::strlen(header));
+        ChunkedSink chunked(socket);
+        // The pool already keeps every core busy, so each response is
+        // rendered on its worker alone
+        if (method == "GET") {
+            RandomCurveSource source(req.chains, req.curves, req.seed);
+            streamCurves(source, renderer, chunked, STREAM_BLOCK_CURVES, 1);
+        } else {
+            LineReader reader(fd, body, contentLength);
+            TextCurveSource source(reader);
+            streamCurves(source, renderer, chunked, STREAM_BLOCK_CURVES, 1);
+        }
+        chunked.finish();
+    } catch (const std::exception &) {
+        // The client went away, the body couldn't be read, or memory
+        // ran out; the response is already underway, so just drop the
+        // connection.
+    }
+}
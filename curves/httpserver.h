@@ -0,0 +1,123 @@
+/*
+  httpserver.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batchsampler.h"
+#include "parallel.h"
+
+static const int DEFAULT_PORT=4040;
+
+// Upper limits on what one request may ask for
+static const size_t MAX_CHAINS=1000000;
+static const size_t MAX_CURVES_PER_CHAIN=10000;
+static const size_t MAX_STEPS=10000;
+
+// Connections waiting for a worker before new ones are turned away
+static const size_t MAX_PENDING_CONNECTIONS=256;
+
+// Seconds a socket may go without sending or accepting data
+static const int CONNECTION_TIMEOUT_SECONDS=10;
+
+/*!
+  What to draw, from a request's query string.  The defaults match
+  bezier.go: one page of 20 chained curves with 40 steps each, different
+  on every request unless a seed is given.
+*/
+struct CurveRequest {
+    CurveRequest();
+
+    size_t chains;
+    size_t curves;
+    size_t steps;
+    unsigned int seed;
+    // True until a seed is given; the server then picks one per request
+    bool randomSeed;
+    size_t format;
+    size_t spacing;
+    int width;
+    int height;
+};
+
+/*!
+  Fills req from a query string such as "chains=100&steps=20".  Unknown
+  keys are ignored.  Returns false with a message in error if a value
+  is malformed or out of range.
+*/
+bool parseQuery(const std::string &query, CurveRequest &req, std::string &error);
+
+/*!
+  A small HTTP/1.1 server for curve pages.
+
+  GET / draws random chains as described by the query string.  POST /
+  draws the chains in the request body, one "x0 y0 x1 y1 ..." line per
+  chain.  Responses are chunked and streamed as they are rendered.
+
+  Connections are queued for a fixed pool of workers, one per core by
+  default, and each worker renders its response on its own thread.  So
+  however many clients there are, no more than that many threads are
+  rendering, and each holds at most a few blocks of text.  Connections
+  beyond MAX_PENDING_CONNECTIONS waiting for a worker get a 503.  A
+  client that stalls for CONNECTION_TIMEOUT_SECONDS while sending its
+  headers gets a 408, and one that stalls anywhere else is dropped, so
+  idle sockets can't hold on to the workers.
+*/
+class CurveServer {
+public:
+    CurveServer(const CurveRequest &defaults, size_t workers = parallelThreadCount());
+    ~CurveServer();
+
+    /*!
+      Binds to port on the loopback interface, or to any free port if
+      port is 0.  Throws std::runtime_error on failure.
+    */
+    void listen(int port);
+    int port() const { return boundPort; }
+
+    /*!
+      Serves connections until the process ends.  If accept fails the
+      workers finish their connections and the error is thrown.
+    */
+    void run();
+
+private:
+    void work();
+    void handle(int fd) const;
+
+    CurveRequest defaults;
+    int listenFd;
+    int boundPort;
+
+    size_t numWorkers;
+    std::vector<std::thread> workers;
+    std::deque<int> pending;
+    bool stopping;
+    std::mutex lock;
+    std::condition_variable connectionReady;
+};
+
+#endif
@@ -0,0 +1,168 @@
+/*
+  loadtest.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "loadtest.h"
+
+namespace {
+
+/*!
+  One complete request.  Returns the number of bytes received, or 0 if
+  the request failed or the response was cut short.
+*/
+size_t fetch(int port, const std::string &request) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return 0;
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        ::close(fd);
+        return 0;
+    }
+
+    size_t done = 0;
+    while (done < request.size()) {
+        ssize_t rc = ::send(fd, request.data() + done, request.size() - done, MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) {
+            ::close(fd);
+            return 0;
+        }
+        done += size_t(rc);
+    }
+
+    // Keep the status line and the tail to check the response is whole
+    static const char okStatus[] = "HTTP/1.1 200";
+    static const char lastChunk[] = "0\r\n\r\n";
+    char buf[1 << 16];
+    char head[sizeof(okStatus) - 1];
+    char tail[sizeof(lastChunk) - 1];
+    size_t total = 0;
+    size_t tailLen = 0;
+    for (;;) {
+        ssize_t got = ::recv(fd, buf, sizeof(buf), 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        for (ssize_t i=0; i<got; ++i) {
+            if (total + i < sizeof(head)) head[total + i] = buf[i];
+        }
+        if (size_t(got) >= sizeof(tail)) {
+            std::memcpy(tail, buf + got - sizeof(tail), sizeof(tail));
+            tailLen = sizeof(tail);
+        } else {
+            for (ssize_t i=0; i<got; ++i) {
+                std::memmove(tail, tail + 1, sizeof(tail) - 1);
+                tail[sizeof(tail) - 1] = buf[i];
+            }
+            tailLen = std::min(sizeof(tail), tailLen + size_t(got));
+        }
+        total += size_t(got);
+    }
+    ::close(fd);
+
+    if (total < sizeof(head) || std::memcmp(head, okStatus, sizeof(head)) != 0) return 0;
+    if (tailLen < sizeof(tail) || std::memcmp(tail, lastChunk, sizeof(tail)) != 0) return 0;
+    return total;
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t i = size_t(p*(sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+}
+
+LoadTestResult runLoadTest(int port, const CurveRequest &req,
+                           size_t numRequests, size_t numClients) {
+    typedef std::chrono::steady_clock Clock;
+
+    if (numClients == 0) numClients = 1;
+    if (numClients > numRequests) numClients = numRequests;
+
+    std::vector<double> latencies(numRequests, -1.0);
+    std::vector<size_t> received(numRequests, 0);
+    std::atomic<size_t> nextRequest(0);
+
+    auto client = [&]() {
+        for (;;) {
+            size_t i = nextRequest.fetch_add(1);
+            if (i >= numRequests) break;
+            char target[256];
+            std::snprintf(target, sizeof(target),
+                          "GET /?chains=%zu&curves=%zu&steps=%zu&seed=%zu&format=%s&spacing=%s HTTP/1.1\r\n"
+                          "Host: localhost\r\n"
+                          "Connection: close\r\n\r\n",
+                          req.chains, req.curves, req.steps, i,
+                          req.format == FORMAT_SVG ? "svg" : "polyline",
+                          req.spacing == SPACING_ARC_LENGTH ? "arclength" : "parameter");
+            Clock::time_point start = Clock::now();
+            received[i] = fetch(port, target);
+            latencies[i] = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+    };
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i=0; i<numClients; ++i) {
+        threads.push_back(std::thread(client));
+    }
+    for (size_t i=0; i<threads.size(); ++i) {
+        threads[i].join();
+    }
+
+    LoadTestResult result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.requests = numRequests;
+    result.failures = 0;
+    result.bytes = 0;
+    std::vector<double> ok;
+    for (size_t i=0; i<numRequests; ++i) {
+        if (received[i] == 0) {
+            ++result.failures;
+        } else {
+            result.bytes += received[i];
+            ok.push_back(latencies[i]);
+        }
+    }
+    result.curves = ok.size()*req.chains*req.curves;
+
+    std::sort(ok.begin(), ok.end());
+    result.p50 = percentile(ok, 0.50);
+    result.p99 = percentile(ok, 0.99);
+    result.maxLatency = ok.empty() ? 0.0 : ok.back();
+    return result;
+}
@@ -0,0 +1,47 @@
+/*
+  loadtest.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef LOADTEST_H
+#define LOADTEST_H
+
+#include <cstddef>
+
+#include "httpserver.h"
+
+struct LoadTestResult {
+    size_t requests;
+    size_t failures;
+    size_t curves;
+    size_t bytes;
+    double seconds;
+
+    // Request latencies in milliseconds
+    double p50;
+    double p99;
+    double maxLatency;
+};
+
+/*!
+  Sends numRequests GET requests for req to a server on the loopback
+  interface, numClients at a time, and times each one from connect to
+  the end of the response.  Every request uses a different seed.
+*/
+LoadTestResult runLoadTest(int port, const CurveRequest &req,
+                           size_t numRequests, size_t numClients);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+  main.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "curvestream.h"
+#include "httpserver.h"
+#include "loadtest.h"
+
+namespace {
+
+void usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "\n"
+              << "Reads chains of cubic Bezier curves from stdin, one per line as\n"
+              << "\"x0 y0 x1 y1 ...\" with 3n+1 points, and writes them to stdout.\n"
+              << "\n"
+              << "  --polyline         write \"x,y x,y ...\" lines instead of SVG\n"
+              << "  --arclength        space samples equally by arc length\n"
+              << "  --random N         draw N random chains instead of reading stdin\n"
+              << "  --curves N         curves per random chain (20)\n"
+              << "  --seed N           random seed (0; the server picks one per request)\n"
+              << "  --steps N          samples per curve (40)\n"
+              << "  --width N          output width (800)\n"
+              << "  --height N         output height (600)\n"
+              << "  --http PORT        serve curves over HTTP on 127.0.0.1:PORT\n"
+              << "  --bench            load test a server started in this process\n"
+              << "  --requests N       requests made by --bench (200)\n"
+              << "  --clients N        concurrent --bench clients (8)\n";
+}
+
+size_t sizeArg(int argc, char *argv[], int &i) {
+    if (i + 1 >= argc) {
+        throw std::runtime_error(std::string(argv[i]) + " needs a value");
+    }
+    std::string flag = argv[i];
+    const char *value = argv[++i];
+    char *end;
+    long v = std::strtol(value, &end, 10);
+    if (*end || v < 0) {
+        throw std::runtime_error("Bad value for " + flag + ": " + value);
+    }
+    return size_t(v);
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    CurveRequest req;
+    bool random = false;
+    bool bench = false;
+    int port = -1;
+    size_t requests = 200;
+    size_t clients = 8;
+
+    try {
+        for (int i=1; i<argc; ++i) {
+            if (!std::strcmp(argv[i], "--polyline")) {
+                req.format = FORMAT_POLYLINE;
+            } else if (!std::strcmp(argv[i], "--arclength")) {
+                req.spacing = SPACING_ARC_LENGTH;
+            } else if (!std::strcmp(argv[i], "--random")) {
+                req.chains = sizeArg(argc, argv, i);
+                random = true;
+            } else if (!std::strcmp(argv[i], "--curves")) {
+                req.curves = sizeArg(argc, argv, i);
+            } else if (!std::strcmp(argv[i], "--seed")) {
+                req.seed = (unsigned int)sizeArg(argc, argv, i);
+                req.randomSeed = false;
+            } else if (!std::strcmp(argv[i], "--steps")) {
+                req.steps = sizeArg(argc, argv, i);
+            } else if (!std::strcmp(argv[i], "--width")) {
+                req.width = int(sizeArg(argc, argv, i));
+            } else if (!std::strcmp(argv[i], "--height")) {
+                req.height = int(sizeArg(argc, argv, i));
+            } else if (!std::strcmp(argv[i], "--http")) {
+                port = int(sizeArg(argc, argv, i));
+            } else if (!std::strcmp(argv[i], "--bench")) {
+                bench = true;
+            } else if (!std::strcmp(argv[i], "--requests")) {
+                requests = sizeArg(argc, argv, i);
+            } else if (!std::strcmp(argv[i], "--clients")) {
+                clients = sizeArg(argc, argv, i);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        if (req.steps == 0 || req.curves == 0) {
+            throw std::runtime_error("--steps and --curves must be positive");
+        }
+    } catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        return 1;
+    }
+
+    // Broken pipes are reported through write errors instead
+    signal(SIGPIPE, SIG_IGN);
+
+    try {
+        if (bench) {
+            if (!random) req.chains = 50;
+            CurveServer server(req);
+            server.listen(port < 0 ? 0 : port);
+            std::thread([&server]() { server.run(); }).detach();
+
+            LoadTestResult r = runLoadTest(server.port(), req, requests, clients);
+            std::cout << r.requests << " requests, " << clients << " clients, "
+                      << req.chains << "x" << req.curves << " curves at "
+                      << req.steps << " steps each\n"
+                      << "  failures:   " << r.failures << "\n"
+                      << "  curves/sec: " << size_t(r.curves/r.seconds) << "\n"
+                      << "  MB/sec:     " << r.bytes/r.seconds/(1024.0*1024.0) << "\n"
+                      << "  latency ms: p50 " << r.p50 << ", p99 " << r.p99
+                      << ", max " << r.maxLatency << std::endl;
+            // The server thread is still blocked in accept
+            std::_Exit(r.failures ? 1 : 0);
+        }
+
+        if (port >= 0) {
+            CurveServer server(req);
+            server.listen(port);
+            std::cerr << "Serving on http://127.0.0.1:" << server.port() << "/" << std::endl;
+            server.run();
+            return 0;
+        }
+
+        CurveRenderer renderer(req.steps, req.format, req.width, req.height);
+        renderer.setSpacing(req.spacing);
+        FdSink out(STDOUT_FILENO);
+        if (random) {
+            RandomCurveSource source(req.chains, req.curves, req.seed);
+            streamCurves(source, renderer, out);
+        } else {
+            LineReader reader(STDIN_FILENO);
+            TextCurveSource source(reader);
+            streamCurves(source, renderer, out);
+            if (source.badLines()) {
+                std::cerr << "Skipped " << source.badLines() << " malformed lines" << std::endl;
+            }
+        }
+    } catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
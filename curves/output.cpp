@@ -0,0 +1,90 @@
+/*
+  output.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "output.h"
+
+FdSink::FdSink(int f, size_t bufferSize) : fd(f), buffer(bufferSize), used(0) {
+}
+
+FdSink::~FdSink() {
+    try {
+        flush();
+    } catch (const std::runtime_error &) {
+        // Nothing sensible to do about it here
+    }
+}
+
+void FdSink::write(const char *data, size_t n) {
+    if (used + n > buffer.size()) {
+        flush();
+    }
+    if (n >= buffer.size()) {
+        // Too big to be worth copying into the buffer
+        size_t done = 0;
+        while (done < n) {
+            ssize_t rc = ::write(fd, data + done, n - done);
+            if (rc < 0 && errno == EINTR) continue;
+            if (rc <= 0) throw std::runtime_error(std::string("write failed: ") + std::strerror(errno));
+            done += size_t(rc);
+        }
+        return;
+    }
+    std::memcpy(&buffer[used], data, n);
+    used += n;
+}
+
+void FdSink::flush() {
+    size_t done = 0;
+    while (done < used) {
+        ssize_t rc = ::write(fd, &buffer[done], used - done);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) {
+            used = 0;
+            throw std::runtime_error(std::string("write failed: ") + std::strerror(errno));
+        }
+        done += size_t(rc);
+    }
+    used = 0;
+}
+
+ChunkedSink::ChunkedSink(ByteSink &o) : out(o) {
+}
+
+void ChunkedSink::write(const char *data, size_t n) {
+    if (n == 0) return;
+    char header[32];
+    int len = std::snprintf(header, sizeof(header), "%zx\r\n", n);
+    out.write(header, size_t(len));
+    out.write(data, n);
+    out.write("\r\n", 2);
+}
+
+void ChunkedSink::flush() {
+    out.flush();
+}
+
+void ChunkedSink::finish() {
+    out.write("0\r\n\r\n", 5);
+    out.flush();
+}
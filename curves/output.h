@@ -0,0 +1,85 @@
+/*
+  output.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*!
+  Somewhere to send bytes.  Throws std::runtime_error if the other end
+  goes away.
+*/
+class ByteSink {
+public:
+    virtual ~ByteSink() {}
+    virtual void write(const char *data, size_t n) = 0;
+    virtual void flush() {}
+
+    void write(const std::string &s) { write(s.data(), s.size()); }
+};
+
+/*!
+  Buffered writes to a file descriptor (stdout or a socket).
+*/
+class FdSink : public ByteSink {
+public:
+    FdSink(int fd, size_t bufferSize = 1 << 16);
+    ~FdSink();
+
+    void write(const char *data, size_t n);
+    void flush();
+
+private:
+    int fd;
+    std::vector<char> buffer;
+    size_t used;
+};
+
+/*!
+  Wraps another sink in HTTP/1.1 chunked transfer encoding, so a
+  response can be sent before its length is known.
+*/
+class ChunkedSink : public ByteSink {
+public:
+    ChunkedSink(ByteSink &out);
+
+    void write(const char *data, size_t n);
+    void flush();
+    // Writes the terminating zero length chunk
+    void finish();
+
+private:
+    ByteSink &out;
+};
+
+/*!
+  Throws everything away but counts it.  Used by the load test.
+*/
+class CountingSink : public ByteSink {
+public:
+    CountingSink() : total(0) {}
+
+    void write(const char *, size_t n) { total += n; }
+
+    size_t total;
+};
+
+#endif
@@ -0,0 +1,309 @@
+/*
+  arclength.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "arclength.h"
+
+namespace {
+
+const size_t GL_POINTS = ARCLENGTH_GL_POINTS;
+
+// Newton steps after the linear guess.  Each roughly squares the error;
+// the guess can be off by a few percent of a piece where the speed
+// varies, so it takes three to get near the tolerance the table is
+// built to.
+const size_t NEWTON_STEPS = 3;
+
+// Lengths inverted together by paramsAt; the per-lookup state fits in L1
+const size_t PARAM_BLOCK = 256;
+
+// Gauss-Legendre nodes and weights mapped to [0, 1]
+const double glNodes[GL_POINTS] = {
+    0.5 - 0.5*0.9061798459386640, 0.5 - 0.5*0.5384693101056831, 0.5,
+    0.5 + 0.5*0.5384693101056831, 0.5 + 0.5*0.9061798459386640
+};
+const double glWeights[GL_POINTS] = {
+    0.5*0.2369268850561891, 0.5*0.4786286704993665, 0.5*0.5688888888888889,
+    0.5*0.4786286704993665, 0.5*0.2369268850561891
+};
+
+/*!
+  Monomial coefficients of the Lagrange basis polynomials on glNodes,
+  already integrated: basis[k][j] is the coefficient of u^(j+1) in the
+  integral of the k'th basis polynomial.
+*/
+struct IntegratedBasis {
+    double c[GL_POINTS][GL_POINTS];
+
+    IntegratedBasis() {
+        for (size_t k=0; k<GL_POINTS; ++k) {
+            double poly[GL_POINTS] = { 1.0, 0.0, 0.0, 0.0, 0.0 };
+            size_t degree = 0;
+            for (size_t j=0; j<GL_POINTS; ++j) {
+                if (j == k) continue;
+                double scale = 1.0/(glNodes[k] - glNodes[j]);
+                // poly *= (u - node_j)*scale
+                for (size_t d=degree+1; d>0; --d) {
+                    poly[d] = (poly[d-1] - glNodes[j]*poly[d])*scale;
+                }
+                poly[0] = -glNodes[j]*poly[0]*scale;
+                ++degree;
+            }
+            for (size_t j=0; j<GL_POINTS; ++j) {
+                c[k][j] = poly[j]/double(j + 1);
+            }
+        }
+    }
+};
+
+const IntegratedBasis &integratedBasis() {
+    static const IntegratedBasis basis;
+    return basis;
+}
+
+}
+
+ArcLengthTable::ArcLengthTable() : tStart(0.0), tEnd(0.0) {
+}
+
+void ArcLengthTable::clear() {
+    t0s.clear();
+    dts.clear();
+    cumulative.clear();
+    q.clear();
+    tStart = tEnd = 0.0;
+}
+
+// Fills in the quadrature nodes of each piece, evaluates them all at once
+void ArcLengthTable::evalPieces(const SpeedFunction &speed, std::vector<Piece> &pieces) {
+    nodeTs.resize(GL_POINTS*pieces.size());
+    nodeSpeeds.resize(nodeTs.size());
+    for (size_t i=0; i<pieces.size(); ++i) {
+        for (size_t k=0; k<GL_POINTS; ++k) {
+            nodeTs[GL_POINTS*i + k] = pieces[i].t0 + glNodes[k]*pieces[i].dt;
+        }
+    }
+    if (!nodeTs.empty()) speed(&nodeTs[0], &nodeSpeeds[0], nodeTs.size());
+    for (size_t i=0; i<pieces.size(); ++i) {
+        double sum = 0.0;
+        for (size_t k=0; k<GL_POINTS; ++k) {
+            double v = nodeSpeeds[GL_POINTS*i + k];
+            // Treat NaN as a stationary point rather than poisoning the table
+            if (!(v >= 0.0)) v = 0.0;
+            pieces[i].speeds[k] = v;
+            sum += glWeights[k]*v;
+        }
+        pieces[i].length = sum*pieces[i].dt;
+    }
+}
+
+void ArcLengthTable::build(const SpeedFunction &speed, double t0, double t1,
+                           double tolerance, size_t initialPieces, size_t maxPieces) {
+    clear();
+    tStart = t0;
+    tEnd = t1;
+    if (initialPieces == 0) initialPieces = 1;
+    if (maxPieces < initialPieces) maxPieces = initialPieces;
+
+    pending.resize(initialPieces);
+    for (size_t i=0; i<initialPieces; ++i) {
+        pending[i].t0 = t0 + (t1 - t0)*double(i)/initialPieces;
+        pending[i].dt = (t1 - t0)/initialPieces;
+    }
+    evalPieces(speed, pending);
+
+    double estimate = 0.0;
+    for (size_t i=0; i<pending.size(); ++i) {
+        estimate += pending[i].length;
+    }
+    const double absTol = tolerance*std::max(estimate, 1.0e-300);
+
+    // Refine a level at a time so every level is one batched call.
+    // Accepted pieces are kept out of order and sorted at the end.
+    accepted.clear();
+    while (!pending.empty()) {
+        halves.resize(2*pending.size());
+        for (size_t i=0; i<pending.size(); ++i) {
+            halves[2*i].t0 = pending[i].t0;
+            halves[2*i].dt = halves[2*i+1].dt = 0.5*pending[i].dt;
+            halves[2*i+1].t0 = pending[i].t0 + 0.5*pending[i].dt;
+        }
+        evalPieces(speed, halves);
+
+        refine.clear();
+        for (size_t i=0; i<pending.size(); ++i) {
+            double split = halves[2*i].length + halves[2*i+1].length;
+            double err = std::fabs(split - pending[i].length);
+            // Budget the tolerance by the piece's share of the range
+            double allowed = absTol*pending[i].dt/std::fabs(t1 - t0);
+            size_t total = accepted.size() + 2*refine.size() + 2*(pending.size() - i);
+            if (err <= allowed || total > maxPieces || pending[i].dt == 0.0) {
+                accepted.push_back(halves[2*i]);
+                accepted.push_back(halves[2*i+1]);
+            } else {
+                refine.push_back(halves[2*i]);
+                refine.push_back(halves[2*i+1]);
+            }
+        }
+        pending.swap(refine);
+    }
+    std::sort(accepted.begin(), accepted.end(),
+              [](const Piece &a, const Piece &b) { return a.t0 < b.t0; });
+
+    const IntegratedBasis &basis = integratedBasis();
+    const size_t n = accepted.size();
+    t0s.resize(n);
+    dts.resize(n);
+    cumulative.resize(n + 1);
+    q.assign(GL_POINTS*n, 0.0);
+    cumulative[0] = 0.0;
+    for (size_t i=0; i<n; ++i) {
+        t0s[i] = accepted[i].t0;
+        dts[i] = accepted[i].dt;
+        for (size_t k=0; k<GL_POINTS; ++k) {
+            double v = accepted[i].speeds[k]*accepted[i].dt;
+            for (size_t j=0; j<GL_POINTS; ++j) {
+                q[GL_POINTS*i + j] += v*basis.c[k][j];
+            }
+        }
+        cumulative[i+1] = cumulative[i] + accepted[i].length;
+    }
+}
+
+size_t ArcLengthTable::findPiece(const std::vector<double> &keys, double v) const {
+    // Last i in [0, numPieces()) with keys[i] <= v, without branches
+    size_t base = 0;
+    size_t n = t0s.size();
+    while (n > 1) {
+        size_t half = n/2;
+        base = (keys[base + half] <= v) ? base + half : base;
+        n -= half;
+    }
+    return base;
+}
+
+double ArcLengthTable::lengthAt(double t) const {
+    if (t0s.empty()) return 0.0;
+    size_t i = findPiece(t0s, t);
+    double u = (dts[i] != 0.0) ? (t - t0s[i])/dts[i] : 0.0;
+    u = std::min(std::max(u, 0.0), 1.0);
+    const double *c = &q[GL_POINTS*i];
+    return cumulative[i] + u*(c[0] + u*(c[1] + u*(c[2] + u*(c[3] + u*c[4]))));
+}
+
+double ArcLengthTable::solve(size_t i, double s) const {
+    const double *c = &q[GL_POINTS*i];
+    double target = s - cumulative[i];
+    double len = cumulative[i+1] - cumulative[i];
+    double u = (len > 0.0) ? target/len : 0.0;
+    for (size_t step=0; step<NEWTON_STEPS; ++step) {
+        double f = u*(c[0] + u*(c[1] + u*(c[2] + u*(c[3] + u*c[4])))) - target;
+        double df = c[0] + u*(2.0*c[1] + u*(3.0*c[2] + u*(4.0*c[3] + u*5.0*c[4])));
+        // A stationary point inside the piece leaves u where it is
+        u -= (df > 0.0) ? f/df : 0.0;
+        u = std::min(std::max(u, 0.0), 1.0);
+    }
+    return t0s[i] + u*dts[i];
+}
+
+double ArcLengthTable::paramAt(double s) const {
+    if (t0s.empty()) return tStart;
+    s = std::min(std::max(s, 0.0), cumulative.back());
+    return solve(findPiece(cumulative, s), s);
+}
+
+/*!
+  Inverts a block at a time in two sweeps over the whole block: the
+  binary search runs one level for every length before the next, since
+  every search takes the same number of levels, and then every lookup
+  takes its Newton steps together.  Each sweep is a straight loop over
+  arrays with no branches on the data.
+*/
+void ArcLengthTable::paramsAt(const double *s, double *t, size_t n) const {
+    if (t0s.empty()) {
+        std::fill(t, t + n, tStart);
+        return;
+    }
+    const double total = cumulative.back();
+    const size_t numPieces = t0s.size();
+    size_t piece[PARAM_BLOCK];
+    double target[PARAM_BLOCK], u[PARAM_BLOCK];
+
+    for (size_t first=0; first<n; first+=PARAM_BLOCK) {
+        const size_t count = std::min(PARAM_BLOCK, n - first);
+        const double *sb = s + first;
+        for (size_t k=0; k<count; ++k) {
+            target[k] = std::min(std::max(sb[k], 0.0), total);
+            piece[k] = 0;
+        }
+
+        for (size_t len=numPieces; len>1; ) {
+            const size_t half = len/2;
+            for (size_t k=0; k<count; ++k) {
+                piece[k] = (cumulative[piece[k] + half] <= target[k]) ? piece[k] + half : piece[k];
+            }
+            len -= half;
+        }
+
+        // Linear guess within each piece
+        for (size_t k=0; k<count; ++k) {
+            const size_t i = piece[k];
+            target[k] -= cumulative[i];
+            const double len = cumulative[i+1] - cumulative[i];
+            u[k] = (len > 0.0) ? target[k]/len : 0.0;
+        }
+        for (size_t step=0; step<NEWTON_STEPS; ++step) {
+            for (size_t k=0; k<count; ++k) {
+                const double *c = &q[GL_POINTS*piece[k]];
+                const double uk = u[k];
+                double f = uk*(c[0] + uk*(c[1] + uk*(c[2] + uk*(c[3] + uk*c[4])))) - target[k];
+                double df = c[0] + uk*(2.0*c[1] + uk*(3.0*c[2] + uk*(4.0*c[3] + uk*5.0*c[4])));
+                double next = uk - ((df > 0.0) ? f/df : 0.0);
+                u[k] = std::min(std::max(next, 0.0), 1.0);
+            }
+        }
+
+        // s and t may be the same array; this block of s has been read
+        double *tb = t + first;
+        for (size_t k=0; k<count; ++k) {
+            tb[k] = t0s[piece[k]] + u[k]*dts[piece[k]];
+        }
+    }
+}
+
+void ArcLengthTable::uniformParams(size_t count, double *t) const {
+    if (count == 0) return;
+    if (count == 1) {
+        t[0] = tStart;
+        return;
+    }
+    if (t0s.empty()) {
+        std::fill(t, t + count, tStart);
+        return;
+    }
+    const double step = length()/double(count - 1);
+    for (size_t k=1; k+1<count; ++k) {
+        t[k] = step*double(k);
+    }
+    paramsAt(t + 1, t + 1, count - 2);
+    // Pin the ends exactly
+    t[0] = tStart;
+    t[count-1] = tEnd;
+}
@@ -0,0 +1,111 @@
+/*
+  arclength.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef ARCLENGTH_H
+#define ARCLENGTH_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Gauss-Legendre points per piece
+static const size_t ARCLENGTH_GL_POINTS=5;
+
+/*!
+  Evaluates |C'(t)| at n parameter values.  Called with whole batches
+  of quadrature nodes so it can be backed by a batched evaluator.
+*/
+typedef std::function<void (const double *t, double *speed, size_t n)> SpeedFunction;
+
+/*!
+  Arc length of a curve as a function of its parameter, and back.
+
+  The parameter range is split adaptively until 5 point Gauss-Legendre
+  quadrature on each piece agrees with the sum over its two halves.
+  Each piece keeps the polynomial through its node speeds, which
+  Gauss-Legendre integrates exactly, so s(t) is a short polynomial per
+  piece and consistent with the piece totals.
+
+  t(s) finds the piece with a branch free binary search over the
+  cumulative lengths and finishes with a fixed number of Newton steps
+  on that polynomial, starting from linear interpolation.
+*/
+class ArcLengthTable {
+public:
+    ArcLengthTable();
+
+    /*!
+      Builds the table for [t0, t1].  tolerance is relative to the total
+      length.  The range starts out split into initialPieces pieces and
+      is never split into more than maxPieces.
+    */
+    void build(const SpeedFunction &speed, double t0, double t1,
+               double tolerance = 1.0e-10, size_t initialPieces = 4,
+               size_t maxPieces = 4096);
+    void clear();
+
+    bool empty() const { return t0s.empty(); }
+    size_t numPieces() const { return t0s.size(); }
+    double length() const { return cumulative.empty() ? 0.0 : cumulative.back(); }
+    double tMin() const { return tStart; }
+    double tMax() const { return tEnd; }
+
+    // Arc length from tMin() to t
+    double lengthAt(double t) const;
+
+    // Parameter at arc length s, clamped to the curve
+    double paramAt(double s) const;
+
+    // paramAt for n lengths at once.  s and t may be the same array.
+    void paramsAt(const double *s, double *t, size_t n) const;
+
+    // count parameters (count >= 2) spaced equally by arc length
+    void uniformParams(size_t count, double *t) const;
+
+private:
+    struct Piece {
+        double t0;
+        double dt;
+        double length;
+        double speeds[ARCLENGTH_GL_POINTS];
+    };
+
+    void evalPieces(const SpeedFunction &speed, std::vector<Piece> &pieces);
+    size_t findPiece(const std::vector<double> &keys, double v) const;
+    double solve(size_t piece, double s) const;
+
+    double tStart;
+    double tEnd;
+
+    // One entry per piece, plus the end for cumulative
+    std::vector<double> t0s;
+    std::vector<double> dts;
+    std::vector<double> cumulative;
+
+    /*!
+      Length within piece i at local u in [0, 1] is
+      u*(q0 + u*(q1 + u*(q2 + u*(q3 + u*q4)))), q stored 5 per piece.
+    */
+    std::vector<double> q;
+
+    // Scratch space kept between builds
+    std::vector<Piece> pending, halves, refine, accepted;
+    std::vector<double> nodeTs, nodeSpeeds;
+};
+
+#endif
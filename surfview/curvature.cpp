@@ -0,0 +1,147 @@
+/*
+  curvature.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#include "curvature.h"
+
+namespace {
+
+const size_t BINS_PER_SIGN = size_t(CURVATURE_MAX_EXP - CURVATURE_MIN_EXP) << CURVATURE_OCTAVE_BITS;
+const size_t ZERO_BIN = BINS_PER_SIGN;
+
+// Start of the key'th magnitude bin
+double magnitude(size_t key) {
+    const size_t steps = size_t(1) << CURVATURE_OCTAVE_BITS;
+    return std::ldexp(1.0 + double(key & (steps - 1))/steps,
+                      CURVATURE_MIN_EXP + int(key >> CURVATURE_OCTAVE_BITS));
+}
+
+size_t binOf(float k) {
+    float a = std::fabs(k);
+    uint32_t bits;
+    std::memcpy(&bits, &a, sizeof(bits));
+    // Exponent and leading mantissa bits, counted from 2^CURVATURE_MIN_EXP
+    int64_t key = int64_t(bits >> (23 - CURVATURE_OCTAVE_BITS)) -
+        (int64_t(127 + CURVATURE_MIN_EXP) << CURVATURE_OCTAVE_BITS);
+    if (key < 0) return ZERO_BIN;
+    if (key >= int64_t(BINS_PER_SIGN)) key = BINS_PER_SIGN - 1;
+    return (k < 0.0f) ? ZERO_BIN - 1 - size_t(key) : ZERO_BIN + 1 + size_t(key);
+}
+
+}
+
+void surfaceCurvatures(const double *const *partials, size_t n, float *curv) {
+    const double *pu[3] = { partials[0], partials[1], partials[2] };
+    const double *pv[3] = { partials[3], partials[4], partials[5] };
+    const double *puu[3] = { partials[6], partials[7], partials[8] };
+    const double *puv[3] = { partials[9], partials[10], partials[11] };
+    const double *pvv[3] = { partials[12], partials[13], partials[14] };
+
+    for (size_t i=0; i<n; ++i) {
+        double nx = pu[1][i]*pv[2][i] - pu[2][i]*pv[1][i];
+        double ny = pu[2][i]*pv[0][i] - pu[0][i]*pv[2][i];
+        double nz = pu[0][i]*pv[1][i] - pu[1][i]*pv[0][i];
+        // |pu x pv|^2 = EG - F^2
+        double det = nx*nx + ny*ny + nz*nz;
+        bool ok = det > 1.0e-24;
+        double invDet = ok ? 1.0/det : 0.0;
+        double invLen = std::sqrt(invDet);
+
+        double E = pu[0][i]*pu[0][i] + pu[1][i]*pu[1][i] + pu[2][i]*pu[2][i];
+        double F = pu[0][i]*pv[0][i] + pu[1][i]*pv[1][i] + pu[2][i]*pv[2][i];
+        double G = pv[0][i]*pv[0][i] + pv[1][i]*pv[1][i] + pv[2][i]*pv[2][i];
+        double L = (puu[0][i]*nx + puu[1][i]*ny + puu[2][i]*nz)*invLen;
+        double M = (puv[0][i]*nx + puv[1][i]*ny + puv[2][i]*nz)*invLen;
+        double N = (pvv[0][i]*nx + pvv[1][i]*ny + pvv[2][i]*nz)*invLen;
+
+        double K = (L*N - M*M)*invDet;
+        double H = 0.5*(E*N - 2.0*F*M + G*L)*invDet;
+        double disc = std::sqrt(std::max(H*H - K, 0.0));
+        float *c = &curv[NUM_CURVATURES*i];
+        c[CURVATURE_GAUSSIAN] = float(K);
+        c[CURVATURE_MEAN] = float(H);
+        c[CURVATURE_MAX] = float(H + disc);
+        c[CURVATURE_MIN] = float(H - disc);
+    }
+}
+
+CurvatureHistogram::CurvatureHistogram() : bins(CURVATURE_BINS, 0), total(0), lo(0.0f), hi(0.0f) {
+}
+
+void CurvatureHistogram::clear() {
+    bins.assign(CURVATURE_BINS, 0);
+    total = 0;
+    lo = hi = 0.0f;
+}
+
+void CurvatureHistogram::add(float k) {
+    if (!std::isfinite(k)) return;
+    if (total == 0) {
+        lo = hi = k;
+    } else {
+        lo = std::min(lo, k);
+        hi = std::max(hi, k);
+    }
+    ++bins[binOf(k)];
+    ++total;
+}
+
+void CurvatureHistogram::merge(const CurvatureHistogram &other) {
+    if (other.total == 0) return;
+    if (total == 0) {
+        lo = other.lo;
+        hi = other.hi;
+    } else {
+        lo = std::min(lo, other.lo);
+        hi = std::max(hi, other.hi);
+    }
+    for (size_t i=0; i<CURVATURE_BINS; ++i) {
+        bins[i] += other.bins[i];
+    }
+    total += other.total;
+}
+
+double CurvatureHistogram::binValue(size_t bin) {
+    if (bin < ZERO_BIN) return -magnitude(ZERO_BIN - bin);
+    if (bin == ZERO_BIN) return -magnitude(0);
+    return magnitude(bin - ZERO_BIN - 1);
+}
+
+/*!
+  Walks the bins to the one holding the requested sample and
+  interpolates inside it
+*/
+float CurvatureHistogram::percentile(double fraction) const {
+    if (total == 0) return 0.0f;
+    double target = std::min(std::max(fraction, 0.0), 1.0)*total;
+    double seen = 0.0;
+    for (size_t i=0; i<CURVATURE_BINS; ++i) {
+        if (bins[i] == 0 || seen + bins[i] < target) {
+            seen += bins[i];
+            continue;
+        }
+        double t = (target - seen)/bins[i];
+        double k = binValue(i) + t*(binValue(i + 1) - binValue(i));
+        return float(std::min(std::max(k, double(lo)), double(hi)));
+    }
+    return hi;
+}
@@ -0,0 +1,84 @@
+/*
+  curvature.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef CURVATURE_H
+#define CURVATURE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "mesh.h"
+
+// Curvature histograms have 2^CURVATURE_OCTAVE_BITS bins per power of
+// two between 2^CURVATURE_MIN_EXP and 2^CURVATURE_MAX_EXP, each sign
+static const int CURVATURE_MIN_EXP=-20;
+static const int CURVATURE_MAX_EXP=20;
+static const int CURVATURE_OCTAVE_BITS=4;
+static const size_t CURVATURE_BINS=2*(size_t(CURVATURE_MAX_EXP - CURVATURE_MIN_EXP) << CURVATURE_OCTAVE_BITS) + 1;
+
+/*!
+  Curvatures of a parametric surface at n points from its partials, in
+  the order of Mesh::curvature.  partials holds 15 arrays of n values:
+  the x, y and z components of pu, pv, puu, puv and pvv.  The sign
+  follows the normal pu x pv.  Points where pu and pv don't span a
+  tangent plane get zeros.
+
+  The loop has no branches, so the compiler can vectorize it.
+*/
+void surfaceCurvatures(const double *const *partials, size_t n, float *curv);
+
+/*!
+  Distribution of a curvature over a mesh, built in the same pass that
+  computes it.
+
+  Curvature has no natural range, and a pole or cusp can throw the
+  extremes off by orders of magnitude, so the bins can't wait for the
+  range to be known.  Instead they're fixed and spaced like floating
+  point numbers, which gives every magnitude the same relative
+  resolution and lets a bin be read off the bits of a float without
+  calling log.  The middle bin holds everything too small for the
+  rest, and the end bins everything too big.  Percentiles then give a
+  range that ignores outliers.
+*/
+class CurvatureHistogram {
+public:
+    CurvatureHistogram();
+
+    void clear();
+    void add(float k);
+    // Adds other's samples, for combining histograms built in parallel
+    void merge(const CurvatureHistogram &other);
+
+    size_t count() const { return total; }
+    size_t binCount(size_t bin) const { return bins[bin]; }
+    float minValue() const { return lo; }
+    float maxValue() const { return hi; }
+
+    // The value fraction of the samples are below, to within a bin
+    float percentile(double fraction) const;
+
+    // Lower edge of a bin; binValue(CURVATURE_BINS) is the top
+    static double binValue(size_t bin);
+
+private:
+    std::vector<unsigned int> bins;
+    size_t total;
+    float lo, hi;
+};
+
+#endif
@@ -0,0 +1,1004 @@
+/*
+  expression.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <locale>
+#include <sstream>
+
+#include "expression.h"
+
+namespace {
+
+const int MAX_POWI = 64;
+
+/*!
+  Applies op to constant arguments.  Used for constant folding.
+*/
+double applyOp(ExprOp op, double a, double b, int ival) {
+    switch (op) {
+    case EXPR_ADD: return a + b;
+    case EXPR_SUB: return a - b;
+    case EXPR_MUL: return a * b;
+    case EXPR_DIV: return a / b;
+    case EXPR_POW: return std::pow(a, b);
+    case EXPR_POWI: return std::pow(a, double(ival));
+    case EXPR_NEG: return -a;
+    case EXPR_SIN: return std::sin(a);
+    case EXPR_COS: return std::cos(a);
+    case EXPR_TAN: return std::tan(a);
+    case EXPR_ATAN: return std::atan(a);
+    case EXPR_EXP: return std::exp(a);
+    case EXPR_LOG: return std::log(a);
+    case EXPR_SQRT: return std::sqrt(a);
+    case EXPR_ABS: return std::fabs(a);
+    case EXPR_SIGN: return double((a > 0.0) - (a < 0.0));
+    case EXPR_SINH: return std::sinh(a);
+    case EXPR_COSH: return std::cosh(a);
+    default: return 0.0;
+    }
+}
+
+Interval makeInterval(double a, double b) {
+    Interval r;
+    r.lo = std::min(a, b);
+    r.hi = std::max(a, b);
+    return r;
+}
+
+Interval intervalMul(const Interval &a, const Interval &b) {
+    double p0 = a.lo*b.lo, p1 = a.lo*b.hi, p2 = a.hi*b.lo, p3 = a.hi*b.hi;
+    if (p0 != p0 || p1 != p1 || p2 != p2 || p3 != p3) {
+        // 0*inf, so give up on bounding it
+        return makeInterval(-HUGE_VAL, HUGE_VAL);
+    }
+    Interval r;
+    r.lo = std::min(std::min(p0, p1), std::min(p2, p3));
+    r.hi = std::max(std::max(p0, p1), std::max(p2, p3));
+    return r;
+}
+
+Interval intervalRecip(const Interval &a) {
+    if (a.lo <= 0.0 && a.hi >= 0.0) {
+        return makeInterval(-HUGE_VAL, HUGE_VAL);
+    }
+    return makeInterval(1.0/a.lo, 1.0/a.hi);
+}
+
+Interval intervalPowi(const Interval &a, int n) {
+    if (n < 0) {
+        return intervalRecip(intervalPowi(a, -n));
+    }
+    double l = std::pow(a.lo, double(n));
+    double h = std::pow(a.hi, double(n));
+    if (n % 2 == 1) {
+        return makeInterval(l, h);
+    }
+    if (a.lo <= 0.0 && a.hi >= 0.0) {
+        return makeInterval(0.0, std::max(l, h));
+    }
+    return makeInterval(l, h);
+}
+
+/*!
+  Range of sin over a: the endpoints, widened to +/-1 if a peak or
+  trough lies inside.
+*/
+Interval intervalSin(const Interval &a) {
+    if (!(a.hi - a.lo < 2.0*M_PI)) {
+        return makeInterval(-1.0, 1.0);
+    }
+    Interval r = makeInterval(std::sin(a.lo), std::sin(a.hi));
+    // First peak (pi/2 + 2k*pi) and trough (3pi/2 + 2k*pi) at or after lo
+    double peak = M_PI_2 + 2.0*M_PI*std::ceil((a.lo - M_PI_2)/(2.0*M_PI));
+    double trough = 3.0*M_PI_2 + 2.0*M_PI*std::ceil((a.lo - 3.0*M_PI_2)/(2.0*M_PI));
+    if (peak <= a.hi) r.hi = 1.0;
+    if (trough <= a.hi) r.lo = -1.0;
+    return r;
+}
+
+Interval intervalUnary(ExprOp op, const Interval &a) {
+    Interval r;
+    switch (op) {
+    case EXPR_NEG:
+        return makeInterval(-a.hi, -a.lo);
+    case EXPR_SIN:
+        return intervalSin(a);
+    case EXPR_COS: {
+        Interval shifted = makeInterval(a.lo + M_PI_2, a.hi + M_PI_2);
+        return intervalSin(shifted);
+    }
+    case EXPR_TAN: {
+        // Unbounded if a pole (pi/2 + k*pi) is inside
+        double pole = M_PI_2 + M_PI*std::ceil((a.lo - M_PI_2)/M_PI);
+        if (pole <= a.hi) return makeInterval(-HUGE_VAL, HUGE_VAL);
+        return makeInterval(std::tan(a.lo), std::tan(a.hi));
+    }
+    case EXPR_ATAN:
+        return makeInterval(std::atan(a.lo), std::atan(a.hi));
+    case EXPR_EXP:
+        return makeInterval(std::exp(a.lo), std::exp(a.hi));
+    case EXPR_LOG:
+        r.lo = (a.lo > 0.0) ? std::log(a.lo) : -HUGE_VAL;
+        r.hi = std::log(a.hi);
+        return r;
+    case EXPR_SQRT:
+        r.lo = (a.lo > 0.0) ? std::sqrt(a.lo) : 0.0;
+        r.hi = std::sqrt(a.hi);
+        return r;
+    case EXPR_ABS:
+        if (a.lo >= 0.0) return a;
+        if (a.hi <= 0.0) return makeInterval(-a.hi, -a.lo);
+        return makeInterval(0.0, std::max(-a.lo, a.hi));
+    case EXPR_SIGN:
+        return makeInterval(double((a.lo > 0.0) - (a.lo < 0.0)),
+                            double((a.hi > 0.0) - (a.hi < 0.0)));
+    case EXPR_SINH:
+        return makeInterval(std::sinh(a.lo), std::sinh(a.hi));
+    case EXPR_COSH:
+        if (a.lo <= 0.0 && a.hi >= 0.0) {
+            return makeInterval(1.0, std::max(std::cosh(a.lo), std::cosh(a.hi)));
+        }
+        return makeInterval(std::cosh(a.lo), std::cosh(a.hi));
+    default:
+        return a;
+    }
+}
+
+bool isUnary(ExprOp op) {
+    return op == EXPR_NEG || op >= EXPR_SIN;
+}
+
+/*!
+  Recursive descent parser that builds nodes directly in an ExprGraph.
+
+  expr    := term (('+'|'-') term)*
+  term    := unary (('*'|'/') unary)*
+  unary   := ('-'|'+') unary | power
+  power   := primary ('^' unary)?
+  primary := number | name | name '(' expr (',' expr)* ')' | '(' expr ')'
+*/
+class Parser {
+public:
+    Parser(ExprGraph &g, const std::string &s) : graph(g), src(s), pos(0) {}
+
+    int parseAll() {
+        int rval = expr();
+        skipSpace();
+        if (pos != src.size()) {
+            fail("Unexpected '" + src.substr(pos, 1) + "'");
+        }
+        return rval;
+    }
+
+private:
+    void fail(const std::string &msg) {
+        std::ostringstream err;
+        err << msg << " at position " << pos;
+        throw ExprError(err.str(), pos);
+    }
+
+    void skipSpace() {
+        while (pos < src.size() && std::isspace((unsigned char)src[pos])) ++pos;
+    }
+
+    bool accept(char c) {
+        skipSpace();
+        if (pos < src.size() && src[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!accept(c)) {
+            fail(std::string("Expected '") + c + "'");
+        }
+    }
+
+    int expr() {
+        int lhs = term();
+        for (;;) {
+            if (accept('+')) {
+                lhs = graph.binary(EXPR_ADD, lhs, term());
+            } else if (accept('-')) {
+                lhs = graph.binary(EXPR_SUB, lhs, term());
+            } else {
+                return lhs;
+            }
+        }
+    }
+
+    int term() {
+        int lhs = unary();
+        for (;;) {
+            if (accept('*')) {
+                lhs = graph.binary(EXPR_MUL, lhs, unary());
+            } else if (accept('/')) {
+                lhs = graph.binary(EXPR_DIV, lhs, unary());
+            } else {
+                return lhs;
+            }
+        }
+    }
+
+    int unary() {
+        if (accept('-')) {
+            return graph.unary(EXPR_NEG, unary());
+        }
+        if (accept('+')) {
+            return unary();
+        }
+        return power();
+    }
+
+    int power() {
+        int base = primary();
+        if (accept('^')) {
+            return graph.binary(EXPR_POW, base, unary());
+        }
+        return base;
+    }
+
+    int primary() {
+        skipSpace();
+        if (pos >= src.size()) {
+            fail("Unexpected end of expression");
+        }
+        char c = src[pos];
+        if (std::isdigit((unsigned char)c) || c == '.') {
+            // Not strtod, which would want a comma under some locales
+            std::istringstream in(src.substr(pos));
+            in.imbue(std::locale::classic());
+            double val = 0.0;
+            if (!(in >> val)) {
+                fail("Malformed number");
+            }
+            pos = in.eof() ? src.size() : pos + size_t(in.tellg());
+            return graph.constant(val);
+        }
+        if (accept('(')) {
+            int rval = expr();
+            expect(')');
+            return rval;
+        }
+        if (!(std::isalpha((unsigned char)c) || c == '_')) {
+            fail(std::string("Unexpected '") + c + "'");
+        }
+
+        size_t start = pos;
+        while (pos < src.size() &&
+               (std::isalnum((unsigned char)src[pos]) || src[pos] == '_')) {
+            ++pos;
+        }
+        std::string name = src.substr(start, pos - start);
+
+        if (accept('(')) {
+            return function(name, start);
+        }
+        for (size_t i=0; i<graph.numVars(); ++i) {
+            if (graph.varName(i) == name) {
+                return graph.variable(i);
+            }
+        }
+        if (name == "pi") return graph.constant(M_PI);
+        if (name == "e") return graph.constant(M_E);
+
+        pos = start;
+        fail("Unknown variable '" + name + "'");
+        return -1;
+    }
+
+    int function(const std::string &name, size_t start) {
+        std::vector<int> args;
+        args.push_back(expr());
+        while (accept(',')) {
+            args.push_back(expr());
+        }
+        expect(')');
+
+        static const struct { const char *name; ExprOp op; } funcs[] = {
+            {"sin", EXPR_SIN}, {"cos", EXPR_COS}, {"tan", EXPR_TAN},
+            {"atan", EXPR_ATAN}, {"exp", EXPR_EXP}, {"log", EXPR_LOG},
+            {"sqrt", EXPR_SQRT}, {"abs", EXPR_ABS}, {"sign", EXPR_SIGN},
+            {"sinh", EXPR_SINH}, {"cosh", EXPR_COSH}
+        };
+        for (size_t i=0; i<sizeof(funcs)/sizeof(funcs[0]); ++i) {
+            if (name == funcs[i].name) {
+                if (args.size() != 1) {
+                    pos = start;
+                    fail(name + "() takes one argument");
+                }
+                return graph.unary(funcs[i].op, args[0]);
+            }
+        }
+        if (name == "pow") {
+            if (args.size() != 2) {
+                pos = start;
+                fail("pow() takes two arguments");
+            }
+            return graph.binary(EXPR_POW, args[0], args[1]);
+        }
+        pos = start;
+        fail("Unknown function '" + name + "'");
+        return -1;
+    }
+
+    ExprGraph &graph;
+    const std::string &src;
+    size_t pos;
+};
+
+}
+
+bool ExprGraph::Key::operator<(const Key &k) const {
+    if (op != k.op) return op < k.op;
+    if (a != k.a) return a < k.a;
+    if (b != k.b) return b < k.b;
+    if (ival != k.ival) return ival < k.ival;
+    // Compare bit patterns so that -0.0 and NaN constants stay distinct
+    return std::memcmp(&val, &k.val, sizeof(double)) < 0;
+}
+
+/*!
+  Creates an empty graph over the named variables.
+*/
+ExprGraph::ExprGraph(const std::vector<std::string> &varNames) : vars(varNames) {
+}
+
+/*!
+  Folds constant arguments and returns the shared node for (op, a, b).
+*/
+int ExprGraph::make(ExprOp op, int a, int b, double val, int ival) {
+    if (op != EXPR_CONST && op != EXPR_VAR) {
+        double av = 0.0, bv = 0.0;
+        bool foldable = isConstant(a, &av);
+        if (!isUnary(op) && op != EXPR_POWI) {
+            foldable = foldable && isConstant(b, &bv);
+        }
+        if (foldable) {
+            return constant(applyOp(op, av, bv, ival));
+        }
+    }
+
+    Key key;
+    key.op = op;
+    key.a = a;
+    key.b = b;
+    key.ival = ival;
+    key.val = val;
+    std::map<Key, int>::const_iterator iter = lookup.find(key);
+    if (iter != lookup.end()) {
+        return iter->second;
+    }
+
+    ExprNode n;
+    n.op = op;
+    n.a = a;
+    n.b = b;
+    n.val = val;
+    n.ival = ival;
+    nodes.push_back(n);
+    lookup[key] = int(nodes.size()) - 1;
+    return int(nodes.size()) - 1;
+}
+
+int ExprGraph::constant(double v) {
+    return make(EXPR_CONST, -1, -1, v, 0);
+}
+
+int ExprGraph::variable(size_t var) {
+    return make(EXPR_VAR, -1, -1, 0.0, int(var));
+}
+
+bool ExprGraph::isConstant(int id, double *val) const {
+    if (nodes[id].op != EXPR_CONST) return false;
+    if (val) *val = nodes[id].val;
+    return true;
+}
+
+/*!
+  Creates a unary node, applying simple algebraic identities first.
+*/
+int ExprGraph::unary(ExprOp op, int a) {
+    if (op == EXPR_NEG && nodes[a].op == EXPR_NEG) {
+        return nodes[a].a;
+    }
+    if (op == EXPR_ABS && (nodes[a].op == EXPR_ABS || nodes[a].op == EXPR_NEG)) {
+        return unary(EXPR_ABS, nodes[a].a);
+    }
+    return make(op, a, -1, 0.0, 0);
+}
+
+/*!
+  Creates a binary node, applying simple algebraic identities first.
+  Commutative operands are put in a canonical order so that u*v and
+  v*u share a node.
+*/
+int ExprGraph::binary(ExprOp op, int a, int b) {
+    double av = 0.0, bv = 0.0;
+    bool ac = isConstant(a, &av);
+    bool bc = isConstant(b, &bv);
+
+    switch (op) {
+    case EXPR_ADD:
+        if (ac && av == 0.0) return b;
+        if (bc && bv == 0.0) return a;
+        if (nodes[b].op == EXPR_NEG) return binary(EXPR_SUB, a, nodes[b].a);
+        if (nodes[a].op == EXPR_NEG) return binary(EXPR_SUB, b, nodes[a].a);
+        if (a > b) std::swap(a, b);
+        break;
+    case EXPR_SUB:
+        if (bc && bv == 0.0) return a;
+        if (ac && av == 0.0) return unary(EXPR_NEG, b);
+        if (a == b) return constant(0.0);
+        if (nodes[b].op == EXPR_NEG) return binary(EXPR_ADD, a, nodes[b].a);
+        break;
+    case EXPR_MUL:
+        if ((ac && av == 0.0) || (bc && bv == 0.0)) return constant(0.0);
+        if (ac && av == 1.0) return b;
+        if (bc && bv == 1.0) return a;
+        if (ac && av == -1.0) return unary(EXPR_NEG, b);
+        if (bc && bv == -1.0) return unary(EXPR_NEG, a);
+        if (a == b) return powi(a, 2);
+        if (a > b) std::swap(a, b);
+        break;
+    case EXPR_DIV:
+        if (ac && av == 0.0) return constant(0.0);
+        if (bc && bv == 1.0) return a;
+        if (bc && !ac && bv != 0.0) return binary(EXPR_MUL, a, constant(1.0/bv));
+        if (a == b) return constant(1.0);
+        break;
+    case EXPR_POW:
+        if (bc && bv == std::floor(bv) && std::fabs(bv) <= MAX_POWI) {
+            return powi(a, int(bv));
+        }
+        if (bc && bv == 0.5) return unary(EXPR_SQRT, a);
+        break;
+    default:
+        break;
+    }
+    return make(op, a, b, 0.0, 0);
+}
+
+/*!
+  Creates a node for a raised to the integer power n.
+*/
+int ExprGraph::powi(int a, int n) {
+    if (n == 0) return constant(1.0);
+    if (n == 1) return a;
+    if (nodes[a].op == EXPR_POWI &&
+        std::abs(nodes[a].ival * n) <= MAX_POWI) {
+        return powi(nodes[a].a, nodes[a].ival * n);
+    }
+    return make(EXPR_POWI, a, -1, 0.0, n);
+}
+
+int ExprGraph::parse(const std::string &src) {
+    Parser parser(*this, src);
+    return parser.parseAll();
+}
+
+/*!
+  Symbolically differentiates node with respect to variable var.
+  Results are memoized, so repeated and higher order derivatives share
+  work with each other and with the original expression.
+*/
+int ExprGraph::diff(int id, size_t var) {
+    std::pair<int, size_t> key(id, var);
+    std::map<std::pair<int, size_t>, int>::const_iterator iter = derivs.find(key);
+    if (iter != derivs.end()) {
+        return iter->second;
+    }
+
+    // Copy, because creating nodes may reallocate the node vector
+    ExprNode n = nodes[id];
+    int rval = 0;
+    int da = (n.a >= 0) ? diff(n.a, var) : -1;
+    int db = (n.b >= 0) ? diff(n.b, var) : -1;
+
+    switch (n.op) {
+    case EXPR_CONST:
+        rval = constant(0.0);
+        break;
+    case EXPR_VAR:
+        rval = constant(size_t(n.ival) == var ? 1.0 : 0.0);
+        break;
+    case EXPR_ADD:
+        rval = binary(EXPR_ADD, da, db);
+        break;
+    case EXPR_SUB:
+        rval = binary(EXPR_SUB, da, db);
+        break;
+    case EXPR_MUL:
+        rval = binary(EXPR_ADD, binary(EXPR_MUL, da, n.b), binary(EXPR_MUL, n.a, db));
+        break;
+    case EXPR_DIV:
+        // a'/b - a*b'/b^2
+        rval = binary(EXPR_SUB, binary(EXPR_DIV, da, n.b),
+                      binary(EXPR_DIV, binary(EXPR_MUL, n.a, db), powi(n.b, 2)));
+        break;
+    case EXPR_POW:
+        // a^b * (b'*log(a) + b*a'/a)
+        rval = binary(EXPR_MUL, id,
+                      binary(EXPR_ADD,
+                             binary(EXPR_MUL, db, unary(EXPR_LOG, n.a)),
+                             binary(EXPR_DIV, binary(EXPR_MUL, n.b, da), n.a)));
+        break;
+    case EXPR_POWI:
+        rval = binary(EXPR_MUL, binary(EXPR_MUL, constant(n.ival), powi(n.a, n.ival - 1)), da);
+        break;
+    case EXPR_NEG:
+        rval = unary(EXPR_NEG, da);
+        break;
+    case EXPR_SIN:
+        rval = binary(EXPR_MUL, unary(EXPR_COS, n.a), da);
+        break;
+    case EXPR_COS:
+        rval = unary(EXPR_NEG, binary(EXPR_MUL, unary(EXPR_SIN, n.a), da));
+        break;
+    case EXPR_TAN:
+        rval = binary(EXPR_DIV, da, powi(unary(EXPR_COS, n.a), 2));
+        break;
+    case EXPR_ATAN:
+        rval = binary(EXPR_DIV, da, binary(EXPR_ADD, constant(1.0), powi(n.a, 2)));
+        break;
+    case EXPR_EXP:
+        rval = binary(EXPR_MUL, id, da);
+        break;
+    case EXPR_LOG:
+        rval = binary(EXPR_DIV, da, n.a);
+        break;
+    case EXPR_SQRT:
+        rval = binary(EXPR_DIV, da, binary(EXPR_MUL, constant(2.0), id));
+        break;
+    case EXPR_ABS:
+        rval = binary(EXPR_MUL, unary(EXPR_SIGN, n.a), da);
+        break;
+    case EXPR_SIGN:
+        rval = constant(0.0);
+        break;
+    case EXPR_SINH:
+        rval = binary(EXPR_MUL, unary(EXPR_COSH, n.a), da);
+        break;
+    case EXPR_COSH:
+        rval = binary(EXPR_MUL, unary(EXPR_SINH, n.a), da);
+        break;
+    }
+    derivs[key] = rval;
+    return rval;
+}
+
+/*!
+  Fully parenthesized text for node id.  Mostly useful for debugging.
+*/
+std::string ExprGraph::toString(int id) const {
+    static const char *names[] = {
+        "", "", "+", "-", "*", "/", "^", "^", "-",
+        "sin", "cos", "tan", "atan", "exp", "log",
+        "sqrt", "abs", "sign", "sinh", "cosh"
+    };
+    const ExprNode &n = nodes[id];
+    std::ostringstream out;
+    switch (n.op) {
+    case EXPR_CONST:
+        out << n.val;
+        break;
+    case EXPR_VAR:
+        out << vars[n.ival];
+        break;
+    case EXPR_POWI:
+        out << "(" << toString(n.a) << "^" << n.ival << ")";
+        break;
+    case EXPR_NEG:
+        out << "(-" << toString(n.a) << ")";
+        break;
+    case EXPR_ADD: case EXPR_SUB: case EXPR_MUL: case EXPR_DIV: case EXPR_POW:
+        out << "(" << toString(n.a) << names[n.op] << toString(n.b) << ")";
+        break;
+    default:
+        out << names[n.op] << "(" << toString(n.a) << ")";
+        break;
+    }
+    return out.str();
+}
+
+namespace {
+
+/*!
+  Runs one instruction over n samples
+*/
+void execute(unsigned char op, int ival, double *d, const double *a, const double *b, size_t n) {
+    switch (op) {
+    case EXPR_ADD: for (size_t k=0; k<n; ++k) d[k] = a[k] + b[k]; break;
+    case EXPR_SUB: for (size_t k=0; k<n; ++k) d[k] = a[k] - b[k]; break;
+    case EXPR_MUL: for (size_t k=0; k<n; ++k) d[k] = a[k] * b[k]; break;
+    case EXPR_DIV: for (size_t k=0; k<n; ++k) d[k] = a[k] / b[k]; break;
+    case EXPR_NEG: for (size_t k=0; k<n; ++k) d[k] = -a[k]; break;
+    case EXPR_POW: for (size_t k=0; k<n; ++k) d[k] = std::pow(a[k], b[k]); break;
+    case EXPR_POWI: {
+        unsigned int m = (ival < 0) ? -ival : ival;
+        for (size_t k=0; k<n; ++k) {
+            double x = a[k];
+            double r = 1.0;
+            for (unsigned int e=m; e; e >>= 1) {
+                if (e & 1) r *= x;
+                x *= x;
+            }
+            d[k] = (ival < 0) ? 1.0/r : r;
+        }
+        break;
+    }
+    case EXPR_SIN: for (size_t k=0; k<n; ++k) d[k] = std::sin(a[k]); break;
+    case EXPR_COS: for (size_t k=0; k<n; ++k) d[k] = std::cos(a[k]); break;
+    case EXPR_TAN: for (size_t k=0; k<n; ++k) d[k] = std::tan(a[k]); break;
+    case EXPR_ATAN: for (size_t k=0; k<n; ++k) d[k] = std::atan(a[k]); break;
+    case EXPR_EXP: for (size_t k=0; k<n; ++k) d[k] = std::exp(a[k]); break;
+    case EXPR_LOG: for (size_t k=0; k<n; ++k) d[k] = std::log(a[k]); break;
+    case EXPR_SQRT: for (size_t k=0; k<n; ++k) d[k] = std::sqrt(a[k]); break;
+    case EXPR_ABS: for (size_t k=0; k<n; ++k) d[k] = std::fabs(a[k]); break;
+    case EXPR_SIGN:
+        for (size_t k=0; k<n; ++k) d[k] = double((a[k] > 0.0) - (a[k] < 0.0));
+        break;
+    case EXPR_SINH: for (size_t k=0; k<n; ++k) d[k] = std::sinh(a[k]); break;
+    case EXPR_COSH: for (size_t k=0; k<n; ++k) d[k] = std::cosh(a[k]); break;
+    }
+}
+
+}
+
+ExprProgram::ExprProgram() : nInputs(0), nRegs(0) {
+}
+
+/*!
+  Compiles the given roots into register code.  Nodes are emitted in
+  dependency order and registers are recycled as soon as their last
+  reader has executed, which keeps the register file small enough to
+  stay in L1 even for large derivative expressions.
+*/
+void ExprProgram::compile(const ExprGraph &graph, const std::vector<int> &roots) {
+    code.clear();
+    consts.clear();
+    outRegs.clear();
+    nInputs = graph.numVars();
+    inRegs.assign(nInputs, -1);
+
+    // Post-order walk of everything reachable from the roots
+    std::vector<int> order;
+    std::vector<char> visited(graph.size(), 0);
+    std::vector<std::pair<int, bool> > stack;
+    for (size_t i=0; i<roots.size(); ++i) {
+        stack.push_back(std::make_pair(roots[i], false));
+    }
+    while (!stack.empty()) {
+        std::pair<int, bool> top = stack.back();
+        stack.pop_back();
+        if (top.second) {
+            order.push_back(top.first);
+            continue;
+        }
+        if (visited[top.first]) continue;
+        visited[top.first] = 1;
+        stack.push_back(std::make_pair(top.first, true));
+        const ExprNode &n = graph.node(top.first);
+        if (n.b >= 0 && !visited[n.b]) stack.push_back(std::make_pair(n.b, false));
+        if (n.a >= 0 && !visited[n.a]) stack.push_back(std::make_pair(n.a, false));
+    }
+
+    // Position of the last instruction reading each node
+    const int FOREVER = int(order.size());
+    std::vector<int> lastUse(graph.size(), -1);
+    for (size_t i=0; i<order.size(); ++i) {
+        const ExprNode &n = graph.node(order[i]);
+        if (n.a >= 0) lastUse[n.a] = int(i);
+        if (n.b >= 0) lastUse[n.b] = int(i);
+    }
+    for (size_t i=0; i<roots.size(); ++i) {
+        lastUse[roots[i]] = FOREVER;
+    }
+
+    std::vector<int> reg(graph.size(), -1);
+    std::vector<int> freeRegs;
+    nRegs = 0;
+
+    // Constants and inputs are pinned for the whole program
+    for (size_t i=0; i<order.size(); ++i) {
+        const ExprNode &n = graph.node(order[i]);
+        if (n.op == EXPR_CONST) {
+            reg[order[i]] = int(nRegs++);
+            consts.push_back(std::make_pair(reg[order[i]], n.val));
+        } else if (n.op == EXPR_VAR) {
+            reg[order[i]] = int(nRegs++);
+            inRegs[n.ival] = reg[order[i]];
+        }
+    }
+
+    for (size_t i=0; i<order.size(); ++i) {
+        int id = order[i];
+        const ExprNode &n = graph.node(id);
+        if (n.op == EXPR_CONST || n.op == EXPR_VAR) continue;
+
+        Instr ins;
+        ins.op = (unsigned char)n.op;
+        ins.a = reg[n.a];
+        ins.b = (n.b >= 0) ? reg[n.b] : -1;
+        ins.ival = n.ival;
+
+        // Release operands that die here so dst may reuse one of them
+        const ExprNode &na = graph.node(n.a);
+        if (lastUse[n.a] == int(i) && na.op != EXPR_CONST && na.op != EXPR_VAR) {
+            freeRegs.push_back(reg[n.a]);
+        }
+        if (n.b >= 0 && n.b != n.a && lastUse[n.b] == int(i)) {
+            const ExprNode &nb = graph.node(n.b);
+            if (nb.op != EXPR_CONST && nb.op != EXPR_VAR) {
+                freeRegs.push_back(reg[n.b]);
+            }
+        }
+
+        if (freeRegs.empty()) {
+            reg[id] = int(nRegs++);
+        } else {
+            reg[id] = freeRegs.back();
+            freeRegs.pop_back();
+        }
+        ins.dst = reg[id];
+        code.push_back(ins);
+    }
+
+    for (size_t i=0; i<roots.size(); ++i) {
+        outRegs.push_back(reg[roots[i]]);
+    }
+}
+
+void ExprProgram::eval(const double *const *inputs, double *const *outputs, size_t n) const {
+    const size_t B = EXPR_BATCH;
+    std::vector<double> regs(nRegs*B);
+    double *R = regs.empty() ? 0 : &regs[0];
+
+    for (size_t i=0; i<consts.size(); ++i) {
+        double *d = R + consts[i].first*B;
+        for (size_t k=0; k<B; ++k) d[k] = consts[i].second;
+    }
+
+    for (size_t base=0; base<n; base+=B) {
+        size_t count = (n - base < B) ? n - base : B;
+
+        // Load inputs, padding a partial batch with a valid sample
+        for (size_t v=0; v<nInputs; ++v) {
+            if (inRegs[v] < 0) continue;
+            double *d = R + inRegs[v]*B;
+            const double *src = inputs[v] + base;
+            for (size_t k=0; k<count; ++k) d[k] = src[k];
+            for (size_t k=count; k<B; ++k) d[k] = src[0];
+        }
+
+        for (size_t i=0; i<code.size(); ++i) {
+            const Instr &ins = code[i];
+            const double *a = R + ins.a*B;
+            execute(ins.op, ins.ival, R + ins.dst*B, a, (ins.b >= 0) ? R + ins.b*B : a, B);
+        }
+
+        for (size_t j=0; j<outRegs.size(); ++j) {
+            const double *s = R + outRegs[j]*B;
+            double *dst = outputs[j] + base;
+            for (size_t k=0; k<count; ++k) dst[k] = s[k];
+        }
+    }
+}
+
+void ExprProgram::evalGrid(const double *xs, size_t nx, const double *ys, size_t ny,
+                           const double *rest, double *const *outputs) const {
+    const size_t B = EXPR_BATCH;
+    const unsigned char ON_X = 1, ON_Y = 2, ON_XY = 3;
+    const int xReg = (nInputs > 0) ? inRegs[0] : -1;
+    const int yReg = (nInputs > 1) ? inRegs[1] : -1;
+
+    // Which grid inputs each instruction depends on.  Registers are
+    // recycled, so this has to follow the code in order.
+    std::vector<unsigned char> regDeps(nRegs, 0);
+    if (xReg >= 0) regDeps[xReg] = ON_X;
+    if (yReg >= 0) regDeps[yReg] = ON_Y;
+    std::vector<unsigned char> deps(code.size());
+    for (size_t i=0; i<code.size(); ++i) {
+        const Instr &ins = code[i];
+        deps[i] = regDeps[ins.a] | ((ins.b >= 0) ? regDeps[ins.b] : 0);
+        regDeps[ins.dst] = deps[i];
+    }
+
+    std::vector<double> regs(nRegs*B);
+    double *R = regs.empty() ? 0 : &regs[0];
+    for (size_t i=0; i<consts.size(); ++i) {
+        double *d = R + consts[i].first*B;
+        for (size_t k=0; k<B; ++k) d[k] = consts[i].second;
+    }
+    for (size_t v=2; v<nInputs; ++v) {
+        if (inRegs[v] < 0) continue;
+        double *d = R + inRegs[v]*B;
+        for (size_t k=0; k<B; ++k) d[k] = rest[v-2];
+    }
+
+    // Hoisted results: a padded column of values for each instruction
+    // that only depends on x, and one value for each of the rest, kept
+    // broadcast across a batch for the inner loop to read in place
+    const size_t nxPadded = (nx + B - 1)/B*B;
+    std::vector<size_t> slot(code.size(), 0);
+    size_t numColumns = 0;
+    for (size_t i=0; i<code.size(); ++i) {
+        if (deps[i] == ON_X) {
+            slot[i] = numColumns++;
+        } else if (deps[i] != ON_XY) {
+            slot[i] = i;
+        }
+    }
+    std::vector<double> columns(numColumns*nxPadded + 1);
+    std::vector<double> scalars(code.size()*B + 1);
+
+    // Where the inner loop reads each operand and output from.  Columns
+    // advance with the batch; registers and broadcasts don't.
+    struct Source {
+        const double *p;
+        bool advances;
+        const double *at(size_t base) const { return advances ? p + base : p; }
+    };
+    std::vector<int> writer(nRegs, -1);
+    auto sourceOf = [&](int reg) {
+        Source src = { R + reg*B, false };
+        int w = writer[reg];
+        if (w >= 0 && deps[w] == ON_X) {
+            src.p = &columns[slot[w]*nxPadded];
+            src.advances = true;
+        } else if (w >= 0 && deps[w] != ON_XY) {
+            src.p = &scalars[slot[w]*B];
+        }
+        return src;
+    };
+    std::vector<size_t> inner;
+    std::vector<Source> operands;
+    for (size_t i=0; i<code.size(); ++i) {
+        const Instr &ins = code[i];
+        if (deps[i] == ON_XY) {
+            inner.push_back(i);
+            operands.push_back(sourceOf(ins.a));
+            operands.push_back(sourceOf(ins.b >= 0 ? ins.b : ins.a));
+        }
+        writer[ins.dst] = int(i);
+    }
+    std::vector<Source> results;
+    for (size_t o=0; o<outRegs.size(); ++o) {
+        results.push_back(sourceOf(outRegs[o]));
+    }
+
+    // Once across the columns, for everything that doesn't involve y
+    for (size_t base=0; base<nx; base+=B) {
+        size_t count = (nx - base < B) ? nx - base : B;
+        if (xReg >= 0) {
+            double *d = R + xReg*B;
+            for (size_t k=0; k<count; ++k) d[k] = xs[base + k];
+            for (size_t k=count; k<B; ++k) d[k] = xs[base];
+        }
+        for (size_t i=0; i<code.size(); ++i) {
+            if (deps[i] & ON_Y) continue;
+            const Instr &ins = code[i];
+            const double *a = R + ins.a*B;
+            double *d = R + ins.dst*B;
+            execute(ins.op, ins.ival, d, a, (ins.b >= 0) ? R + ins.b*B : a, B);
+            if (deps[i] == ON_X) {
+                std::copy(d, d + B, &columns[slot[i]*nxPadded + base]);
+            } else {
+                std::fill(&scalars[slot[i]*B], &scalars[slot[i]*B] + B, d[0]);
+            }
+        }
+    }
+
+    for (size_t j=0; j<ny; ++j) {
+        // A single sample for everything that only involves y
+        if (yReg >= 0) {
+            R[yReg*B] = ys[j];
+        }
+        for (size_t i=0; i<code.size(); ++i) {
+            const Instr &ins = code[i];
+            double *d = R + ins.dst*B;
+            if (deps[i] == 0) {
+                d[0] = scalars[slot[i]*B];
+            } else if (deps[i] == ON_Y) {
+                const double *a = R + ins.a*B;
+                execute(ins.op, ins.ival, d, a, (ins.b >= 0) ? R + ins.b*B : a, 1);
+                std::fill(&scalars[slot[i]*B], &scalars[slot[i]*B] + B, d[0]);
+            }
+        }
+
+        if (yReg >= 0) {
+            double *d = R + yReg*B;
+            for (size_t k=0; k<B; ++k) d[k] = ys[j];
+        }
+        for (size_t base=0; base<nx; base+=B) {
+            size_t count = (nx - base < B) ? nx - base : B;
+            if (xReg >= 0) {
+                double *d = R + xReg*B;
+                for (size_t k=0; k<count; ++k) d[k] = xs[base + k];
+                for (size_t k=count; k<B; ++k) d[k] = xs[base];
+            }
+            for (size_t n=0; n<inner.size(); ++n) {
+                const Instr &ins = code[inner[n]];
+                execute(ins.op, ins.ival, R + ins.dst*B, operands[2*n].at(base),
+                        operands[2*n + 1].at(base), B);
+            }
+            for (size_t o=0; o<outRegs.size(); ++o) {
+                const double *src = results[o].at(base);
+                double *dst = outputs[o] + j*nx + base;
+                for (size_t k=0; k<count; ++k) dst[k] = src[k];
+            }
+        }
+    }
+}
+
+void ExprProgram::evalInterval(const Interval *inputs, Interval *outputs) const {
+    std::vector<Interval> regs(nRegs);
+
+    for (size_t i=0; i<consts.size(); ++i) {
+        regs[consts[i].first] = makeInterval(consts[i].second, consts[i].second);
+    }
+    for (size_t v=0; v<nInputs; ++v) {
+        if (inRegs[v] >= 0) {
+            regs[inRegs[v]] = inputs[v];
+        }
+    }
+
+    for (size_t i=0; i<code.size(); ++i) {
+        const Instr &ins = code[i];
+        Interval a = regs[ins.a];
+        Interval b = (ins.b >= 0) ? regs[ins.b] : a;
+        Interval &d = regs[ins.dst];
+
+        switch (ins.op) {
+        case EXPR_ADD:
+            d.lo = a.lo + b.lo;
+            d.hi = a.hi + b.hi;
+            break;
+        case EXPR_SUB:
+            d.lo = a.lo - b.hi;
+            d.hi = a.hi - b.lo;
+            break;
+        case EXPR_MUL:
+            d = intervalMul(a, b);
+            break;
+        case EXPR_DIV:
+            d = intervalMul(a, intervalRecip(b));
+            break;
+        case EXPR_POWI:
+            d = intervalPowi(a, ins.ival);
+            break;
+        case EXPR_POW:
+            // a^b = exp(b*log(a))
+            d = intervalUnary(EXPR_EXP, intervalMul(b, intervalUnary(EXPR_LOG, a)));
+            break;
+        default:
+            d = intervalUnary(ExprOp(ins.op), a);
+            break;
+        }
+    }
+
+    for (size_t j=0; j<outRegs.size(); ++j) {
+        outputs[j] = regs[outRegs[j]];
+    }
+}
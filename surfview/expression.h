@@ -0,0 +1,176 @@
+/*
+  expression.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <cstddef>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Number of samples evaluated by each bytecode instruction
+static const size_t EXPR_BATCH=16;
+
+enum ExprOp {
+    EXPR_CONST, EXPR_VAR,
+    EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV, EXPR_POW, EXPR_POWI, EXPR_NEG,
+    EXPR_SIN, EXPR_COS, EXPR_TAN, EXPR_ATAN, EXPR_EXP, EXPR_LOG,
+    EXPR_SQRT, EXPR_ABS, EXPR_SIGN, EXPR_SINH, EXPR_COSH
+};
+
+/*!
+  Thrown for syntax errors and unknown names.  pos is the offset into
+  the source string where the problem was noticed.
+*/
+class ExprError : public std::runtime_error {
+public:
+    ExprError(const std::string &msg, size_t p) : std::runtime_error(msg), pos(p) {}
+    size_t pos;
+};
+
+/*!
+  Closed range of values, used to bound an expression over a box.
+*/
+struct Interval {
+    double lo;
+    double hi;
+};
+
+/*!
+  One node of an expression DAG.  Children are indices into the owning
+  ExprGraph.  EXPR_POWI stores its integer exponent in ival.
+*/
+struct ExprNode {
+    ExprOp op;
+    int a;
+    int b;
+    double val;
+    int ival;
+};
+
+/*!
+  A pool of hash-consed expression nodes over a fixed set of variables.
+  Identical subexpressions share a node and constant subexpressions are
+  folded as nodes are created, so parsing and differentiating never
+  produce redundant work for the compiler.
+*/
+class ExprGraph {
+public:
+    ExprGraph(const std::vector<std::string> &varNames);
+
+    // Parses src and returns the id of its root node.  Throws ExprError.
+    int parse(const std::string &src);
+
+    // Returns the id of d(node)/d(var)
+    int diff(int node, size_t var);
+
+    int constant(double v);
+    int variable(size_t var);
+    int unary(ExprOp op, int a);
+    int binary(ExprOp op, int a, int b);
+    int powi(int a, int n);
+
+    bool isConstant(int id, double *val = 0) const;
+
+    const ExprNode &node(int id) const { return nodes[id]; }
+    size_t size() const { return nodes.size(); }
+    size_t numVars() const { return vars.size(); }
+    const std::string &varName(size_t i) const { return vars[i]; }
+
+    std::string toString(int id) const;
+
+private:
+    struct Key {
+        int op, a, b, ival;
+        double val;
+        bool operator<(const Key &k) const;
+    };
+
+    int make(ExprOp op, int a, int b, double val, int ival);
+
+    std::vector<std::string> vars;
+    std::vector<ExprNode> nodes;
+    std::map<Key, int> lookup;
+    std::map<std::pair<int, size_t>, int> derivs;
+};
+
+/*!
+  Register bytecode compiled from one or more roots of an ExprGraph.
+  Every register holds EXPR_BATCH samples, so each instruction dispatch
+  processes a whole batch and the inner loops are simple enough for the
+  compiler to vectorize.
+*/
+class ExprProgram {
+public:
+    ExprProgram();
+
+    void compile(const ExprGraph &graph, const std::vector<int> &roots);
+
+    size_t numInputs() const { return nInputs; }
+    size_t numOutputs() const { return outRegs.size(); }
+    size_t numInstructions() const { return code.size(); }
+    size_t numRegisters() const { return nRegs; }
+
+    /*!
+      Evaluates n samples.  inputs[i] points to n values of variable i
+      and outputs[j] receives n values of root j.  Safe to call from
+      several threads at once.
+    */
+    void eval(const double *const *inputs, double *const *outputs, size_t n) const;
+
+    /*!
+      Evaluates on the grid of nx values of input 0 by ny values of
+      input 1, with any other inputs fixed at rest[0], rest[1], ...
+      outputs[j] receives nx*ny values, input 0 varying fastest.
+
+      Instructions that don't depend on input 1 are run once per column
+      and those that don't depend on input 0 once per row, rather than
+      at every sample.  For most parametric surfaces that takes nearly
+      all of the transcendental functions out of the inner loop.
+    */
+    void evalGrid(const double *xs, size_t nx, const double *ys, size_t ny,
+                  const double *rest, double *const *outputs) const;
+
+    /*!
+      Bounds every output over the box given by one interval per input.
+      The bounds are conservative but not tight, which is what spatial
+      culling needs: a range that excludes zero proves there is no
+      root inside the box.
+    */
+    void evalInterval(const Interval *inputs, Interval *outputs) const;
+
+private:
+    struct Instr {
+        unsigned char op;
+        int dst;
+        int a;
+        int b;
+        int ival;
+    };
+
+    size_t nInputs;
+    size_t nRegs;
+    std::vector<Instr> code;
+    std::vector<std::pair<int, double> > consts;
+    std::vector<int> inRegs;
+    std::vector<int> outRegs;
+};
+
+#endif
@@ -0,0 +1,138 @@
+/*
+  framegovernor.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "framegovernor.h"
+
+CostModel::CostModel() {
+    clear();
+}
+
+void CostModel::clear() {
+    weight = 0.0;
+    sumX = sumY = sumXX = sumXY = 0.0;
+}
+
+void CostModel::add(double triangles, double ms) {
+    const double decay = 1.0 - 1.0/GOVERNOR_HISTORY;
+    weight = weight*decay + 1.0;
+    sumX = sumX*decay + triangles;
+    sumY = sumY*decay + ms;
+    sumXX = sumXX*decay + triangles*triangles;
+    sumXY = sumXY*decay + triangles*ms;
+}
+
+/*!
+  Two points on the saved line, each counted twice, so the first few
+  real samples can still move it
+*/
+void CostModel::restore(double overhead, double perTriangle) {
+    const double tris = 1.0e6;
+    clear();
+    for (size_t i=0; i<2; ++i) {
+        add(0.0, overhead);
+        add(tris, overhead + perTriangle*tris);
+    }
+}
+
+double CostModel::overhead() const {
+    if (weight <= 0.0) return 0.0;
+    const double meanX = sumX/weight;
+    const double meanY = sumY/weight;
+    if (meanX <= 0.0) return meanY;
+    const double varX = sumXX/weight - meanX*meanX;
+    const double cov = sumXY/weight - meanX*meanY;
+    // Too little spread in the triangle counts to fit a line, or a fit
+    // that says more triangles are cheaper
+    if (varX <= 1.0e-4*meanX*meanX || cov <= 0.0) return 0.0;
+    return std::max(meanY - cov/varX*meanX, 0.0);
+}
+
+double CostModel::perTriangle() const {
+    if (weight <= 0.0) return 0.0;
+    const double meanX = sumX/weight;
+    if (meanX <= 0.0) return 0.0;
+    return std::max((sumY/weight - overhead())/meanX, 0.0);
+}
+
+FrameGovernor::FrameGovernor() : targetMs(0.0), bias(0), frames(0) {
+}
+
+/*!
+  Turning the governor off goes back to full detail
+*/
+void FrameGovernor::setTarget(double ms) {
+    targetMs = std::max(ms, 0.0);
+    if (!enabled()) bias = 0;
+    frames = 0;
+}
+
+void FrameGovernor::setLodBias(int b) {
+    bias = enabled() ? std::min(std::max(b, GOVERNOR_MIN_BIAS), 0) : 0;
+    frames = 0;
+}
+
+void FrameGovernor::addDrawSample(size_t triangles, double ms) {
+    draw.add(double(triangles), ms);
+    ++frames;
+}
+
+void FrameGovernor::addRegenSample(size_t triangles, double ms) {
+    regen.add(double(triangles), ms);
+}
+
+size_t FrameGovernor::scaledTriangles(size_t fullTriangles) const {
+    return std::max(size_t(std::ldexp(double(fullTriangles), bias)), size_t(1));
+}
+
+double FrameGovernor::predict(int b, size_t fullTriangles, size_t instances, bool animated) const {
+    const double tris = std::ldexp(double(fullTriangles), b);
+    double ms = draw.predict(tris*instances);
+    if (animated && regen.calibrated()) {
+        ms = std::max(ms, regen.predict(tris));
+    }
+    return ms;
+}
+
+/*!
+  Drops detail until the prediction fits under the headroom, or raises
+  it while the next level up fits with room to spare.  Predictions come
+  from the fitted costs, so one decision jumps straight to the right
+  level rather than stepping there a frame at a time.
+*/
+bool FrameGovernor::update(size_t fullTriangles, size_t instances, bool animated) {
+    if (!enabled() || !draw.calibrated() || frames < GOVERNOR_SETTLE_FRAMES) return false;
+
+    const double budget = targetMs*GOVERNOR_HEADROOM;
+    int b = bias;
+    if (predict(b, fullTriangles, instances, animated) > budget) {
+        while (b > GOVERNOR_MIN_BIAS && predict(b, fullTriangles, instances, animated) > budget) {
+            --b;
+        }
+    } else {
+        while (b < 0 && predict(b + 1, fullTriangles, instances, animated) <= budget*GOVERNOR_HEADROOM) {
+            ++b;
+        }
+    }
+    frames = 0;
+    if (b == bias) return false;
+    bias = b;
+    return true;
+}
@@ -0,0 +1,125 @@
+/*
+  framegovernor.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef FRAMEGOVERNOR_H
+#define FRAMEGOVERNOR_H
+
+#include <cstddef>
+
+// Frame time the governor aims for unless told otherwise, in milliseconds
+static const double GOVERNOR_DEFAULT_TARGET=16.0;
+
+// Roughly how many samples the cost models remember; older ones fade out
+static const size_t GOVERNOR_HISTORY=32;
+
+// Frames drawn at a level of detail before it's judged
+static const size_t GOVERNOR_SETTLE_FRAMES=8;
+
+// Fraction of the target frames are steered under, so noise doesn't
+// push them over.  Detail is only raised if it fits under
+// GOVERNOR_HEADROOM squared, which keeps it from flipping back and forth.
+static const double GOVERNOR_HEADROOM=0.85;
+
+// Lowest level of detail: 2^GOVERNOR_MIN_BIAS of the triangles asked for
+static const int GOVERNOR_MIN_BIAS=-10;
+
+/*!
+  Running least squares fit of the time some work takes against the
+  triangles it handles, ms = overhead + perTriangle*triangles.  Each new
+  sample weighs the old ones down a little, so the fit follows changes
+  in load.  Until there's a spread of triangle counts to fit a line
+  through, all of the time is put down to the triangles, which
+  overestimates the cost of small meshes rather than large ones.
+*/
+class CostModel {
+public:
+    CostModel();
+
+    void clear();
+    void add(double triangles, double ms);
+    // Starts over from a fit saved earlier, as if from a few samples
+    void restore(double overhead, double perTriangle);
+
+    bool calibrated() const { return weight > 0.0; }
+    double overhead() const;
+    double perTriangle() const;
+
+    double predict(double triangles) const { return overhead() + perTriangle()*triangles; }
+
+private:
+    double weight;
+    double sumX, sumY, sumXX, sumXY;
+};
+
+/*!
+  Picks how much detail to draw so frames take about the target time.
+
+  The viewer feeds it how long drawing and rebuilding meshes take, and
+  it keeps a CostModel of each.  Detail is an integer LOD bias: bias b
+  asks for 2^b of the triangles the surface would otherwise have, so it
+  is never more than what was asked for.  Static meshes are judged by
+  their draw time alone.  Animated ones are rebuilt on another thread
+  while the last frame is drawn, so they're held to the slower of the
+  two.
+*/
+class FrameGovernor {
+public:
+    FrameGovernor();
+
+    // Target frame time in milliseconds; 0 turns the governor off
+    void setTarget(double ms);
+    double target() const { return targetMs; }
+    bool enabled() const { return targetMs > 0.0; }
+
+    // A frame that drew triangles triangles, counting every instance, in ms
+    void addDrawSample(size_t triangles, double ms);
+    // Building the vertices of a mesh of triangles triangles took ms
+    void addRegenSample(size_t triangles, double ms);
+
+    /*!
+      Judges the current detail once enough frames have been drawn at
+      it.  fullTriangles is the size of the surface's mesh at bias 0,
+      drawn instances times per frame.  Returns true if the bias
+      changed, in which case the mesh should be rebuilt.
+    */
+    bool update(size_t fullTriangles, size_t instances, bool animated);
+
+    // Ignored while the governor is off
+    int lodBias() const { return bias; }
+    void setLodBias(int b);
+
+    // Triangles in a mesh of fullTriangles at the current bias
+    size_t scaledTriangles(size_t fullTriangles) const;
+
+    // Predicted frame time at bias b
+    double predict(int b, size_t fullTriangles, size_t instances, bool animated) const;
+
+    CostModel &drawCost() { return draw; }
+    const CostModel &drawCost() const { return draw; }
+    CostModel &regenCost() { return regen; }
+    const CostModel &regenCost() const { return regen; }
+
+private:
+    CostModel draw;
+    CostModel regen;
+    double targetMs;
+    int bias;
+    size_t frames;
+};
+
+#endif
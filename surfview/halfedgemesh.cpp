@@ -0,0 +1,102 @@
+/*
+  halfedgemesh.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include <stdint.h>
+
+#include "halfedgemesh.h"
+
+HalfEdgeMesh::HalfEdgeMesh() : faceStart(1, 0), vertStart(1, 0), nEdges(0) {
+}
+
+void HalfEdgeMesh::build(size_t numVerts, const std::vector<unsigned int> &faceSizes,
+                         const std::vector<unsigned int> &faceVerts) {
+    faceStart.assign(faceSizes.size() + 1, 0);
+    for (size_t f=0; f<faceSizes.size(); ++f) {
+        if (faceSizes[f] < 3) {
+            throw std::runtime_error("Faces need at least three corners");
+        }
+        faceStart[f+1] = faceStart[f] + int(faceSizes[f]);
+    }
+    if (size_t(faceStart.back()) != faceVerts.size()) {
+        throw std::runtime_error("Face sizes don't match the face vertex list");
+    }
+
+    const size_t numHe = faceVerts.size();
+    heVert.resize(numHe);
+    heFace.resize(numHe);
+    heTwin.assign(numHe, -1);
+    heEdge.assign(numHe, -1);
+    for (size_t f=0; f+1<faceStart.size(); ++f) {
+        for (int h=faceStart[f]; h<faceStart[f+1]; ++h) {
+            if (faceVerts[h] >= numVerts) {
+                throw std::runtime_error("Face refers to a missing vertex");
+            }
+            heVert[h] = int(faceVerts[h]);
+            heFace[h] = int(f);
+        }
+    }
+
+    // Pair up half-edges by sorting on their undirected vertex pair.
+    // Anything other than exactly two opposing half-edges is left as
+    // boundary, which also keeps non-manifold input from breaking things.
+    std::vector<std::pair<uint64_t, int> > keys(numHe);
+    for (size_t h=0; h<numHe; ++h) {
+        uint64_t a = uint64_t(heVert[h]);
+        uint64_t b = uint64_t(heVert[next(int(h))]);
+        keys[h].first = (std::min(a, b) << 32) | std::max(a, b);
+        keys[h].second = int(h);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    nEdges = 0;
+    for (size_t i=0; i<numHe; ) {
+        size_t j = i + 1;
+        while (j < numHe && keys[j].first == keys[i].first) ++j;
+        int h0 = keys[i].second;
+        if (j - i == 2) {
+            int h1 = keys[i+1].second;
+            if (heVert[h0] != heVert[h1]) {
+                heTwin[h0] = h1;
+                heTwin[h1] = h0;
+                heEdge[h0] = heEdge[h1] = int(nEdges++);
+                i = j;
+                continue;
+            }
+        }
+        for (size_t k=i; k<j; ++k) {
+            heEdge[keys[k].second] = int(nEdges++);
+        }
+        i = j;
+    }
+
+    // Outgoing half-edges of each vertex, by counting sort
+    vertStart.assign(numVerts + 1, 0);
+    for (size_t h=0; h<numHe; ++h) {
+        ++vertStart[heVert[h] + 1];
+    }
+    for (size_t v=0; v<numVerts; ++v) {
+        vertStart[v+1] += vertStart[v];
+    }
+    vertHes.resize(numHe);
+    std::vector<int> fill(vertStart.begin(), vertStart.end() - 1);
+    for (size_t h=0; h<numHe; ++h) {
+        vertHes[fill[heVert[h]]++] = int(h);
+    }
+}
@@ -0,0 +1,79 @@
+/*
+  halfedgemesh.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef HALFEDGEMESH_H
+#define HALFEDGEMESH_H
+
+#include <cstddef>
+#include <vector>
+
+/*!
+  Polygon mesh connectivity as a half-edge structure stored in parallel
+  arrays.  Only topology lives here; positions are kept by whoever owns
+  the mesh.
+
+  The half-edges of face f are numbered faceStart[f] .. faceStart[f+1]-1
+  in winding order, so next, prev and face lookups need no pointers.
+  heTwin is -1 on boundary half-edges.  Each vertex's outgoing
+  half-edges are listed in vertHes[vertStart[v] .. vertStart[v+1]-1].
+*/
+class HalfEdgeMesh {
+public:
+    HalfEdgeMesh();
+
+    /*!
+      Builds the connectivity.  faceSizes[f] is the number of corners of
+      face f, and faceVerts lists the corners of all faces in order.
+      Throws std::runtime_error for out of range vertices or faces with
+      fewer than three corners.
+    */
+    void build(size_t numVerts, const std::vector<unsigned int> &faceSizes,
+               const std::vector<unsigned int> &faceVerts);
+
+    size_t numVerts() const { return vertStart.size() - 1; }
+    size_t numFaces() const { return faceStart.size() - 1; }
+    size_t numHalfEdges() const { return heVert.size(); }
+    size_t numEdges() const { return nEdges; }
+
+    int next(int h) const {
+        int f = heFace[h];
+        return (h + 1 == faceStart[f+1]) ? faceStart[f] : h + 1;
+    }
+    int prev(int h) const {
+        int f = heFace[h];
+        return (h == faceStart[f]) ? faceStart[f+1] - 1 : h - 1;
+    }
+    int faceSize(int f) const { return faceStart[f+1] - faceStart[f]; }
+    bool isBoundary(int h) const { return heTwin[h] < 0; }
+
+    // Origin vertex, opposite half-edge, owning face and undirected edge
+    std::vector<int> heVert;
+    std::vector<int> heTwin;
+    std::vector<int> heFace;
+    std::vector<int> heEdge;
+
+    std::vector<int> faceStart;
+
+    std::vector<int> vertStart;
+    std::vector<int> vertHes;
+
+private:
+    size_t nEdges;
+};
+
+#endif
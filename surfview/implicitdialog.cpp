@@ -0,0 +1,96 @@
+/*
+  implicitdialog.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QtGui>
+
+#include <algorithm>
+
+#include "implicitdialog.h"
+
+/*!
+  Lays out the fields, filled in from surf
+*/
+ImplicitDialog::ImplicitDialog(const ImplicitSurface &surf, QWidget *parent) :
+    QDialog(parent), result(surf) {
+
+    setWindowTitle(tr("Edit Implicit Surface"));
+
+    fEdit = new QLineEdit(QString::fromStdString(surf.expression()), this);
+
+    QGridLayout *grid = new QGridLayout;
+    grid->addWidget(new QLabel(tr("F(x,y,z) = 0")), 0, 0);
+    grid->addWidget(fEdit, 0, 1, 1, 3);
+
+    grid->addWidget(new QLabel(tr("Min")), 1, 0);
+    grid->addWidget(new QLabel(tr("Max")), 2, 0);
+    for (size_t i=0; i<3; ++i) {
+        minBoxes[i] = new QDoubleSpinBox(this);
+        maxBoxes[i] = new QDoubleSpinBox(this);
+        minBoxes[i]->setRange(-1.0e6, 1.0e6);
+        maxBoxes[i]->setRange(-1.0e6, 1.0e6);
+        minBoxes[i]->setDecimals(4);
+        maxBoxes[i]->setDecimals(4);
+        minBoxes[i]->setValue(surf.boundsMin()[i]);
+        maxBoxes[i]->setValue(surf.boundsMax()[i]);
+        grid->addWidget(minBoxes[i], 1, int(i) + 1);
+        grid->addWidget(maxBoxes[i], 2, int(i) + 1);
+    }
+
+    levelBox = new QComboBox(this);
+    for (size_t lev=5; lev<=IMPLICIT_MAX_LEVELS; ++lev) {
+        int cells = 1 << lev;
+        levelBox->addItem(tr("%1 x %1 x %1").arg(cells), int(lev));
+    }
+    levelBox->setCurrentIndex(std::max(0, levelBox->findData(int(surf.levels()))));
+    grid->addWidget(new QLabel(tr("Grid")), 3, 0);
+    grid->addWidget(levelBox, 3, 1, 1, 3);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok |
+                                                     QDialogButtonBox::Cancel);
+    connect(buttons, SIGNAL(accepted()), this, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), this, SLOT(reject()));
+
+    QVBoxLayout *layout = new QVBoxLayout;
+    layout->addLayout(grid);
+    layout->addWidget(buttons);
+    setLayout(layout);
+}
+
+/*!
+  Compiles the expression and only closes the dialog if it is valid
+*/
+void ImplicitDialog::accept() {
+    ImplicitSurface surf(result);
+    try {
+        surf.setExpression(fEdit->text().toStdString());
+    } catch (const ExprError &err) {
+        QMessageBox::warning(this, tr("Invalid Expression"),
+                             QString::fromStdString(err.what()));
+        return;
+    }
+    double minPt[3], maxPt[3];
+    for (size_t i=0; i<3; ++i) {
+        minPt[i] = minBoxes[i]->value();
+        maxPt[i] = maxBoxes[i]->value();
+    }
+    surf.setBounds(minPt, maxPt);
+    surf.setLevels(size_t(levelBox->itemData(levelBox->currentIndex()).toInt()));
+
+    result = surf;
+    QDialog::accept();
+}
@@ -0,0 +1,54 @@
+/*
+  implicitdialog.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef IMPLICITDIALOG_H
+#define IMPLICITDIALOG_H
+
+#include <QDialog>
+
+#include "implicitsurface.h"
+
+class QLineEdit;
+class QDoubleSpinBox;
+class QComboBox;
+
+/*!
+  Dialog for entering F(x,y,z), the bounding box and the grid resolution
+  of an implicit surface.
+*/
+class ImplicitDialog : public QDialog {
+    Q_OBJECT;
+
+public:
+    ImplicitDialog(const ImplicitSurface &surf, QWidget *parent = 0);
+
+    const ImplicitSurface &surface() const { return result; }
+
+public slots:
+    void accept();
+
+private:
+    QLineEdit *fEdit;
+    QDoubleSpinBox *minBoxes[3];
+    QDoubleSpinBox *maxBoxes[3];
+    QComboBox *levelBox;
+
+    ImplicitSurface result;
+};
+
+#endif
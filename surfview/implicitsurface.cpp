@@ -0,0 +1,400 @@
+/*
+  implicitsurface.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+#include "implicitsurface.h"
+#include "parallel.h"
+
+namespace {
+
+// Cell flags: bit a set if the cell's edge from its min corner along
+// axis a crosses the surface, CELL_INSIDE if that corner has F < 0
+const unsigned char CELL_INSIDE = 8;
+
+/*!
+  Spreads the low 21 bits of x out to every third bit.
+*/
+uint64_t spreadBits(uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8) & 0x100f00f00f00f00fULL;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2) & 0x1249249249249249ULL;
+    return x;
+}
+
+uint64_t compactBits(uint64_t x) {
+    x &= 0x1249249249249249ULL;
+    x = (x | x >> 2) & 0x10c30c30c30c30c3ULL;
+    x = (x | x >> 4) & 0x100f00f00f00f00fULL;
+    x = (x | x >> 8) & 0x1f0000ff0000ffULL;
+    x = (x | x >> 16) & 0x1f00000000ffffULL;
+    x = (x | x >> 32) & 0x1fffff;
+    return x;
+}
+
+uint64_t mortonEncode(uint64_t x, uint64_t y, uint64_t z) {
+    return spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+}
+
+void mortonDecode(uint64_t m, uint64_t c[3]) {
+    c[0] = compactBits(m);
+    c[1] = compactBits(m >> 1);
+    c[2] = compactBits(m >> 2);
+}
+
+/*!
+  Everything one leaf contributes to the mesh.
+*/
+struct LeafCells {
+    std::vector<uint64_t> keys;
+    std::vector<float> verts;
+    std::vector<float> norms;
+    std::vector<unsigned char> flags;
+    std::vector<unsigned int> tris;
+};
+
+}
+
+/*!
+  Defaults to a torus matching the default parametric surface.
+*/
+ImplicitSurface::ImplicitSurface() : nLevels(7), lastLeaves(0) {
+    for (size_t i=0; i<3; ++i) {
+        bmin[i] = -6.0;
+        bmax[i] = 6.0;
+    }
+    setExpression("(x^2 + y^2 + z^2 + 15)^2 - 64*(x^2 + y^2)");
+}
+
+/*!
+  Compiles F along with its gradient, which supplies the normals.
+*/
+void ImplicitSurface::setExpression(const std::string &f) {
+    std::vector<std::string> vars;
+    vars.push_back("x");
+    vars.push_back("y");
+    vars.push_back("z");
+    ExprGraph graph(vars);
+
+    int root = graph.parse(f);
+    std::vector<int> value(1, root);
+    std::vector<int> grad;
+    for (size_t i=0; i<3; ++i) {
+        grad.push_back(graph.diff(root, i));
+    }
+
+    ExprProgram vp, gp;
+    vp.compile(graph, value);
+    gp.compile(graph, grad);
+
+    valueProg = vp;
+    gradProg = gp;
+    fExpr = f;
+}
+
+void ImplicitSurface::setBounds(const double minPt[3], const double maxPt[3]) {
+    for (size_t i=0; i<3; ++i) {
+        bmin[i] = std::min(minPt[i], maxPt[i]);
+        bmax[i] = std::max(minPt[i], maxPt[i]);
+    }
+}
+
+void ImplicitSurface::setLevels(size_t levels) {
+    nLevels = std::max(size_t(1), std::min(levels, IMPLICIT_MAX_LEVELS));
+}
+
+void ImplicitSurface::polygonize(Mesh &mesh) const {
+    mesh.clear();
+
+    const size_t leafBits = std::min(IMPLICIT_LEAF_BITS, nLevels);
+    const size_t octDepth = nLevels - leafBits;
+    const uint64_t gridCells = uint64_t(1) << nLevels;
+    double h[3];
+    for (size_t i=0; i<3; ++i) {
+        h[i] = (bmax[i] - bmin[i]) / double(gridCells);
+    }
+
+    // Refine the octree one level at a time.  Children are appended in
+    // Morton order, so each level stays sorted without a sort.
+    std::vector<uint64_t> nodes(1, 0);
+    for (size_t level=0; level<=octDepth; ++level) {
+        const double cells = double(uint64_t(1) << (nLevels - level));
+        const size_t grain = 64;
+        std::vector<std::vector<uint64_t> > kept((nodes.size() + grain - 1)/grain);
+
+        parallelFor(0, nodes.size(), grain, [&](size_t lo, size_t hi) {
+            std::vector<uint64_t> &out = kept[lo/grain];
+            for (size_t n=lo; n<hi; ++n) {
+                uint64_t c[3];
+                mortonDecode(nodes[n], c);
+                Interval box[3];
+                for (size_t k=0; k<3; ++k) {
+                    // Grow the box slightly so roundoff can't cull a root
+                    // sitting exactly on a node face
+                    box[k].lo = bmin[k] + (c[k]*cells - 1.0e-6)*h[k];
+                    box[k].hi = bmin[k] + ((c[k] + 1)*cells + 1.0e-6)*h[k];
+                }
+                Interval range;
+                valueProg.evalInterval(box, &range);
+                if (!(range.lo <= 0.0 && range.hi >= 0.0)) {
+                    continue;
+                }
+                if (level == octDepth) {
+                    out.push_back(nodes[n]);
+                } else {
+                    for (uint64_t child=0; child<8; ++child) {
+                        out.push_back((nodes[n] << 3) | child);
+                    }
+                }
+            }
+        });
+
+        nodes.clear();
+        for (size_t i=0; i<kept.size(); ++i) {
+            nodes.insert(nodes.end(), kept[i].begin(), kept[i].end());
+        }
+    }
+    lastLeaves = nodes.size();
+    if (nodes.empty()) return;
+
+    // Find the vertex of every cell in every leaf that straddles the surface
+    const size_t n = size_t(1) << leafBits;
+    const size_t np = n + 1;
+    std::vector<LeafCells> leaves(nodes.size());
+
+    static const int edges[12][2] = {
+        {0, 1}, {2, 3}, {4, 5}, {6, 7},
+        {0, 2}, {1, 3}, {4, 6}, {5, 7},
+        {0, 4}, {1, 5}, {2, 6}, {3, 7}
+    };
+
+    parallelFor(0, nodes.size(), 8, [&](size_t lo, size_t hi) {
+        std::vector<double> xs(np*np*np), ys(np*np*np), zs(np*np*np), vals(np*np*np);
+        std::vector<unsigned char> inside(np*np*np);
+        std::vector<uint64_t> active;
+        std::vector<double> gx, gy, gz, dx, dy, dz;
+
+        for (size_t l=lo; l<hi; ++l) {
+            LeafCells &leaf = leaves[l];
+            uint64_t origin[3];
+            mortonDecode(nodes[l], origin);
+            for (size_t k=0; k<3; ++k) {
+                origin[k] <<= leafBits;
+            }
+
+            // Sample F at every corner of the leaf's cells
+            size_t idx = 0;
+            for (size_t k=0; k<np; ++k) {
+                for (size_t j=0; j<np; ++j) {
+                    for (size_t i=0; i<np; ++i, ++idx) {
+                        xs[idx] = bmin[0] + double(origin[0] + i)*h[0];
+                        ys[idx] = bmin[1] + double(origin[1] + j)*h[1];
+                        zs[idx] = bmin[2] + double(origin[2] + k)*h[2];
+                    }
+                }
+            }
+            const double *in[3] = { &xs[0], &ys[0], &zs[0] };
+            double *out[1] = { &vals[0] };
+            valueProg.eval(in, out, np*np*np);
+
+            // Find the straddling cells with a cheap sign test, then
+            // visit them in Morton order so their keys come out sorted
+            for (size_t i=0; i<np*np*np; ++i) {
+                inside[i] = (vals[i] < 0.0);
+            }
+            active.clear();
+            for (size_t k=0; k<n; ++k) {
+                for (size_t j=0; j<n; ++j) {
+                    const unsigned char *s0 = &inside[(k*np + j)*np];
+                    const unsigned char *s1 = s0 + np;
+                    const unsigned char *s2 = s0 + np*np;
+                    const unsigned char *s3 = s2 + np;
+                    for (size_t i=0; i<n; ++i) {
+                        unsigned int count = s0[i] + s0[i+1] + s1[i] + s1[i+1] +
+                            s2[i] + s2[i+1] + s3[i] + s3[i+1];
+                        if (count != 0 && count != 8) {
+                            active.push_back(mortonEncode(i, j, k));
+                        }
+                    }
+                }
+            }
+            std::sort(active.begin(), active.end());
+
+            for (size_t ai=0; ai<active.size(); ++ai) {
+                uint64_t m = active[ai];
+                uint64_t c[3];
+                mortonDecode(m, c);
+                double v[8];
+                unsigned int mask = 0;
+                for (size_t corner=0; corner<8; ++corner) {
+                    size_t ci = c[0] + (corner & 1);
+                    size_t cj = c[1] + ((corner >> 1) & 1);
+                    size_t ck = c[2] + ((corner >> 2) & 1);
+                    v[corner] = vals[(ck*np + cj)*np + ci];
+                    if (v[corner] < 0.0) mask |= 1 << corner;
+                }
+
+                // Vertex goes at the mean of the edge crossings
+                double p[3] = { 0.0, 0.0, 0.0 };
+                size_t crossings = 0;
+                for (size_t e=0; e<12; ++e) {
+                    int a = edges[e][0];
+                    int b = edges[e][1];
+                    if (((mask >> a) & 1) == ((mask >> b) & 1)) continue;
+                    double t = v[a] / (v[a] - v[b]);
+                    for (size_t k=0; k<3; ++k) {
+                        double pa = double((a >> k) & 1);
+                        double pb = double((b >> k) & 1);
+                        p[k] += pa + t*(pb - pa);
+                    }
+                    ++crossings;
+                }
+
+                unsigned char flags = 0;
+                for (size_t a=0; a<3; ++a) {
+                    if (((mask >> 0) & 1) != ((mask >> (1 << a)) & 1)) {
+                        flags |= (unsigned char)(1 << a);
+                    }
+                }
+                if (mask & 1) flags |= CELL_INSIDE;
+
+                leaf.keys.push_back((nodes[l] << (3*leafBits)) | m);
+                leaf.flags.push_back(flags);
+                for (size_t k=0; k<3; ++k) {
+                    double g = double(origin[k] + c[k]) + p[k]/crossings;
+                    leaf.verts.push_back(float(bmin[k] + g*h[k]));
+                }
+            }
+
+            // Normals from the analytic gradient at each vertex
+            size_t nv = leaf.keys.size();
+            if (nv == 0) continue;
+            gx.resize(nv); gy.resize(nv); gz.resize(nv);
+            dx.resize(nv); dy.resize(nv); dz.resize(nv);
+            for (size_t i=0; i<nv; ++i) {
+                gx[i] = leaf.verts[3*i];
+                gy[i] = leaf.verts[3*i+1];
+                gz[i] = leaf.verts[3*i+2];
+            }
+            const double *gin[3] = { &gx[0], &gy[0], &gz[0] };
+            double *gout[3] = { &dx[0], &dy[0], &dz[0] };
+            gradProg.eval(gin, gout, nv);
+            leaf.norms.resize(3*nv);
+            for (size_t i=0; i<nv; ++i) {
+                double len = std::sqrt(dx[i]*dx[i] + dy[i]*dy[i] + dz[i]*dz[i]);
+                len = (len > 0.0) ? 1.0/len : 0.0;
+                leaf.norms[3*i] = float(dx[i]*len);
+                leaf.norms[3*i+1] = float(dy[i]*len);
+                leaf.norms[3*i+2] = float(dz[i]*len);
+            }
+        }
+    });
+
+    // Global vertex numbering.  Concatenating the leaves keeps Morton order.
+    std::vector<size_t> vertOffset(leaves.size() + 1, 0);
+    for (size_t l=0; l<leaves.size(); ++l) {
+        vertOffset[l+1] = vertOffset[l] + leaves[l].keys.size();
+    }
+    const size_t totalVerts = vertOffset.back();
+    std::vector<uint64_t> allKeys(totalVerts);
+    mesh.verts.resize(3*totalVerts);
+    mesh.norms.resize(3*totalVerts);
+
+    parallelFor(0, leaves.size(), 16, [&](size_t lo, size_t hi) {
+        for (size_t l=lo; l<hi; ++l) {
+            const LeafCells &leaf = leaves[l];
+            std::copy(leaf.keys.begin(), leaf.keys.end(), allKeys.begin() + vertOffset[l]);
+            std::copy(leaf.verts.begin(), leaf.verts.end(), mesh.verts.begin() + 3*vertOffset[l]);
+            std::copy(leaf.norms.begin(), leaf.norms.end(), mesh.norms.begin() + 3*vertOffset[l]);
+        }
+    });
+
+    // One quad per crossing edge, joining the four cells around it.
+    // Neighbours in other leaves are found in the shared, read-only key
+    // list, so no synchronization is needed.
+    parallelFor(0, leaves.size(), 4, [&](size_t lo, size_t hi) {
+        for (size_t l=lo; l<hi; ++l) {
+            LeafCells &leaf = leaves[l];
+            for (size_t i=0; i<leaf.keys.size(); ++i) {
+                unsigned char flags = leaf.flags[i];
+                if ((flags & 7) == 0) continue;
+
+                uint64_t c[3];
+                mortonDecode(leaf.keys[i], c);
+
+                for (size_t a=0; a<3; ++a) {
+                    if (!(flags & (1 << a))) continue;
+                    size_t b = (a + 1) % 3;
+                    size_t d = (a + 2) % 3;
+                    if (c[b] == 0 || c[d] == 0) continue;
+
+                    // Counter-clockwise around +a
+                    uint64_t nc[3][3];
+                    for (size_t q=0; q<3; ++q) {
+                        nc[q][0] = c[0];
+                        nc[q][1] = c[1];
+                        nc[q][2] = c[2];
+                    }
+                    nc[0][b] -= 1;
+                    nc[1][b] -= 1;
+                    nc[1][d] -= 1;
+                    nc[2][d] -= 1;
+
+                    unsigned int quad[4];
+                    quad[0] = (unsigned int)(vertOffset[l] + i);
+                    bool found = true;
+                    for (size_t q=0; q<3 && found; ++q) {
+                        uint64_t key = mortonEncode(nc[q][0], nc[q][1], nc[q][2]);
+                        std::vector<uint64_t>::const_iterator iter =
+                            std::lower_bound(allKeys.begin(), allKeys.end(), key);
+                        found = (iter != allKeys.end() && *iter == key);
+                        quad[q+1] = (unsigned int)(iter - allKeys.begin());
+                    }
+                    if (!found) continue;
+
+                    if (!(flags & CELL_INSIDE)) {
+                        std::swap(quad[1], quad[3]);
+                    }
+                    leaf.tris.push_back(quad[0]);
+                    leaf.tris.push_back(quad[1]);
+                    leaf.tris.push_back(quad[2]);
+                    leaf.tris.push_back(quad[0]);
+                    leaf.tris.push_back(quad[2]);
+                    leaf.tris.push_back(quad[3]);
+                }
+            }
+        }
+    });
+
+    std::vector<size_t> triOffset(leaves.size() + 1, 0);
+    for (size_t l=0; l<leaves.size(); ++l) {
+        triOffset[l+1] = triOffset[l] + leaves[l].tris.size();
+    }
+    mesh.indices.resize(triOffset.back());
+    parallelFor(0, leaves.size(), 16, [&](size_t lo, size_t hi) {
+        for (size_t l=lo; l<hi; ++l) {
+            std::copy(leaves[l].tris.begin(), leaves[l].tris.end(),
+                      mesh.indices.begin() + triOffset[l]);
+        }
+    });
+}
@@ -0,0 +1,79 @@
+/*
+  implicitsurface.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef IMPLICITSURFACE_H
+#define IMPLICITSURFACE_H
+
+#include <string>
+
+#include "expression.h"
+#include "mesh.h"
+
+// Each octree leaf is a block of 2^IMPLICIT_LEAF_BITS cells per axis
+static const size_t IMPLICIT_LEAF_BITS=4;
+// Finest supported grid is 2^IMPLICIT_MAX_LEVELS (2048) cells per axis
+static const size_t IMPLICIT_MAX_LEVELS=11;
+
+/*!
+  The surface F(x,y,z) = 0 inside an axis aligned box.
+
+  Polygonizing walks a sparse octree over the box, using interval
+  arithmetic on F to discard every node that cannot contain the
+  surface.  The surviving leaves are meshed in parallel with a dual
+  (surface nets) scheme: one vertex per cell that straddles the surface
+  and one quad per grid edge that crosses it.  Cells are keyed by their
+  Morton code, and since the leaves are produced in Morton order the
+  concatenated per-leaf vertex lists are already sorted.  Quads that
+  reach into a neighbouring leaf find its vertices with a binary search
+  of that read-only list, so vertices are shared across leaf boundaries
+  without any locking.  Storage is proportional to the number of cells
+  on the surface, not to the volume of the grid.
+*/
+class ImplicitSurface {
+public:
+    ImplicitSurface();
+
+    // Throws ExprError and leaves the surface unchanged on failure
+    void setExpression(const std::string &f);
+    void setBounds(const double minPt[3], const double maxPt[3]);
+    // The grid has 2^levels cells per axis, clamped to the supported range
+    void setLevels(size_t levels);
+
+    const std::string &expression() const { return fExpr; }
+    const double *boundsMin() const { return bmin; }
+    const double *boundsMax() const { return bmax; }
+    size_t levels() const { return nLevels; }
+
+    void polygonize(Mesh &mesh) const;
+
+    // Number of octree leaves that survived culling in the last polygonize()
+    size_t activeLeaves() const { return lastLeaves; }
+
+private:
+    std::string fExpr;
+    double bmin[3];
+    double bmax[3];
+    size_t nLevels;
+
+    ExprProgram valueProg;
+    ExprProgram gradProg;
+
+    mutable size_t lastLeaves;
+};
+
+#endif
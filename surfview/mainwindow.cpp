@@ -20,10 +20,15 @@
 #include <QSettings>
 
 #include <cstdlib>
+#include <stdexcept>
 
 #include "mainwindow.h"
 
 #include "surfaceviewer.h"
+#include "surfacedialog.h"
+#include "implicitdialog.h"
+#include "simplifydialog.h"
+#include "subdivisiondialog.h"
 
 /*!
   Performs initialization
@@ -32,6 +37,11 @@ MainWindow::MainWindow() : QMainWindow(), promptExit(true), showingFacets(true),
   
     // Create SurfaceViewer widget
     sview = new SurfaceViewer(this);
+    connect(sview, SIGNAL(surfacePicked(int, double, double, double, double, double)),
+            this, SLOT(showPickedPoint(int, double, double, double, double, double)));
+    connect(sview, SIGNAL(objectPicked(int)), this, SLOT(showPickedObject(int)));
+    connect(sview, SIGNAL(animationStats(double, double)), this, SLOT(showAnimationStats(double, double)));
+    connect(sview, SIGNAL(detailChanged(int, double)), this, SLOT(showDetail(int, double)));
   
     qset = new QSettings(QSettings::IniFormat, QSettings::UserScope,
                          "SurfaceViewer", "SurfaceViewer");
@@ -56,10 +66,20 @@ MainWindow::~MainWindow() {
     delete aboutQtAction;
     delete quitAction;
     delete resetViewAction;
+    delete editSurfaceAction;
+    delete editImplicitAction;
+    delete editSubdivisionAction;
+    delete triangleBudgetAction;
+    delete frameTargetAction;
+    delete surfaceCopiesAction;
+    delete animateAction;
+    delete showIsolinesAction;
+    delete shadingGroup;
 
     delete theToolbar;
   
     delete fileMenu;
+    delete shadingMenu;
     delete optionsMenu;
     delete helpMenu;
     delete statusLabel;
@@ -98,6 +118,61 @@ void MainWindow::createActions() {
     resetViewAction->setShortcut(tr("Ctrl+V"));
     resetViewAction->setStatusTip(tr("Reset the view"));
     connect(resetViewAction, SIGNAL(triggered()), this, SLOT(resetView()));
+
+    // Edit surface
+    editSurfaceAction = new QAction(tr("Edit Surface..."), this);
+    editSurfaceAction->setShortcut(tr("Ctrl+E"));
+    editSurfaceAction->setStatusTip(tr("Enter new surface expressions"));
+    connect(editSurfaceAction, SIGNAL(triggered()), this, SLOT(editSurface()));
+
+    // Edit implicit surface
+    editImplicitAction = new QAction(tr("Edit Implicit Surface..."), this);
+    editImplicitAction->setShortcut(tr("Ctrl+I"));
+    editImplicitAction->setStatusTip(tr("Enter an implicit surface F(x,y,z) = 0"));
+    connect(editImplicitAction, SIGNAL(triggered()), this, SLOT(editImplicitSurface()));
+
+    // Edit subdivision surface
+    editSubdivisionAction = new QAction(tr("Subdivision Surface..."), this);
+    editSubdivisionAction->setShortcut(tr("Ctrl+D"));
+    editSubdivisionAction->setStatusTip(tr("Show a subdivision surface"));
+    connect(editSubdivisionAction, SIGNAL(triggered()), this, SLOT(editSubdivisionSurface()));
+
+    triangleBudgetAction = new QAction(tr("Triangle Budget..."), this);
+    triangleBudgetAction->setStatusTip(tr("Simplify meshes to a number of triangles or an error bound"));
+    connect(triangleBudgetAction, SIGNAL(triggered()), this, SLOT(editTriangleBudget()));
+
+    frameTargetAction = new QAction(tr("Frame Time Target..."), this);
+    frameTargetAction->setStatusTip(tr("Lower the surface's detail until frames take this long"));
+    connect(frameTargetAction, SIGNAL(triggered()), this, SLOT(editFrameTarget()));
+
+    surfaceCopiesAction = new QAction(tr("Surface Copies..."), this);
+    surfaceCopiesAction->setStatusTip(tr("Show copies of the surface around it"));
+    connect(surfaceCopiesAction, SIGNAL(triggered()), this, SLOT(editSurfaceCopies()));
+
+    animateAction = new QAction(tr("Animate"), this);
+    animateAction->setShortcut(tr("Ctrl+T"));
+    animateAction->setStatusTip(tr("Animate surfaces that use the time t"));
+    animateAction->setCheckable(true);
+    animateAction->setChecked(sview->isAnimating());
+    connect(animateAction, SIGNAL(triggered()), this, SLOT(toggleAnimation()));
+
+    // One checkable action per SHADE_ constant, in order
+    const char *shadings[NUM_SHADINGS] = { "Material", "Gaussian Curvature", "Mean Curvature",
+                                           "Max Principal Curvature", "Min Principal Curvature",
+                                           "Zebra Stripes" };
+    shadingGroup = new QActionGroup(this);
+    for (size_t i=0; i<NUM_SHADINGS; ++i) {
+        QAction *action = shadingGroup->addAction(tr(shadings[i]));
+        action->setData(int(i));
+        action->setCheckable(true);
+        action->setChecked(i == sview->getShading());
+    }
+    shadingGroup->actions()[SHADE_MATERIAL]->setStatusTip(tr("Colour surfaces with their material"));
+    shadingGroup->actions()[SHADE_ZEBRA]->setStatusTip(tr("Show reflected stripes, which kink where the surface does"));
+    for (size_t i=SHADE_GAUSSIAN; i<=SHADE_MIN; ++i) {
+        shadingGroup->actions()[int(i)]->setStatusTip(tr("Colour the parametric surface by its curvature"));
+    }
+    connect(shadingGroup, SIGNAL(triggered(QAction*)), this, SLOT(changeShading(QAction*)));
     
     showFacetsAction = new QAction(tr("Show Facets"), this);
     showFacetsAction->setStatusTip(tr("Show facet outlines."));
@@ -105,6 +180,12 @@ void MainWindow::createActions() {
     showFacetsAction->setChecked(showingFacets);
     connect(showFacetsAction, SIGNAL(triggered()), this, SLOT(toggleFacets()));
     
+    showIsolinesAction = new QAction(tr("Show Isolines"), this);
+    showIsolinesAction->setStatusTip(tr("Draw u and v isolines on the parametric surface, spaced by arc length."));
+    showIsolinesAction->setCheckable(true);
+    showIsolinesAction->setChecked(sview->getShowIsolines());
+    connect(showIsolinesAction, SIGNAL(triggered()), this, SLOT(toggleIsolines()));
+
     showPolygonsAction = new QAction(tr("Show Polygons"), this);
     showPolygonsAction->setStatusTip(tr("Fill facets."));
     showPolygonsAction->setCheckable(true);
@@ -122,8 +203,19 @@ void MainWindow::createMenus() {
 
     // Options menu
     optionsMenu = menuBar()->addMenu(tr("&Options"));
+    optionsMenu->addAction(editSurfaceAction);
+    optionsMenu->addAction(editImplicitAction);
+    optionsMenu->addAction(editSubdivisionAction);
+    optionsMenu->addSeparator();
+    optionsMenu->addAction(triangleBudgetAction);
+    optionsMenu->addAction(frameTargetAction);
+    optionsMenu->addAction(surfaceCopiesAction);
+    optionsMenu->addAction(animateAction);
+    shadingMenu = optionsMenu->addMenu(tr("Shading"));
+    shadingMenu->addActions(shadingGroup->actions());
     optionsMenu->addAction(showPolygonsAction);
     optionsMenu->addAction(showFacetsAction);
+    optionsMenu->addAction(showIsolinesAction);
 
     // Help menu
     helpMenu = menuBar()->addMenu(tr("&Help"));
@@ -160,6 +252,23 @@ void MainWindow::updateStatusBar(QString txt) {
     statusLabel->setText(txt);
 }
 
+/*!
+  Shows where a shift+click landed on the surface
+*/
+void MainWindow::showPickedPoint(int patch, double u, double v, double x, double y, double z) {
+    statusLabel->setText(tr("Patch %1  (u, v) = (%2, %3)  (%4, %5, %6)")
+                         .arg(patch).arg(u, 0, 'g', 6).arg(v, 0, 'g', 6)
+                         .arg(x, 0, 'g', 6).arg(y, 0, 'g', 6).arg(z, 0, 'g', 6));
+}
+
+/*!
+  Shows which scene object a ctrl+click landed on
+*/
+void MainWindow::showPickedObject(int id) {
+    statusLabel->setText(id == sview->getSurfaceObject() ? tr("Object %1 (the surface)").arg(id)
+                                                          : tr("Object %1").arg(id));
+}
+
 /*!
   Display the about box
 */
@@ -172,9 +281,11 @@ void MainWindow::about() {
 }
 
 /*!
-  Prompt before closing
+  Prompt before closing.  The governor's costs are saved here, since
+  they keep being refined after the last change of detail.
 */
 void MainWindow::closeEvent(QCloseEvent *event) {
+    writeGovernorSettings();
     event->accept();
 }
 
@@ -193,6 +304,288 @@ void MainWindow::readSettings() {
     // qset->value("whatever", default_int_value).toInt();
     // qset->value("whatever", default_string_value).toString();
     // qset->value("whatever", QDateTime(2012, 4,2)).toDateTime();
+
+    ParametricSurface surf(sview->getSurface());
+    try {
+        surf.setExpressions(qset->value("surface/x", QString::fromStdString(surf.xExpression())).toString().toStdString(),
+                            qset->value("surface/y", QString::fromStdString(surf.yExpression())).toString().toStdString(),
+                            qset->value("surface/z", QString::fromStdString(surf.zExpression())).toString().toStdString());
+        surf.setDomain(qset->value("surface/umin", surf.uMin()).toDouble(),
+                       qset->value("surface/umax", surf.uMax()).toDouble(),
+                       qset->value("surface/vmin", surf.vMin()).toDouble(),
+                       qset->value("surface/vmax", surf.vMax()).toDouble());
+        surf.setResolution(qset->value("surface/usteps", int(surf.uSteps())).toInt(),
+                           qset->value("surface/vsteps", int(surf.vSteps())).toInt());
+    } catch (const ExprError &) {
+        // Keep the default surface if the saved one no longer parses
+        surf = sview->getSurface();
+    }
+
+    ImplicitSurface isurf(sview->getImplicitSurface());
+    try {
+        isurf.setExpression(qset->value("implicit/f", QString::fromStdString(isurf.expression())).toString().toStdString());
+        double minPt[3], maxPt[3];
+        const char *axes[3] = { "x", "y", "z" };
+        for (size_t i=0; i<3; ++i) {
+            minPt[i] = qset->value(QString("implicit/%1min").arg(axes[i]), isurf.boundsMin()[i]).toDouble();
+            maxPt[i] = qset->value(QString("implicit/%1max").arg(axes[i]), isurf.boundsMax()[i]).toDouble();
+        }
+        isurf.setBounds(minPt, maxPt);
+        isurf.setLevels(qset->value("implicit/levels", int(isurf.levels())).toInt());
+    } catch (const ExprError &) {
+        isurf = sview->getImplicitSurface();
+    }
+
+    SubdivisionSurface ssurf(sview->getSubdivisionSurface());
+    try {
+        ssurf.setLevels(0);
+        ssurf.setPresetCage(qset->value("subdivision/cage", int(ssurf.presetCage())).toInt());
+        ssurf.setScheme(qset->value("subdivision/scheme", int(ssurf.scheme())).toInt());
+        ssurf.setLevels(qset->value("subdivision/levels", int(sview->getSubdivisionSurface().levels())).toInt());
+    } catch (const std::runtime_error &) {
+        ssurf = sview->getSubdivisionSurface();
+    }
+
+    sview->setTriangleBudget(qset->value("view/triangleBudget", 0).toInt());
+    sview->setSimplifyError(qset->value("view/simplifyError", 0.0).toDouble());
+    sview->setSurfaceCopies(qset->value("view/copies", 0).toInt());
+    sview->setAnimating(qset->value("view/animate", false).toBool());
+    sview->setShading(qset->value("view/shading", int(SHADE_MATERIAL)).toInt());
+    sview->setShowIsolines(qset->value("view/isolines", false).toBool());
+
+    // Set before the surfaces, so the first mesh is built at the tuned detail
+    FrameGovernor gov(sview->getGovernor());
+    gov.setTarget(qset->value("governor/target", gov.target()).toDouble());
+    if (qset->contains("governor/drawPerTriangle")) {
+        gov.drawCost().restore(qset->value("governor/drawOverhead", 0.0).toDouble(),
+                               qset->value("governor/drawPerTriangle", 0.0).toDouble());
+    }
+    if (qset->contains("governor/regenPerTriangle")) {
+        gov.regenCost().restore(qset->value("governor/regenOverhead", 0.0).toDouble(),
+                                qset->value("governor/regenPerTriangle", 0.0).toDouble());
+    }
+    gov.setLodBias(qset->value("governor/lodBias", 0).toInt());
+    sview->setGovernor(gov);
+
+    // Whichever is set last is the one displayed
+    sview->setSurface(surf);
+    sview->setImplicitSurface(isurf);
+    sview->setSubdivisionSurface(ssurf);
+    switch (qset->value("surface/type", int(PARAMETRIC_SURFACE)).toInt()) {
+    case IMPLICIT_SURFACE:
+        sview->setImplicitSurface(isurf);
+        break;
+    case SUBDIVISION_SURFACE:
+        break;
+    default:
+        sview->setSurface(surf);
+        break;
+    }
+}
+
+/*!
+  Saves the current surfaces so they are restored on the next run
+*/
+void MainWindow::writeSurfaceSettings() {
+    const ParametricSurface &surf = sview->getSurface();
+    qset->setValue("surface/type", int(sview->getSurfaceType()));
+    qset->setValue("surface/x", QString::fromStdString(surf.xExpression()));
+    qset->setValue("surface/y", QString::fromStdString(surf.yExpression()));
+    qset->setValue("surface/z", QString::fromStdString(surf.zExpression()));
+    qset->setValue("surface/umin", surf.uMin());
+    qset->setValue("surface/umax", surf.uMax());
+    qset->setValue("surface/vmin", surf.vMin());
+    qset->setValue("surface/vmax", surf.vMax());
+    qset->setValue("surface/usteps", int(surf.uSteps()));
+    qset->setValue("surface/vsteps", int(surf.vSteps()));
+
+    const ImplicitSurface &isurf = sview->getImplicitSurface();
+    const char *axes[3] = { "x", "y", "z" };
+    qset->setValue("implicit/f", QString::fromStdString(isurf.expression()));
+    for (size_t i=0; i<3; ++i) {
+        qset->setValue(QString("implicit/%1min").arg(axes[i]), isurf.boundsMin()[i]);
+        qset->setValue(QString("implicit/%1max").arg(axes[i]), isurf.boundsMax()[i]);
+    }
+    qset->setValue("implicit/levels", int(isurf.levels()));
+
+    const SubdivisionSurface &ssurf = sview->getSubdivisionSurface();
+    qset->setValue("subdivision/cage", int(ssurf.presetCage()));
+    qset->setValue("subdivision/scheme", int(ssurf.scheme()));
+    qset->setValue("subdivision/levels", int(ssurf.levels()));
+    qset->setValue("view/triangleBudget", int(sview->getTriangleBudget()));
+    qset->setValue("view/simplifyError", sview->getSimplifyError());
+    qset->setValue("view/copies", int(sview->getSurfaceCopies()));
+    qset->setValue("view/animate", sview->isAnimating());
+    qset->setValue("view/shading", int(sview->getShading()));
+    qset->setValue("view/isolines", sview->getShowIsolines());
+    qset->sync();
+}
+
+/*!
+  Lets the user type in a new surface
+*/
+void MainWindow::editSurface() {
+    SurfaceDialog dlg(sview->getSurface(), this);
+    if (dlg.exec() == QDialog::Accepted) {
+        sview->setSurface(dlg.surface());
+        writeSurfaceSettings();
+        // The budget may have simplified it, so count after repainting
+        sview->updateGL();
+        updateStatusBar(tr("%1 triangles").arg(sview->numTriangles()));
+    }
+}
+
+/*!
+  Lets the user type in a new implicit surface
+*/
+void MainWindow::editImplicitSurface() {
+    ImplicitDialog dlg(sview->getImplicitSurface(), this);
+    if (dlg.exec() == QDialog::Accepted) {
+        sview->setImplicitSurface(dlg.surface());
+        writeSurfaceSettings();
+        // Repaint now so the triangle count is current
+        sview->updateGL();
+        updateStatusBar(tr("%1 triangles").arg(sview->numTriangles()));
+    }
+}
+
+/*!
+  Lets the user pick a subdivision surface
+*/
+void MainWindow::editSubdivisionSurface() {
+    SubdivisionDialog dlg(sview->getSubdivisionSurface(), this);
+    if (dlg.exec() == QDialog::Accepted) {
+        sview->setSubdivisionSurface(dlg.surface());
+        writeSurfaceSettings();
+        sview->updateGL();
+        updateStatusBar(tr("%1 triangles").arg(sview->numTriangles()));
+    }
+}
+
+/*!
+  Asks for the most triangles to draw.  Bigger meshes are simplified.
+*/
+void MainWindow::editTriangleBudget() {
+    MeshSimplifier simp;
+    simp.setTriangleBudget(sview->getTriangleBudget());
+    simp.setMaxError(sview->getSimplifyError());
+    SimplifyDialog dlg(simp, this);
+    if (dlg.exec() == QDialog::Accepted) {
+        sview->setTriangleBudget(dlg.simplifier().triangleBudget());
+        sview->setSimplifyError(dlg.simplifier().maxError());
+        writeSurfaceSettings();
+        sview->updateGL();
+        updateStatusBar(tr("%1 triangles").arg(sview->numTriangles()));
+    }
+}
+
+/*!
+  Asks for the frame time the governor should aim for
+*/
+void MainWindow::editFrameTarget() {
+    bool ok = false;
+    double ms = QInputDialog::getDouble(this, tr("Frame Time Target"),
+                                        tr("Milliseconds per frame (0 for full detail):"),
+                                        sview->getGovernor().target(), 0.0, 1000.0, 1, &ok);
+    if (ok) {
+        FrameGovernor gov(sview->getGovernor());
+        gov.setTarget(ms);
+        sview->setGovernor(gov);
+        writeGovernorSettings();
+    }
+}
+
+/*!
+  Saves the governor's target, detail and fitted costs, so the next run
+  starts out at the detail this machine can draw
+*/
+void MainWindow::writeGovernorSettings() {
+    const FrameGovernor &gov = sview->getGovernor();
+    qset->setValue("governor/target", gov.target());
+    qset->setValue("governor/lodBias", gov.lodBias());
+    if (gov.drawCost().calibrated()) {
+        qset->setValue("governor/drawOverhead", gov.drawCost().overhead());
+        qset->setValue("governor/drawPerTriangle", gov.drawCost().perTriangle());
+    }
+    if (gov.regenCost().calibrated()) {
+        qset->setValue("governor/regenOverhead", gov.regenCost().overhead());
+        qset->setValue("governor/regenPerTriangle", gov.regenCost().perTriangle());
+    }
+}
+
+/*!
+  Asks how many copies of the surface to show.  They share the
+  surface's mesh, so drawing them costs one draw call per colour.
+*/
+void MainWindow::editSurfaceCopies() {
+    bool ok = false;
+    int copies = QInputDialog::getInt(this, tr("Surface Copies"), tr("Copies of the surface:"),
+                                      int(sview->getSurfaceCopies()), 0, 100000, 100, &ok);
+    if (ok) {
+        sview->setSurfaceCopies(copies);
+        writeSurfaceSettings();
+        sview->updateGL();
+        updateStatusBar(tr("%1 objects, %2 draw calls")
+                        .arg(sview->getScene().numObjects()).arg(sview->numDrawCalls()));
+    }
+}
+
+/*!
+  Starts or stops animating the parametric surface
+*/
+void MainWindow::toggleAnimation() {
+    sview->setAnimating(!sview->isAnimating());
+    writeSurfaceSettings();
+    if (!sview->isAnimating()) {
+        updateStatusBar(tr("Stopped at t = %1").arg(sview->getSurface().time(), 0, 'g', 6));
+    }
+}
+
+/*!
+  Shows how fast frames of the animation are being drawn and uploaded
+*/
+void MainWindow::showAnimationStats(double fps, double bytesPerSec) {
+    statusLabel->setText(tr("%1 frames/s, %2 MB/s uploaded")
+                         .arg(fps, 0, 'f', 1).arg(bytesPerSec/(1024.0*1024.0), 0, 'f', 1));
+}
+
+/*!
+  Switches to the shading picked from the Shading menu, and for the
+  curvatures shows the range the colour map covers
+*/
+void MainWindow::changeShading(QAction *action) {
+    size_t mode = action->data().toInt();
+    sview->setShading(mode);
+    writeSurfaceSettings();
+    if (mode < SHADE_GAUSSIAN || mode > SHADE_MIN) {
+        updateStatusBar(action->text());
+        return;
+    }
+    // The curvatures and their histogram come from the next paint
+    sview->updateGL();
+    const CurvatureHistogram &hist = sview->curvatureHistogram(mode - SHADE_GAUSSIAN);
+    if (hist.count() == 0) {
+        updateStatusBar(tr("No curvatures for this surface"));
+        return;
+    }
+    updateStatusBar(tr("%1: colours span +/-%2, values %3 to %4")
+                    .arg(action->text())
+                    .arg(sview->curvatureRange(), 0, 'g', 4)
+                    .arg(hist.minValue(), 0, 'g', 4)
+                    .arg(hist.maxValue(), 0, 'g', 4));
+}
+
+/*!
+  Reports a change of detail by the governor and saves it
+*/
+void MainWindow::showDetail(int lodBias, double frameMs) {
+    if (lodBias == 0) {
+        updateStatusBar(tr("Full detail, about %1 ms per frame").arg(frameMs, 0, 'f', 1));
+    } else {
+        updateStatusBar(tr("1/%1 of the triangles, about %2 ms per frame")
+                        .arg(1 << -lodBias).arg(frameMs, 0, 'f', 1));
+    }
+    writeGovernorSettings();
 }
 
 void MainWindow::toggleFacets() {
@@ -201,6 +594,10 @@ void MainWindow::toggleFacets() {
         sview->setShowFacets(showingFacets);
     }
 }
+void MainWindow::toggleIsolines() {
+    sview->setShowIsolines(!sview->getShowIsolines());
+    writeSurfaceSettings();
+}
 void MainWindow::togglePolygons() {
     showingPolygons = !showingPolygons;
     if (sview) {
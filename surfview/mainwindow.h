@@ -24,6 +24,7 @@
 #include <ctime>
 
 class QAction;
+class QActionGroup;
 class QLabel;
 class QIcon;
 class QMenu;
@@ -47,6 +48,19 @@ private slots:
     void updateStatusBar(QString fileName);
     void toggleFacets();
     void togglePolygons();
+    void toggleIsolines();
+    void editSurface();
+    void editImplicitSurface();
+    void editSubdivisionSurface();
+    void editTriangleBudget();
+    void editFrameTarget();
+    void editSurfaceCopies();
+    void toggleAnimation();
+    void showAnimationStats(double fps, double bytesPerSec);
+    void changeShading(QAction *action);
+    void showDetail(int lodBias, double frameMs);
+    void showPickedPoint(int patch, double u, double v, double x, double y, double z);
+    void showPickedObject(int id);
 
 protected:
     // Initialization functions
@@ -57,19 +71,31 @@ protected:
     void closeEvent(QCloseEvent *event);
 
     void readSettings();
+    void writeSurfaceSettings();
+    void writeGovernorSettings();
 private:
     QAction *aboutAction;
     QAction *aboutQtAction;
     QAction *quitAction;
     QAction *resetViewAction;
+    QAction *editSurfaceAction;
+    QAction *editImplicitAction;
+    QAction *editSubdivisionAction;
+    QAction *triangleBudgetAction;
+    QAction *frameTargetAction;
+    QAction *surfaceCopiesAction;
+    QAction *animateAction;
+    QActionGroup *shadingGroup;
 
     QAction *showFacetsAction;
     QAction *showPolygonsAction;
+    QAction *showIsolinesAction;
 
     QToolBar *theToolbar;
   
     QMenu *fileMenu;
     QMenu *optionsMenu;
+    QMenu *shadingMenu;
     QMenu *helpMenu;
     QLabel *statusLabel;
     QIcon *tbIcon;
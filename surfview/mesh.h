@@ -0,0 +1,74 @@
+/*
+  mesh.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <vector>
+#include <cstddef>
+
+// Curvatures in Mesh::curvature, per vertex
+static const size_t CURVATURE_GAUSSIAN=0;
+static const size_t CURVATURE_MEAN=1;
+static const size_t CURVATURE_MAX=2;
+static const size_t CURVATURE_MIN=3;
+static const size_t NUM_CURVATURES=4;
+
+/*!
+  Indexed triangle mesh in the layout SurfaceViewer hands to OpenGL:
+  three floats per vertex and normal, three indices per triangle.
+
+  curvature is optional.  When it's filled in it holds NUM_CURVATURES
+  floats per vertex: Gaussian, mean, and the larger and smaller
+  principal curvatures.
+*/
+struct Mesh {
+    std::vector<float> verts;
+    std::vector<float> norms;
+    std::vector<unsigned int> indices;
+    std::vector<float> curvature;
+
+    size_t numVerts() const { return verts.size()/3; }
+    size_t numTris() const { return indices.size()/3; }
+
+    void clear() {
+        verts.clear();
+        norms.clear();
+        indices.clear();
+        curvature.clear();
+    }
+
+    /*!
+      Computes the axis aligned bounding box.  Leaves min/max untouched
+      when the mesh is empty.
+    */
+    void bounds(float minPt[3], float maxPt[3]) const {
+        if (verts.empty()) return;
+        for (size_t j=0; j<3; ++j) {
+            minPt[j] = maxPt[j] = verts[j];
+        }
+        for (size_t i=3; i<verts.size(); i+=3) {
+            for (size_t j=0; j<3; ++j) {
+                if (verts[i+j] < minPt[j]) minPt[j] = verts[i+j];
+                if (verts[i+j] > maxPt[j]) maxPt[j] = verts[i+j];
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,584 @@
+/*
+  meshsimplifier.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+#include "meshsimplifier.h"
+#include "parallel.h"
+
+namespace {
+
+// Cells in the cluster grid, kept small enough to count densely
+const size_t MAX_GRID_CELLS = 1 << 22;
+
+// Clusters handed to a thread at a time
+const size_t CLUSTER_GRAIN = 2;
+
+// Cluster grid offsets for each pass, as a fraction of a cell
+const double passShift[SIMPLIFY_MAX_PASSES] = { 0.0, 0.5, 0.25, 0.75, 0.125, 0.625 };
+
+// Triangles not inside a single cluster
+const uint32_t NO_CELL = 0xffffffffu;
+
+struct Collapse {
+    double cost;
+    int a;
+    int b;
+
+    bool operator<(const Collapse &o) const { return cost < o.cost; }
+};
+
+/*!
+  One cluster's vertices, triangles and collapse queue, in local
+  numbering.  Reused for each cluster in a chunk of work.
+*/
+struct Cluster {
+    std::vector<unsigned int> globalVert;
+    std::vector<double> pos;
+    std::vector<double> nrm;
+    std::vector<double> quad;
+    std::vector<char> locked;
+    std::vector<char> removed;
+    std::vector<char> touched;
+
+    std::vector<int> tris;
+    std::vector<char> dead;
+    std::vector<std::vector<int> > adj;
+
+    std::vector<uint64_t> edges;
+    std::vector<Collapse> queue;
+    std::vector<int> ringA;
+    std::vector<int> ringB;
+    std::vector<unsigned int> markA;
+    std::vector<unsigned int> markB;
+    unsigned int stamp;
+
+    double maxCost;
+    double cosFeature;
+    size_t live;
+};
+
+/*!
+  Error quadric of a set of planes, as the upper triangle of the 4x4
+  matrix: xx xy xz xw yy yz yw zz zw ww.
+*/
+inline void addPlane(double *q, double a, double b, double c, double d) {
+    q[0] += a*a; q[1] += a*b; q[2] += a*c; q[3] += a*d;
+    q[4] += b*b; q[5] += b*c; q[6] += b*d;
+    q[7] += c*c; q[8] += c*d;
+    q[9] += d*d;
+}
+
+inline double quadricError(const double *q, const double *p) {
+    double x = p[0], y = p[1], z = p[2];
+    return q[0]*x*x + 2.0*q[1]*x*y + 2.0*q[2]*x*z + 2.0*q[3]*x
+        + q[4]*y*y + 2.0*q[5]*y*z + 2.0*q[6]*y
+        + q[7]*z*z + 2.0*q[8]*z
+        + q[9];
+}
+
+inline void triNormal(const double *p0, const double *p1, const double *p2, double *n) {
+    double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+/*!
+  Where collapsing a and b should put the merged vertex, and what it
+  costs.  Returns a negative cost if the edge mustn't collapse.
+*/
+double collapseCost(const Cluster &cl, int a, int b, double *p) {
+    if (cl.locked[a] && cl.locked[b]) return -1.0;
+    const double *na = &cl.nrm[3*a], *nb = &cl.nrm[3*b];
+    if (na[0]*nb[0] + na[1]*nb[1] + na[2]*nb[2] < cl.cosFeature) return -1.0;
+
+    double q[10];
+    for (size_t k=0; k<10; ++k) {
+        q[k] = cl.quad[10*a+k] + cl.quad[10*b+k];
+    }
+    const double *pa = &cl.pos[3*a], *pb = &cl.pos[3*b];
+    if (cl.locked[a] || cl.locked[b]) {
+        const double *keep = cl.locked[a] ? pa : pb;
+        p[0] = keep[0];
+        p[1] = keep[1];
+        p[2] = keep[2];
+        return std::max(quadricError(q, p), 0.0);
+    }
+
+    // Minimize the quadric by Cramer's rule if it's well conditioned
+    double m00 = q[0], m01 = q[1], m02 = q[2], m11 = q[4], m12 = q[5], m22 = q[7];
+    double c0 = m11*m22 - m12*m12, c1 = m02*m12 - m01*m22, c2 = m01*m12 - m02*m11;
+    double det = m00*c0 + m01*c1 + m02*c2;
+    double scale = m00*m11*m22 + 1.0e-300;
+    if (std::fabs(det) > 1.0e-9*scale) {
+        double r0 = -q[3], r1 = -q[6], r2 = -q[8];
+        p[0] = (r0*c0 + r1*c1 + r2*c2)/det;
+        p[1] = (r0*c1 + r1*(m00*m22 - m02*m02) + r2*(m01*m02 - m00*m12))/det;
+        p[2] = (r0*c2 + r1*(m01*m02 - m00*m12) + r2*(m00*m11 - m01*m01))/det;
+
+        // Don't trust solutions far from the edge
+        double e[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+        double mid[3] = { p[0] - 0.5*(pa[0] + pb[0]), p[1] - 0.5*(pa[1] + pb[1]),
+                          p[2] - 0.5*(pa[2] + pb[2]) };
+        if (mid[0]*mid[0] + mid[1]*mid[1] + mid[2]*mid[2] <=
+            4.0*(e[0]*e[0] + e[1]*e[1] + e[2]*e[2])) {
+            return std::max(quadricError(q, p), 0.0);
+        }
+    }
+
+    // Otherwise the best of the ends and the middle
+    double best = HUGE_VAL;
+    for (size_t i=0; i<3; ++i) {
+        double t = 0.5*i;
+        double c[3] = { pa[0] + t*(pb[0] - pa[0]), pa[1] + t*(pb[1] - pa[1]),
+                        pa[2] + t*(pb[2] - pa[2]) };
+        double err = quadricError(q, c);
+        if (err < best) {
+            best = err;
+            p[0] = c[0];
+            p[1] = c[1];
+            p[2] = c[2];
+        }
+    }
+    return std::max(best, 0.0);
+}
+
+void queueEdge(Cluster &cl, int a, int b) {
+    double p[3];
+    double cost = collapseCost(cl, a, b, p);
+    if (cost < 0.0 || cost > cl.maxCost) return;
+    Collapse c;
+    c.cost = cost;
+    c.a = a;
+    c.b = b;
+    cl.queue.push_back(c);
+}
+
+// Distinct neighbours of v through its live triangles, tagged in mark
+void gatherRing(const Cluster &cl, int v, std::vector<int> &ring,
+                std::vector<unsigned int> &mark) {
+    ring.clear();
+    const std::vector<int> &adj = cl.adj[v];
+    for (size_t i=0; i<adj.size(); ++i) {
+        int t = adj[i];
+        if (cl.dead[t]) continue;
+        for (size_t k=0; k<3; ++k) {
+            int w = cl.tris[3*t+k];
+            if (w != v && mark[w] != cl.stamp) {
+                mark[w] = cl.stamp;
+                ring.push_back(w);
+            }
+        }
+    }
+}
+
+// True if moving v to p would flip or flatten one of its triangles
+bool wouldFlip(const Cluster &cl, int v, int other, const double *p) {
+    const std::vector<int> &adj = cl.adj[v];
+    for (size_t i=0; i<adj.size(); ++i) {
+        int t = adj[i];
+        if (cl.dead[t]) continue;
+        const int *tv = &cl.tris[3*t];
+        if (tv[0] == other || tv[1] == other || tv[2] == other) continue;
+        const double *c[3];
+        for (size_t k=0; k<3; ++k) {
+            c[k] = &cl.pos[3*tv[k]];
+        }
+        double before[3], after[3];
+        triNormal(c[0], c[1], c[2], before);
+        for (size_t k=0; k<3; ++k) {
+            if (tv[k] == v) c[k] = p;
+        }
+        triNormal(c[0], c[1], c[2], after);
+        double lb = std::sqrt(before[0]*before[0] + before[1]*before[1] + before[2]*before[2]);
+        double la = std::sqrt(after[0]*after[0] + after[1]*after[1] + after[2]*after[2]);
+        if (!(la > 1.0e-6*lb)) return true;
+        double d = before[0]*after[0] + before[1]*after[1] + before[2]*after[2];
+        if (d < 0.2*la*lb) return true;
+    }
+    return false;
+}
+
+bool tryCollapse(Cluster &cl, int a, int b) {
+    double p[3];
+    double cost = collapseCost(cl, a, b, p);
+    if (cost < 0.0) return false;
+
+    // Link condition: the only shared neighbours are the far corners of
+    // the triangles on the edge, otherwise the collapse pinches
+    ++cl.stamp;
+    gatherRing(cl, a, cl.ringA, cl.markA);
+    gatherRing(cl, b, cl.ringB, cl.markB);
+    size_t common = 0;
+    for (size_t i=0; i<cl.ringB.size(); ++i) {
+        if (cl.markA[cl.ringB[i]] == cl.stamp) ++common;
+    }
+    size_t shared = 0;
+    for (size_t i=0; i<cl.adj[a].size(); ++i) {
+        int t = cl.adj[a][i];
+        if (cl.dead[t]) continue;
+        const int *tv = &cl.tris[3*t];
+        if (tv[0] == b || tv[1] == b || tv[2] == b) ++shared;
+    }
+    if (shared == 0 || common != shared) return false;
+    if (wouldFlip(cl, a, b, p) || wouldFlip(cl, b, a, p)) return false;
+
+    const int keep = cl.locked[b] ? b : a;
+    const int gone = (keep == a) ? b : a;
+    for (size_t k=0; k<3; ++k) {
+        cl.pos[3*keep+k] = p[k];
+    }
+    for (size_t k=0; k<10; ++k) {
+        cl.quad[10*keep+k] += cl.quad[10*gone+k];
+    }
+    double n[3] = { cl.nrm[3*keep] + cl.nrm[3*gone], cl.nrm[3*keep+1] + cl.nrm[3*gone+1],
+                    cl.nrm[3*keep+2] + cl.nrm[3*gone+2] };
+    double len = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if (len > 0.0) {
+        for (size_t k=0; k<3; ++k) {
+            cl.nrm[3*keep+k] = n[k]/len;
+        }
+    }
+    cl.removed[gone] = 1;
+
+    std::vector<int> &adjKeep = cl.adj[keep];
+    const std::vector<int> &adjGone = cl.adj[gone];
+    for (size_t i=0; i<adjGone.size(); ++i) {
+        int t = adjGone[i];
+        if (cl.dead[t]) continue;
+        int *tv = &cl.tris[3*t];
+        if (tv[0] == keep || tv[1] == keep || tv[2] == keep) {
+            cl.dead[t] = 1;
+            --cl.live;
+            continue;
+        }
+        for (size_t k=0; k<3; ++k) {
+            if (tv[k] == gone) tv[k] = keep;
+        }
+        adjKeep.push_back(t);
+    }
+    // Drop dead triangles so the lists don't grow without bound
+    size_t out = 0;
+    for (size_t i=0; i<adjKeep.size(); ++i) {
+        if (!cl.dead[adjKeep[i]]) adjKeep[out++] = adjKeep[i];
+    }
+    adjKeep.resize(out);
+    cl.adj[gone].clear();
+    return true;
+}
+
+/*!
+  Simplifies the triangles listed in triList, which all have their
+  vertices in the same cluster, down to target triangles.  Returns the
+  number removed.
+*/
+size_t simplifyCluster(Mesh &mesh, const uint32_t *triList, size_t numTris, size_t target,
+                       std::vector<int> &localId, std::vector<char> &triDead, Cluster &cl) {
+    cl.globalVert.clear();
+    cl.tris.resize(3*numTris);
+    for (size_t i=0; i<numTris; ++i) {
+        for (size_t k=0; k<3; ++k) {
+            unsigned int g = mesh.indices[3*size_t(triList[i]) + k];
+            if (localId[g] < 0) {
+                localId[g] = int(cl.globalVert.size());
+                cl.globalVert.push_back(g);
+            }
+            cl.tris[3*i+k] = localId[g];
+        }
+    }
+    const size_t nv = cl.globalVert.size();
+    cl.pos.resize(3*nv);
+    cl.nrm.resize(3*nv);
+    cl.quad.assign(10*nv, 0.0);
+    cl.locked.assign(nv, 0);
+    cl.removed.assign(nv, 0);
+    cl.touched.assign(nv, 0);
+    cl.markA.assign(nv, 0);
+    cl.markB.assign(nv, 0);
+    cl.stamp = 0;
+    cl.dead.assign(numTris, 0);
+    cl.live = numTris;
+    if (cl.adj.size() < nv) cl.adj.resize(nv);
+    for (size_t v=0; v<nv; ++v) {
+        cl.adj[v].clear();
+        for (size_t k=0; k<3; ++k) {
+            cl.pos[3*v+k] = mesh.verts[3*size_t(cl.globalVert[v]) + k];
+            cl.nrm[3*v+k] = mesh.norms[3*size_t(cl.globalVert[v]) + k];
+        }
+    }
+
+    cl.edges.resize(3*numTris);
+    for (size_t t=0; t<numTris; ++t) {
+        const int *tv = &cl.tris[3*t];
+        double n[3];
+        triNormal(&cl.pos[3*tv[0]], &cl.pos[3*tv[1]], &cl.pos[3*tv[2]], n);
+        double len = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (len > 0.0) {
+            n[0] /= len;
+            n[1] /= len;
+            n[2] /= len;
+            double d = -(n[0]*cl.pos[3*tv[0]] + n[1]*cl.pos[3*tv[0]+1] + n[2]*cl.pos[3*tv[0]+2]);
+            for (size_t k=0; k<3; ++k) {
+                addPlane(&cl.quad[10*tv[k]], n[0], n[1], n[2], d);
+            }
+        }
+        for (size_t k=0; k<3; ++k) {
+            cl.adj[tv[k]].push_back(int(t));
+            uint64_t a = uint64_t(tv[k]), b = uint64_t(tv[(k+1)%3]);
+            cl.edges[3*t+k] = (std::min(a, b) << 32) | std::max(a, b);
+        }
+    }
+
+    // Edges on only one triangle in the cluster are open boundaries,
+    // patch seams or cluster borders, and edges on more than two are
+    // non-manifold.  Their vertices stay put.
+    std::sort(cl.edges.begin(), cl.edges.end());
+    for (size_t i=0; i<cl.edges.size(); ) {
+        size_t j = i + 1;
+        while (j < cl.edges.size() && cl.edges[j] == cl.edges[i]) ++j;
+        if (j - i != 2) {
+            cl.locked[cl.edges[i] >> 32] = 1;
+            cl.locked[cl.edges[i] & 0xffffffffu] = 1;
+        }
+        i = j;
+    }
+
+    // Collapse in rounds.  Each round sorts the candidate edges once and
+    // takes them cheapest first, skipping any that touch a vertex already
+    // moved this round, since its quadric and cost are out of date.  This
+    // is nearly as good as a priority queue and much cheaper to run.
+    while (cl.live > target) {
+        cl.queue.clear();
+        for (size_t t=0; t<numTris; ++t) {
+            if (cl.dead[t]) continue;
+            const int *tv = &cl.tris[3*t];
+            for (size_t k=0; k<3; ++k) {
+                int a = tv[k], b = tv[(k+1)%3];
+                if (a < b) queueEdge(cl, a, b);
+            }
+        }
+        if (cl.queue.empty()) break;
+        std::sort(cl.queue.begin(), cl.queue.end());
+
+        size_t before = cl.live;
+        std::fill(cl.touched.begin(), cl.touched.end(), 0);
+        for (size_t i=0; i<cl.queue.size() && cl.live > target; ++i) {
+            const Collapse &c = cl.queue[i];
+            if (cl.touched[c.a] || cl.touched[c.b]) continue;
+            if (tryCollapse(cl, c.a, c.b)) {
+                cl.touched[c.a] = 1;
+                cl.touched[c.b] = 1;
+            }
+        }
+        if (cl.live == before) break;
+    }
+
+    // Write back.  Vertices here belong to no other cluster, so there
+    // are no races.
+    for (size_t v=0; v<nv; ++v) {
+        size_t g = cl.globalVert[v];
+        localId[g] = -1;
+        if (cl.removed[v]) continue;
+        for (size_t k=0; k<3; ++k) {
+            mesh.verts[3*g+k] = float(cl.pos[3*v+k]);
+            mesh.norms[3*g+k] = float(cl.nrm[3*v+k]);
+        }
+    }
+    for (size_t t=0; t<numTris; ++t) {
+        size_t g = triList[t];
+        if (cl.dead[t]) {
+            triDead[g] = 1;
+            continue;
+        }
+        for (size_t k=0; k<3; ++k) {
+            mesh.indices[3*g+k] = cl.globalVert[cl.tris[3*t+k]];
+        }
+    }
+    return numTris - cl.live;
+}
+
+}
+
+MeshSimplifier::MeshSimplifier() : budget(0), maxErr(0.0), featureAngle(60.0) {
+}
+
+size_t MeshSimplifier::simplify(Mesh &mesh) const {
+    const size_t startTris = mesh.numTris();
+    if (startTris == 0 || (budget == 0 && !(maxErr > 0.0))) return 0;
+    if (budget && startTris <= budget) return 0;
+
+    const double maxCost = (maxErr > 0.0) ? maxErr*maxErr : HUGE_VAL;
+    const double cosFeature = std::cos(featureAngle*M_PI/180.0);
+    const size_t nv = mesh.numVerts();
+
+    std::vector<int> localId(nv, -1);
+    std::vector<uint32_t> vertCell(nv);
+    std::vector<uint32_t> triCell, order, cellStart;
+    std::vector<char> triDead;
+    std::vector<size_t> busyCells;
+
+    for (size_t pass=0; pass<SIMPLIFY_MAX_PASSES; ++pass) {
+        const size_t live = mesh.numTris();
+        if (budget && live <= budget) break;
+
+        // Size cells so each holds about SIMPLIFY_CLUSTER_TRIS triangles
+        float lo[3], hi[3];
+        mesh.bounds(lo, hi);
+        double area = 0.0;
+        for (size_t t=0; t<live; ++t) {
+            double p[3][3];
+            for (size_t k=0; k<3; ++k) {
+                for (size_t j=0; j<3; ++j) {
+                    p[k][j] = mesh.verts[3*size_t(mesh.indices[3*t+k]) + j];
+                }
+            }
+            double n[3];
+            triNormal(p[0], p[1], p[2], n);
+            area += 0.5*std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        }
+        double clusters = std::max(1.0, double(live)/SIMPLIFY_CLUSTER_TRIS);
+        double extent = std::max(std::max(hi[0] - lo[0], hi[1] - lo[1]), hi[2] - lo[2]);
+        double cell = std::sqrt(area/clusters);
+        if (!(cell > 0.0)) cell = (extent > 0.0) ? extent : 1.0;
+        size_t dims[3];
+        for (;;) {
+            for (size_t k=0; k<3; ++k) {
+                dims[k] = size_t((hi[k] - lo[k])/cell) + 2;
+            }
+            if (dims[0]*dims[1]*dims[2] <= MAX_GRID_CELLS) break;
+            cell *= 1.25;
+        }
+        const double shift = (1.0 - passShift[pass])*cell;
+
+        parallelFor(0, nv, 1 << 16, [&](size_t a, size_t b) {
+            for (size_t v=a; v<b; ++v) {
+                size_t c[3];
+                for (size_t k=0; k<3; ++k) {
+                    double f = (mesh.verts[3*v+k] - lo[k] + shift)/cell;
+                    c[k] = (f > 0.0) ? std::min(size_t(f), dims[k] - 1) : 0;
+                }
+                vertCell[v] = uint32_t(c[0] + dims[0]*(c[1] + dims[1]*c[2]));
+            }
+        });
+
+        // Counting sort of the triangles inside a single cell
+        const size_t numCells = dims[0]*dims[1]*dims[2];
+        triCell.resize(live);
+        cellStart.assign(numCells + 1, 0);
+        size_t inside = 0;
+        for (size_t t=0; t<live; ++t) {
+            uint32_t c = vertCell[mesh.indices[3*t]];
+            if (vertCell[mesh.indices[3*t+1]] != c || vertCell[mesh.indices[3*t+2]] != c) {
+                c = NO_CELL;
+            } else {
+                ++cellStart[c + 1];
+                ++inside;
+            }
+            triCell[t] = c;
+        }
+        busyCells.clear();
+        for (size_t c=0; c<numCells; ++c) {
+            if (cellStart[c + 1]) busyCells.push_back(c);
+            cellStart[c + 1] += cellStart[c];
+        }
+        order.resize(inside);
+        {
+            std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+            for (size_t t=0; t<live; ++t) {
+                if (triCell[t] != NO_CELL) order[fill[triCell[t]]++] = uint32_t(t);
+            }
+        }
+
+        // Share the removal out over the triangles that can be touched
+        double keepFraction = 0.0;
+        if (budget) {
+            double remove = double(live - budget);
+            keepFraction = std::max(0.0, 1.0 - remove/std::max(double(inside), 1.0));
+        }
+
+        triDead.assign(live, 0);
+        std::atomic<size_t> removed(0);
+        parallelFor(0, busyCells.size(), CLUSTER_GRAIN, [&](size_t a, size_t b) {
+            Cluster cl;
+            cl.maxCost = maxCost;
+            cl.cosFeature = cosFeature;
+            size_t count = 0;
+            for (size_t i=a; i<b; ++i) {
+                size_t c = busyCells[i];
+                size_t n = cellStart[c + 1] - cellStart[c];
+                size_t target = size_t(std::ceil(keepFraction*n));
+                count += simplifyCluster(mesh, &order[cellStart[c]], n, target,
+                                         localId, triDead, cl);
+            }
+            removed += count;
+        });
+
+        size_t out = 0;
+        for (size_t t=0; t<live; ++t) {
+            if (triDead[t]) continue;
+            for (size_t k=0; k<3; ++k) {
+                mesh.indices[3*out+k] = mesh.indices[3*t+k];
+            }
+            ++out;
+        }
+        mesh.indices.resize(3*out);
+
+        // Stop once another pass isn't going to help much
+        if (removed < live/100) break;
+    }
+
+    // Drop vertices nothing refers to any more.  Survivors keep their
+    // curvature, which is close enough for display.
+    const bool curvature = mesh.curvature.size() == nv*NUM_CURVATURES;
+    std::vector<unsigned int> remap(nv, 0);
+    for (size_t i=0; i<mesh.indices.size(); ++i) {
+        remap[mesh.indices[i]] = 1;
+    }
+    size_t used = 0;
+    for (size_t v=0; v<nv; ++v) {
+        if (!remap[v]) continue;
+        remap[v] = unsigned(used);
+        for (size_t k=0; k<3; ++k) {
+            mesh.verts[3*used+k] = mesh.verts[3*v+k];
+            mesh.norms[3*used+k] = mesh.norms[3*v+k];
+        }
+        if (curvature) {
+            for (size_t k=0; k<NUM_CURVATURES; ++k) {
+                mesh.curvature[NUM_CURVATURES*used+k] = mesh.curvature[NUM_CURVATURES*v+k];
+            }
+        }
+        ++used;
+    }
+    mesh.verts.resize(3*used);
+    mesh.norms.resize(3*used);
+    if (curvature) {
+        mesh.curvature.resize(NUM_CURVATURES*used);
+    } else {
+        mesh.curvature.clear();
+    }
+    for (size_t i=0; i<mesh.indices.size(); ++i) {
+        mesh.indices[i] = remap[mesh.indices[i]];
+    }
+    return startTris - mesh.numTris();
+}
@@ -0,0 +1,76 @@
+/*
+  meshsimplifier.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <cstddef>
+
+#include "mesh.h"
+
+// Rounds of clustering; each shifts the cluster grid so edges locked
+// on one round's cluster borders can collapse on the next
+static const size_t SIMPLIFY_MAX_PASSES=6;
+
+// Rough number of triangles handled by one cluster
+static const size_t SIMPLIFY_CLUSTER_TRIS=16384;
+
+/*!
+  Quadric error edge collapse simplification of an indexed Mesh.
+
+  The mesh is cut into clusters by a uniform grid and the clusters are
+  simplified in parallel, cheapest edges first.  Triangles
+  crossing a cluster border are left alone and the vertices around
+  them are locked, which keeps the clusters independent.  The same
+  locking rule holds open boundaries and the seams between patches in
+  place, since those edges also have only one triangle in the cluster.
+
+  Collapses that would flip a triangle, pinch the surface, or join
+  vertices whose normals differ by more than the feature angle are
+  refused.  Normals of merged vertices are blended, not recomputed, so
+  analytic normals survive.
+*/
+class MeshSimplifier {
+public:
+    MeshSimplifier();
+
+    // Stop at this many triangles; 0 for no budget
+    void setTriangleBudget(size_t tris) { budget = tris; }
+    size_t triangleBudget() const { return budget; }
+
+    // Refuse collapses with more quadric error than this distance; 0 for no bound
+    void setMaxError(double err) { maxErr = err; }
+    double maxError() const { return maxErr; }
+
+    void setFeatureAngle(double degrees) { featureAngle = degrees; }
+    double getFeatureAngle() const { return featureAngle; }
+
+    /*!
+      Simplifies mesh in place until the budget is met, no collapse is
+      within the error bound, or nothing more can be removed.  Returns
+      the number of triangles removed.
+    */
+    size_t simplify(Mesh &mesh) const;
+
+private:
+    size_t budget;
+    double maxErr;
+    double featureAngle;
+};
+
+#endif
@@ -0,0 +1,71 @@
+/*
+  parallel.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+/*!
+  Number of worker threads used by parallelFor.
+*/
+inline size_t parallelThreadCount() {
+    size_t n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+/*!
+  Calls func(lo, hi) over [begin, end) split into chunks of grain items.
+  Chunks are handed out dynamically so uneven work balances itself.
+  The calling thread participates, so this is cheap when there is
+  only a single chunk.
+*/
+template <class Func>
+void parallelFor(size_t begin, size_t end, size_t grain, Func func) {
+    if (end <= begin) return;
+    if (grain == 0) grain = 1;
+
+    size_t numChunks = (end - begin + grain - 1) / grain;
+    size_t numThreads = parallelThreadCount();
+    if (numThreads > numChunks) numThreads = numChunks;
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (;;) {
+            size_t chunk = next.fetch_add(1);
+            if (chunk >= numChunks) break;
+            size_t lo = begin + chunk*grain;
+            size_t hi = lo + grain < end ? lo + grain : end;
+            func(lo, hi);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i=1; i<numThreads; ++i) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t i=0; i<threads.size(); ++i) {
+        threads[i].join();
+    }
+}
+
+#endif
@@ -0,0 +1,359 @@
+/*
+  parametricsurface.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "parametricsurface.h"
+#include "parallel.h"
+
+/*!
+  Starts out as a torus so there is something to look at.
+*/
+ParametricSurface::ParametricSurface() : umin(0.0), umax(2.0*M_PI),
+                                         vmin(0.0), vmax(2.0*M_PI),
+                                         usteps(64), vsteps(32), tval(0.0), animated(false) {
+    setExpressions("(4 + cos(v))*cos(u)", "(4 + cos(v))*sin(u)", "sin(v)");
+}
+
+/*!
+  Parses and compiles the three coordinate expressions along with their
+  u and v partials.  Second partials go in a separate program so plain
+  evaluation doesn't pay for them.  t is an input to both, and is only
+  differentiated by to see whether the surface moves.
+*/
+void ParametricSurface::setExpressions(const std::string &x, const std::string &y,
+                                       const std::string &z) {
+    std::vector<std::string> vars;
+    vars.push_back("u");
+    vars.push_back("v");
+    vars.push_back("t");
+    ExprGraph graph(vars);
+
+    int coords[3];
+    coords[0] = graph.parse(x);
+    coords[1] = graph.parse(y);
+    coords[2] = graph.parse(z);
+
+    std::vector<int> roots(PS_NUM_OUTPUTS);
+    for (size_t i=0; i<3; ++i) {
+        roots[PS_X + i] = coords[i];
+        roots[PS_DU + i] = graph.diff(coords[i], 0);
+        roots[PS_DV + i] = graph.diff(coords[i], 1);
+    }
+
+    ExprProgram prog;
+    prog.compile(graph, roots);
+
+    roots.resize(PS_NUM_SECOND_OUTPUTS);
+    for (size_t i=0; i<3; ++i) {
+        roots[PS_DUU + i] = graph.diff(roots[PS_DU + i], 0);
+        roots[PS_DUV + i] = graph.diff(roots[PS_DU + i], 1);
+        roots[PS_DVV + i] = graph.diff(roots[PS_DV + i], 1);
+    }
+    ExprProgram second;
+    second.compile(graph, roots);
+
+    bool moves = false;
+    for (size_t i=0; i<3; ++i) {
+        double d = 0.0;
+        if (!graph.isConstant(graph.diff(coords[i], 2), &d) || d != 0.0) moves = true;
+    }
+
+    // Nothing above threw, so commit
+    program = prog;
+    secondProgram = second;
+    animated = moves;
+    isolines.clear();
+    xExpr = x;
+    yExpr = y;
+    zExpr = z;
+}
+
+void ParametricSurface::setDomain(double u0, double u1, double v0, double v1) {
+    isolines.clear();
+    umin = u0;
+    umax = u1;
+    vmin = v0;
+    vmax = v1;
+}
+
+void ParametricSurface::setResolution(size_t us, size_t vs) {
+    usteps = us ? us : 1;
+    vsteps = vs ? vs : 1;
+}
+
+void ParametricSurface::setTime(double t) {
+    if (t == tval) return;
+    tval = t;
+    if (animated) isolines.clear();
+}
+
+void ParametricSurface::evaluate(const double *u, const double *v, size_t n,
+                                 double *const *out) const {
+    std::vector<double> t(n, tval);
+    const double *in[3] = { u, v, n ? &t[0] : 0 };
+    program.eval(in, out, n);
+}
+
+void ParametricSurface::evaluateSecond(const double *u, const double *v, size_t n,
+                                       double *const *out) const {
+    std::vector<double> t(n, tval);
+    const double *in[3] = { u, v, n ? &t[0] : 0 };
+    secondProgram.eval(in, out, n);
+}
+
+void ParametricSurface::tessellate(Mesh &mesh, bool curvature, CurvatureHistogram *histograms) const {
+    const size_t nu = usteps + 1;
+
+    mesh.verts.resize(numVerts()*3);
+    mesh.norms.resize(numVerts()*3);
+    mesh.indices.resize(usteps*vsteps*6);
+    if (curvature) {
+        mesh.curvature.resize(numVerts()*NUM_CURVATURES);
+    } else {
+        mesh.curvature.clear();
+    }
+
+    tessellateVertices(&mesh.verts[0], &mesh.norms[0], curvature ? &mesh.curvature[0] : 0, histograms);
+
+    parallelFor(0, vsteps, 64, [&](size_t lo, size_t hi) {
+        for (size_t j=lo; j<hi; ++j) {
+            unsigned int *ip = &mesh.indices[6*j*usteps];
+            for (size_t i=0; i<usteps; ++i) {
+                unsigned int a = j*nu + i;
+                unsigned int c = a + nu;
+                ip[6*i+0] = a;
+                ip[6*i+1] = a + 1;
+                ip[6*i+2] = c;
+                ip[6*i+3] = a + 1;
+                ip[6*i+4] = c + 1;
+                ip[6*i+5] = c;
+            }
+        }
+    });
+}
+
+/*!
+  Evaluates the surface over a regular grid, a block of rows of
+  constant v per work item.  Each block goes through evalGrid, so
+  anything that depends on only one of u and v is worked out once per
+  column or row of the block rather than at every vertex.  Curvature
+  comes out of the same pass, using the second derivative program, and
+  each block bins its own curvatures before merging them into the
+  totals.
+*/
+void ParametricSurface::tessellateVertices(float *verts, float *norms, float *curv,
+                                           CurvatureHistogram *histograms) const {
+    const size_t nu = usteps + 1;
+    const size_t nv = vsteps + 1;
+    const double du = (umax - umin) / usteps;
+    const double dv = (vmax - vmin) / vsteps;
+    const ExprProgram &prog = curv ? secondProgram : program;
+    const size_t numOutputs = curv ? PS_NUM_SECOND_OUTPUTS : PS_NUM_OUTPUTS;
+
+    std::vector<double> us(nu), vs(nv);
+    for (size_t i=0; i<nu; ++i) {
+        us[i] = umin + du*i;
+    }
+    for (size_t j=0; j<nv; ++j) {
+        vs[j] = vmin + dv*j;
+    }
+    if (histograms) {
+        for (size_t c=0; c<NUM_CURVATURES; ++c) {
+            histograms[c].clear();
+        }
+    }
+
+    std::atomic<bool> degenerate(false);
+    std::mutex histogramLock;
+
+    parallelFor(0, nv, TESSELLATE_ROWS, [&](size_t lo, size_t hi) {
+        const size_t n = nu*(hi - lo);
+        std::vector<double> buf(n*numOutputs);
+        double *out[PS_NUM_SECOND_OUTPUTS];
+        for (size_t k=0; k<numOutputs; ++k) {
+            out[k] = &buf[k*n];
+        }
+        prog.evalGrid(&us[0], nu, &vs[lo], hi - lo, &tval, out);
+
+        float *vp = &verts[3*lo*nu];
+        float *np = &norms[3*lo*nu];
+        for (size_t i=0; i<n; ++i) {
+            double pu[3] = { out[PS_DU][i], out[PS_DU+1][i], out[PS_DU+2][i] };
+            double pv[3] = { out[PS_DV][i], out[PS_DV+1][i], out[PS_DV+2][i] };
+            double nrm[3] = { pu[1]*pv[2] - pu[2]*pv[1],
+                              pu[2]*pv[0] - pu[0]*pv[2],
+                              pu[0]*pv[1] - pu[1]*pv[0] };
+            double len = std::sqrt(nrm[0]*nrm[0] + nrm[1]*nrm[1] + nrm[2]*nrm[2]);
+            if (!(len > 1.0e-12)) {
+                // Poles and other singular points get fixed up below
+                degenerate = true;
+                nrm[0] = nrm[1] = nrm[2] = len = 0.0;
+            } else {
+                len = 1.0/len;
+            }
+            for (size_t k=0; k<3; ++k) {
+                vp[3*i+k] = float(out[PS_X+k][i]);
+                np[3*i+k] = float(nrm[k]*len);
+            }
+        }
+        if (!curv) return;
+
+        float *cp = &curv[NUM_CURVATURES*lo*nu];
+        surfaceCurvatures(out + PS_DU, n, cp);
+        if (!histograms) return;
+
+        // Singular points are binned once they've been fixed up
+        CurvatureHistogram local[NUM_CURVATURES];
+        for (size_t i=0; i<n; ++i) {
+            if (np[3*i] == 0.0f && np[3*i+1] == 0.0f && np[3*i+2] == 0.0f) continue;
+            for (size_t k=0; k<NUM_CURVATURES; ++k) {
+                local[k].add(cp[NUM_CURVATURES*i + k]);
+            }
+        }
+        std::lock_guard<std::mutex> guard(histogramLock);
+        for (size_t k=0; k<NUM_CURVATURES; ++k) {
+            histograms[k].merge(local[k]);
+        }
+    });
+
+    if (!degenerate) return;
+
+    // Where the partials vanish (poles, cone tips), use the normal and
+    // curvature of a point nudged slightly toward the middle of the
+    // domain instead
+    std::vector<size_t> bad;
+    us.clear();
+    vs.clear();
+    const double uc = 0.5*(umin + umax);
+    const double vc = 0.5*(vmin + vmax);
+    for (size_t i=0; i<3*nu*nv; i+=3) {
+        if (norms[i] != 0.0f || norms[i+1] != 0.0f || norms[i+2] != 0.0f) {
+            continue;
+        }
+        size_t idx = i/3;
+        double u = umin + du*(idx % nu);
+        double v = vmin + dv*(idx / nu);
+        bad.push_back(i);
+        us.push_back(u + 1.0e-3*(uc - u)/(0.5*nu));
+        vs.push_back(v + 1.0e-3*(vc - v)/(0.5*nv));
+    }
+
+    if (bad.empty()) return;
+
+    std::vector<double> buf(bad.size()*numOutputs);
+    double *out[PS_NUM_SECOND_OUTPUTS];
+    for (size_t k=0; k<numOutputs; ++k) {
+        out[k] = &buf[k*bad.size()];
+    }
+    if (curv) {
+        evaluateSecond(&us[0], &vs[0], bad.size(), out);
+    } else {
+        evaluate(&us[0], &vs[0], bad.size(), out);
+    }
+
+    for (size_t b=0; b<bad.size(); ++b) {
+        double pu[3] = { out[PS_DU][b], out[PS_DU+1][b], out[PS_DU+2][b] };
+        double pv[3] = { out[PS_DV][b], out[PS_DV+1][b], out[PS_DV+2][b] };
+        double n[3] = { pu[1]*pv[2] - pu[2]*pv[1],
+                        pu[2]*pv[0] - pu[0]*pv[2],
+                        pu[0]*pv[1] - pu[1]*pv[0] };
+        double len = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (len > 0.0) {
+            for (size_t k=0; k<3; ++k) {
+                norms[bad[b]+k] = float(n[k]/len);
+            }
+        }
+    }
+
+    if (!curv) return;
+    std::vector<float> fixed(bad.size()*NUM_CURVATURES);
+    surfaceCurvatures(out + PS_DU, bad.size(), &fixed[0]);
+    for (size_t b=0; b<bad.size(); ++b) {
+        float *c = &curv[NUM_CURVATURES*(bad[b]/3)];
+        for (size_t k=0; k<NUM_CURVATURES; ++k) {
+            c[k] = fixed[NUM_CURVATURES*b + k];
+            if (histograms) histograms[k].add(c[k]);
+        }
+    }
+}
+
+const ArcLengthTable &ParametricSurface::isolineArcLength(size_t dir, double value) const {
+    std::pair<size_t, double> key(dir, value);
+    std::map<std::pair<size_t, double>, ArcLengthTable>::iterator it = isolines.find(key);
+    if (it != isolines.end()) {
+        return it->second;
+    }
+    if (isolines.size() >= MAX_CACHED_ISOLINES) {
+        isolines.clear();
+    }
+
+    std::vector<double> fixed, out;
+    SpeedFunction speed = [&](const double *t, double *s, size_t n) {
+        fixed.assign(n, value);
+        out.resize(PS_NUM_OUTPUTS*n);
+        double *outs[PS_NUM_OUTPUTS];
+        for (size_t k=0; k<PS_NUM_OUTPUTS; ++k) {
+            outs[k] = &out[k*n];
+        }
+        if (dir == ISOLINE_U) {
+            evaluate(t, &fixed[0], n, outs);
+        } else {
+            evaluate(&fixed[0], t, n, outs);
+        }
+        const size_t d = (dir == ISOLINE_U) ? PS_DU : PS_DV;
+        for (size_t i=0; i<n; ++i) {
+            double dx = outs[d][i], dy = outs[d+1][i], dz = outs[d+2][i];
+            s[i] = std::sqrt(dx*dx + dy*dy + dz*dz);
+        }
+    };
+
+    ArcLengthTable &table = isolines[key];
+    if (dir == ISOLINE_U) {
+        table.build(speed, umin, umax, 1.0e-10, 16);
+    } else {
+        table.build(speed, vmin, vmax, 1.0e-10, 16);
+    }
+    return table;
+}
+
+void ParametricSurface::isolinePoints(size_t dir, double value, size_t count,
+                                      std::vector<float> &pts) const {
+    pts.clear();
+    if (count == 0) return;
+    std::vector<double> t(count), fixed(count, value), out(PS_NUM_OUTPUTS*count);
+    isolineArcLength(dir, value).uniformParams(count, &t[0]);
+
+    double *outs[PS_NUM_OUTPUTS];
+    for (size_t k=0; k<PS_NUM_OUTPUTS; ++k) {
+        outs[k] = &out[k*count];
+    }
+    if (dir == ISOLINE_U) {
+        evaluate(&t[0], &fixed[0], count, outs);
+    } else {
+        evaluate(&fixed[0], &t[0], count, outs);
+    }
+    pts.resize(3*count);
+    for (size_t i=0; i<count; ++i) {
+        pts[3*i] = float(outs[PS_X][i]);
+        pts[3*i+1] = float(outs[PS_X+1][i]);
+        pts[3*i+2] = float(outs[PS_X+2][i]);
+    }
+}
@@ -0,0 +1,146 @@
+/*
+  parametricsurface.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef PARAMETRICSURFACE_H
+#define PARAMETRICSURFACE_H
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "arclength.h"
+#include "curvature.h"
+#include "expression.h"
+#include "mesh.h"
+
+// Outputs of the compiled surface program
+static const size_t PS_X=0;
+static const size_t PS_DU=3;
+static const size_t PS_DV=6;
+static const size_t PS_NUM_OUTPUTS=9;
+
+// Extra outputs of the second derivative program, after the first nine
+static const size_t PS_DUU=9;
+static const size_t PS_DUV=12;
+static const size_t PS_DVV=15;
+static const size_t PS_NUM_SECOND_OUTPUTS=18;
+
+// Grid rows evaluated together by tessellate
+static const size_t TESSELLATE_ROWS=16;
+
+// Isoline directions
+static const size_t ISOLINE_U=0;
+static const size_t ISOLINE_V=1;
+
+// Cached isoline tables kept before the cache is emptied
+static const size_t MAX_CACHED_ISOLINES=256;
+
+/*!
+  A surface given by user supplied expressions x(u,v), y(u,v), z(u,v).
+  The expressions are compiled together with their symbolic partial
+  derivatives, so normals are analytic rather than estimated from the
+  tessellation.
+
+  The expressions may also use the time t, which makes the surface
+  animated.  Everything is evaluated at the time set by setTime.
+*/
+class ParametricSurface {
+public:
+    ParametricSurface();
+
+    // Throws ExprError and leaves the surface unchanged on failure
+    void setExpressions(const std::string &x, const std::string &y, const std::string &z);
+    void setDomain(double umin, double umax, double vmin, double vmax);
+    void setResolution(size_t uSteps, size_t vSteps);
+    void setTime(double t);
+
+    const std::string &xExpression() const { return xExpr; }
+    const std::string &yExpression() const { return yExpr; }
+    const std::string &zExpression() const { return zExpr; }
+
+    double uMin() const { return umin; }
+    double uMax() const { return umax; }
+    double vMin() const { return vmin; }
+    double vMax() const { return vmax; }
+    size_t uSteps() const { return usteps; }
+    size_t vSteps() const { return vsteps; }
+    size_t numVerts() const { return (usteps + 1)*(vsteps + 1); }
+    double time() const { return tval; }
+
+    // True if the expressions depend on t
+    bool isAnimated() const { return animated; }
+
+    /*!
+      Evaluates position and first partials at n (u,v) pairs.  out must
+      hold PS_NUM_OUTPUTS pointers to n doubles each, in the order
+      x, y, z, xu, yu, zu, xv, yv, zv.
+    */
+    void evaluate(const double *u, const double *v, size_t n, double *const *out) const;
+
+    /*!
+      Like evaluate, but out holds PS_NUM_SECOND_OUTPUTS arrays and also
+      gets the second partials xuu, yuu, zuu, xuv, yuv, zuv, xvv, yvv, zvv.
+    */
+    void evaluateSecond(const double *u, const double *v, size_t n, double *const *out) const;
+
+    /*!
+      Fills mesh with a (uSteps+1) x (vSteps+1) grid of vertices.  With
+      curvature set it also fills mesh.curvature from the analytic second
+      partials, and histograms, if given, with NUM_CURVATURES histograms
+      of it built along the way.
+    */
+    void tessellate(Mesh &mesh, bool curvature = false, CurvatureHistogram *histograms = 0) const;
+
+    /*!
+      Just the vertex half of tessellate: numVerts() positions into
+      verts and normals into norms, three floats each, and curvatures
+      into curv if it isn't null.  The triangles are the same at every
+      time, so animation only needs this.
+    */
+    void tessellateVertices(float *verts, float *norms, float *curv = 0,
+                            CurvatureHistogram *histograms = 0) const;
+
+    /*!
+      Arc length table of an isoline: u running over the domain with
+      v = value for ISOLINE_U, or the other way round for ISOLINE_V.
+      Tables are cached until the expressions or domain change, so
+      this isn't safe to call from several threads at once.
+    */
+    const ArcLengthTable &isolineArcLength(size_t dir, double value) const;
+
+    // count points along an isoline spaced equally by arc length, xyz each
+    void isolinePoints(size_t dir, double value, size_t count, std::vector<float> &pts) const;
+
+private:
+    std::string xExpr;
+    std::string yExpr;
+    std::string zExpr;
+
+    double umin, umax, vmin, vmax;
+    size_t usteps, vsteps;
+    double tval;
+    bool animated;
+
+    ExprProgram program;
+    ExprProgram secondProgram;
+
+    mutable std::map<std::pair<size_t, double>, ArcLengthTable> isolines;
+};
+
+#endif
@@ -0,0 +1,187 @@
+/*
+  scene.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+#include "scene.h"
+
+namespace {
+
+const float identity[16] = { 1.0f, 0.0f, 0.0f, 0.0f,
+                             0.0f, 1.0f, 0.0f, 0.0f,
+                             0.0f, 0.0f, 1.0f, 0.0f,
+                             0.0f, 0.0f, 0.0f, 1.0f };
+
+}
+
+SceneMaterial makeMaterial(float r, float g, float b) {
+    SceneMaterial mat;
+    mat.diffuse[0] = r;
+    mat.diffuse[1] = g;
+    mat.diffuse[2] = b;
+    mat.diffuse[3] = 1.0f;
+    for (size_t i=0; i<3; ++i) {
+        mat.specular[i] = 1.0f;
+        mat.ambient[i] = 0.1f;
+    }
+    mat.specular[3] = 1.0f;
+    mat.ambient[3] = 1.0f;
+    mat.shininess = 100.0f;
+    return mat;
+}
+
+Scene::Scene() : matVersion(1), version(1), instancesValid(false) {
+}
+
+void Scene::clear() {
+    meshes.clear();
+    meshVersions.clear();
+    materials.clear();
+    if (++matVersion == 0) matVersion = 1;
+    objects.clear();
+    objectIndex.clear();
+    objectsChanged();
+}
+
+size_t Scene::addMesh(const Mesh &mesh) {
+    meshes.push_back(mesh);
+    meshVersions.push_back(1);
+    return meshes.size() - 1;
+}
+
+void Scene::swapMesh(size_t i, Mesh &mesh) {
+    meshes[i].verts.swap(mesh.verts);
+    meshes[i].norms.swap(mesh.norms);
+    meshes[i].indices.swap(mesh.indices);
+    meshes[i].curvature.swap(mesh.curvature);
+    mesh.clear();
+    if (++meshVersions[i] == 0) meshVersions[i] = 1;
+}
+
+size_t Scene::addMaterial(const SceneMaterial &mat) {
+    materials.push_back(mat);
+    if (++matVersion == 0) matVersion = 1;
+    return materials.size() - 1;
+}
+
+void Scene::setMaterial(size_t i, const SceneMaterial &mat) {
+    materials[i] = mat;
+    if (++matVersion == 0) matVersion = 1;
+}
+
+int Scene::addObject(size_t mesh, size_t material, const float *transform) {
+    SceneObject obj;
+    obj.id = int(objectIndex.size()) + 1;
+    obj.mesh = mesh;
+    obj.material = material;
+    std::memcpy(obj.transform, transform ? transform : identity, sizeof(obj.transform));
+    objectIndex.push_back(int(objects.size()));
+    objects.push_back(obj);
+    objectsChanged();
+    return obj.id;
+}
+
+/*!
+  Moves the last object into the hole, so removal is constant time but
+  doesn't keep the order objects were added in.
+*/
+void Scene::removeObject(int id) {
+    if (!findObject(id)) return;
+    int idx = objectIndex[id - 1];
+    objectIndex[id - 1] = -1;
+    if (size_t(idx) + 1 != objects.size()) {
+        objects[idx] = objects.back();
+        objectIndex[objects[idx].id - 1] = idx;
+    }
+    objects.pop_back();
+    objectsChanged();
+}
+
+void Scene::setTransform(int id, const float *transform) {
+    if (!findObject(id)) return;
+    std::memcpy(objects[objectIndex[id - 1]].transform, transform ? transform : identity,
+                sizeof(identity));
+    objectsChanged();
+}
+
+void Scene::setObjectMaterial(int id, size_t material) {
+    if (!findObject(id)) return;
+    objects[objectIndex[id - 1]].material = material;
+    objectsChanged();
+}
+
+const SceneObject *Scene::findObject(int id) const {
+    if (id < 1 || size_t(id) > objectIndex.size() || objectIndex[id - 1] < 0) return 0;
+    return &objects[objectIndex[id - 1]];
+}
+
+const std::vector<SceneBatch> &Scene::batches() const {
+    if (!instancesValid) sortInstances();
+    return sortedBatches;
+}
+
+const std::vector<float> &Scene::instanceTransforms() const {
+    if (!instancesValid) sortInstances();
+    return transforms;
+}
+
+const std::vector<int> &Scene::instanceIds() const {
+    if (!instancesValid) sortInstances();
+    return ids;
+}
+
+unsigned int Scene::instanceVersion() const {
+    if (!instancesValid) sortInstances();
+    return version;
+}
+
+/*!
+  Sorts objects by (material, mesh) and lays out their transforms in
+  that order, so each batch is a contiguous run that can be handed to
+  the GPU as one instanced draw.
+*/
+void Scene::sortInstances() const {
+    std::vector<std::pair<uint64_t, uint32_t> > keys(objects.size());
+    for (size_t i=0; i<objects.size(); ++i) {
+        keys[i].first = (uint64_t(objects[i].material) << 32) | uint64_t(objects[i].mesh);
+        keys[i].second = uint32_t(i);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    sortedBatches.clear();
+    transforms.resize(16*objects.size());
+    ids.resize(objects.size());
+    for (size_t i=0; i<keys.size(); ++i) {
+        const SceneObject &obj = objects[keys[i].second];
+        std::memcpy(&transforms[16*i], obj.transform, sizeof(obj.transform));
+        ids[i] = obj.id;
+        if (i == 0 || keys[i].first != keys[i-1].first) {
+            SceneBatch batch;
+            batch.material = obj.material;
+            batch.mesh = obj.mesh;
+            batch.first = i;
+            batch.count = 0;
+            sortedBatches.push_back(batch);
+        }
+        ++sortedBatches.back().count;
+    }
+    if (++version == 0) version = 1;
+    instancesValid = true;
+}
@@ -0,0 +1,137 @@
+/*
+  scene.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "mesh.h"
+
+/*!
+  Colours for the fixed function lighting model.
+*/
+struct SceneMaterial {
+    float diffuse[4];
+    float specular[4];
+    float ambient[4];
+    float shininess;
+};
+
+// A shiny material of colour (r, g, b)
+SceneMaterial makeMaterial(float r, float g, float b);
+
+/*!
+  One thing in the scene: a shared mesh drawn with a material and a
+  column major 4x4 transform, as glMultMatrixf takes it.  Transforms
+  should be rigid motions with uniform scale so normals stay normal.
+*/
+struct SceneObject {
+    int id;
+    size_t mesh;
+    size_t material;
+    float transform[16];
+};
+
+/*!
+  Objects sharing a material and mesh, drawn with one instanced call.
+  Their transforms and ids are at [first, first+count) of the scene's
+  instance arrays.
+*/
+struct SceneBatch {
+    size_t material;
+    size_t mesh;
+    size_t first;
+    size_t count;
+};
+
+/*!
+  A collection of meshes, materials and objects that use them.
+
+  Any number of objects may share a mesh.  For drawing, the objects are
+  sorted by material and then mesh into batches, so the number of
+  state changes and draw calls depends on the distinct (material, mesh)
+  pairs, not the number of objects.  The sort is redone lazily the first
+  time the batches are asked for after something changes.
+
+  Object ids start at 1, are never reused, and stay valid until the
+  object is removed, so they can be used as picking names.
+*/
+class Scene {
+public:
+    Scene();
+
+    void clear();
+
+    size_t addMesh(const Mesh &mesh);
+    // Replaces mesh i with the contents of mesh, which is left empty
+    void swapMesh(size_t i, Mesh &mesh);
+    const Mesh &mesh(size_t i) const { return meshes[i]; }
+    size_t numMeshes() const { return meshes.size(); }
+    // Changes every time mesh i does; never 0
+    unsigned int meshVersion(size_t i) const { return meshVersions[i]; }
+
+    size_t addMaterial(const SceneMaterial &mat);
+    void setMaterial(size_t i, const SceneMaterial &mat);
+    const SceneMaterial &material(size_t i) const { return materials[i]; }
+    size_t numMaterials() const { return materials.size(); }
+    // Changes every time a material is added or changed; never 0
+    unsigned int materialVersion() const { return matVersion; }
+
+    /*!
+      Adds an object and returns its id.  A null transform means the
+      identity.
+    */
+    int addObject(size_t mesh, size_t material, const float *transform = 0);
+    void removeObject(int id);
+    void setTransform(int id, const float *transform);
+    void setObjectMaterial(int id, size_t material);
+
+    // Returns 0 if there is no object with this id
+    const SceneObject *findObject(int id) const;
+    const SceneObject &object(size_t i) const { return objects[i]; }
+    size_t numObjects() const { return objects.size(); }
+
+    const std::vector<SceneBatch> &batches() const;
+    const std::vector<float> &instanceTransforms() const;
+    const std::vector<int> &instanceIds() const;
+    // Changes every time the instance arrays do
+    unsigned int instanceVersion() const;
+
+private:
+    void sortInstances() const;
+    void objectsChanged() { instancesValid = false; }
+
+    std::vector<Mesh> meshes;
+    std::vector<unsigned int> meshVersions;
+    std::vector<SceneMaterial> materials;
+    unsigned int matVersion;
+
+    std::vector<SceneObject> objects;
+    // Index into objects for each id, -1 once removed
+    std::vector<int> objectIndex;
+
+    mutable std::vector<SceneBatch> sortedBatches;
+    mutable std::vector<float> transforms;
+    mutable std::vector<int> ids;
+    mutable unsigned int version;
+    mutable bool instancesValid;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*
+  simplifydialog.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QtGui>
+
+#include "simplifydialog.h"
+
+/*!
+  Lays out the fields, filled in from simp
+*/
+SimplifyDialog::SimplifyDialog(const MeshSimplifier &simp, QWidget *parent) :
+    QDialog(parent), result(simp) {
+
+    setWindowTitle(tr("Triangle Budget"));
+
+    budgetBox = new QSpinBox(this);
+    budgetBox->setRange(0, 100000000);
+    budgetBox->setSingleStep(10000);
+    budgetBox->setSpecialValueText(tr("No limit"));
+    budgetBox->setValue(int(simp.triangleBudget()));
+
+    errorBox = new QDoubleSpinBox(this);
+    errorBox->setRange(0.0, 1.0e6);
+    errorBox->setDecimals(4);
+    errorBox->setSingleStep(0.01);
+    errorBox->setSpecialValueText(tr("No limit"));
+    errorBox->setValue(simp.maxError());
+
+    QGridLayout *grid = new QGridLayout;
+    grid->addWidget(new QLabel(tr("Most triangles to draw")), 0, 0);
+    grid->addWidget(budgetBox, 0, 1);
+    grid->addWidget(new QLabel(tr("Largest error, as a distance")), 1, 0);
+    grid->addWidget(errorBox, 1, 1);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok |
+                                                     QDialogButtonBox::Cancel);
+    connect(buttons, SIGNAL(accepted()), this, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), this, SLOT(reject()));
+
+    QVBoxLayout *layout = new QVBoxLayout;
+    layout->addLayout(grid);
+    layout->addWidget(buttons);
+    setLayout(layout);
+}
+
+void SimplifyDialog::accept() {
+    result.setTriangleBudget(size_t(budgetBox->value()));
+    result.setMaxError(errorBox->value());
+    QDialog::accept();
+}
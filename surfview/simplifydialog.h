@@ -0,0 +1,51 @@
+/*
+  simplifydialog.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SIMPLIFYDIALOG_H
+#define SIMPLIFYDIALOG_H
+
+#include <QDialog>
+
+#include "meshsimplifier.h"
+
+class QSpinBox;
+class QDoubleSpinBox;
+
+/*!
+  Dialog for the triangle budget and error bound meshes are simplified
+  to before drawing.
+*/
+class SimplifyDialog : public QDialog {
+    Q_OBJECT;
+
+public:
+    SimplifyDialog(const MeshSimplifier &simp, QWidget *parent = 0);
+
+    const MeshSimplifier &simplifier() const { return result; }
+
+public slots:
+    void accept();
+
+private:
+    QSpinBox *budgetBox;
+    QDoubleSpinBox *errorBox;
+
+    MeshSimplifier result;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*
+  subdivisiondialog.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QtGui>
+
+#include <stdexcept>
+
+#include "subdivisiondialog.h"
+
+/*!
+  Lays out the fields, filled in from surf
+*/
+SubdivisionDialog::SubdivisionDialog(const SubdivisionSurface &surf, QWidget *parent) :
+    QDialog(parent), result(surf) {
+
+    setWindowTitle(tr("Subdivision Surface"));
+
+    cageBox = new QComboBox(this);
+    cageBox->addItem(tr("Cube"), int(CAGE_CUBE));
+    cageBox->addItem(tr("Tetrahedron"), int(CAGE_TETRAHEDRON));
+    cageBox->addItem(tr("Octahedron"), int(CAGE_OCTAHEDRON));
+    cageBox->setCurrentIndex(cageBox->findData(int(surf.presetCage())));
+
+    schemeBox = new QComboBox(this);
+    schemeBox->addItem(tr("Catmull-Clark"), int(SUBDIV_CATMULL_CLARK));
+    schemeBox->addItem(tr("Loop"), int(SUBDIV_LOOP));
+    schemeBox->setCurrentIndex(schemeBox->findData(int(surf.scheme())));
+
+    levelBox = new QSpinBox(this);
+    levelBox->setRange(0, int(SUBDIV_MAX_LEVELS));
+    levelBox->setValue(int(surf.levels()));
+
+    QGridLayout *grid = new QGridLayout;
+    grid->addWidget(new QLabel(tr("Control cage")), 0, 0);
+    grid->addWidget(cageBox, 0, 1);
+    grid->addWidget(new QLabel(tr("Scheme")), 1, 0);
+    grid->addWidget(schemeBox, 1, 1);
+    grid->addWidget(new QLabel(tr("Levels")), 2, 0);
+    grid->addWidget(levelBox, 2, 1);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok |
+                                                     QDialogButtonBox::Cancel);
+    connect(buttons, SIGNAL(accepted()), this, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), this, SLOT(reject()));
+
+    QVBoxLayout *layout = new QVBoxLayout;
+    layout->addLayout(grid);
+    layout->addWidget(buttons);
+    setLayout(layout);
+}
+
+/*!
+  Builds the surface, staying open if the choices don't fit together
+*/
+void SubdivisionDialog::accept() {
+    SubdivisionSurface surf(result);
+    try {
+        // Levels first, so changing the cage or scheme only refines once
+        surf.setLevels(0);
+        surf.setPresetCage(size_t(cageBox->itemData(cageBox->currentIndex()).toInt()));
+        surf.setScheme(size_t(schemeBox->itemData(schemeBox->currentIndex()).toInt()));
+        surf.setLevels(size_t(levelBox->value()));
+    } catch (const std::runtime_error &err) {
+        QMessageBox::warning(this, tr("Invalid Subdivision"),
+                             QString::fromStdString(err.what()));
+        return;
+    }
+
+    result = surf;
+    QDialog::accept();
+}
@@ -0,0 +1,51 @@
+/*
+  subdivisiondialog.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SUBDIVISIONDIALOG_H
+#define SUBDIVISIONDIALOG_H
+
+#include <QDialog>
+
+#include "subdivisionsurface.h"
+
+class QComboBox;
+class QSpinBox;
+
+/*!
+  Dialog for picking a control cage, subdivision scheme and level.
+*/
+class SubdivisionDialog : public QDialog {
+    Q_OBJECT;
+
+public:
+    SubdivisionDialog(const SubdivisionSurface &surf, QWidget *parent = 0);
+
+    const SubdivisionSurface &surface() const { return result; }
+
+public slots:
+    void accept();
+
+private:
+    QComboBox *cageBox;
+    QComboBox *schemeBox;
+    QSpinBox *levelBox;
+
+    SubdivisionSurface result;
+};
+
+#endif
@@ -0,0 +1,534 @@
+/*
+  subdivisionsurface.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "subdivisionsurface.h"
+#include "parallel.h"
+
+namespace {
+
+typedef std::vector<std::pair<int, double> > Row;
+
+/*!
+  Fills a stencil table with numRows rows in parallel.  rowFunc(r, row)
+  appends (column, weight) terms for row r; repeated columns are
+  merged here.
+*/
+template <class RowFunc>
+void buildTable(size_t numRows, RowFunc rowFunc, StencilTable &table) {
+    const size_t grain = 1024;
+    size_t numChunks = (numRows + grain - 1)/grain;
+    std::vector<std::vector<int> > chunkCols(numChunks);
+    std::vector<std::vector<float> > chunkWeights(numChunks);
+    table.rowStart.assign(numRows + 1, 0);
+
+    parallelFor(0, numRows, grain, [&](size_t lo, size_t hi) {
+        std::vector<int> &cols = chunkCols[lo/grain];
+        std::vector<float> &weights = chunkWeights[lo/grain];
+        Row row;
+        for (size_t r=lo; r<hi; ++r) {
+            row.clear();
+            rowFunc(r, row);
+            std::sort(row.begin(), row.end());
+            size_t count = 0;
+            for (size_t i=0; i<row.size(); ) {
+                double w = 0.0;
+                size_t j = i;
+                for (; j<row.size() && row[j].first == row[i].first; ++j) {
+                    w += row[j].second;
+                }
+                cols.push_back(row[i].first);
+                weights.push_back(float(w));
+                ++count;
+                i = j;
+            }
+            table.rowStart[r+1] = int(count);
+        }
+    });
+
+    for (size_t r=0; r<numRows; ++r) {
+        table.rowStart[r+1] += table.rowStart[r];
+    }
+    table.cols.clear();
+    table.weights.clear();
+    table.cols.reserve(table.rowStart.back());
+    table.weights.reserve(table.rowStart.back());
+    for (size_t c=0; c<numChunks; ++c) {
+        table.cols.insert(table.cols.end(), chunkCols[c].begin(), chunkCols[c].end());
+        table.weights.insert(table.weights.end(), chunkWeights[c].begin(), chunkWeights[c].end());
+    }
+}
+
+/*!
+  Returns a*b, the table mapping b's columns straight to a's rows.
+*/
+StencilTable compose(const StencilTable &a, const StencilTable &b, size_t numCols) {
+    StencilTable result;
+    const size_t grain = 1024;
+    size_t numRows = a.numRows();
+    size_t numChunks = (numRows + grain - 1)/grain;
+    std::vector<std::vector<int> > chunkCols(numChunks);
+    std::vector<std::vector<float> > chunkWeights(numChunks);
+    result.rowStart.assign(numRows + 1, 0);
+
+    parallelFor(0, numRows, grain, [&](size_t lo, size_t hi) {
+        std::vector<int> &cols = chunkCols[lo/grain];
+        std::vector<float> &weights = chunkWeights[lo/grain];
+        // Dense accumulator plus the list of columns it touched
+        std::vector<double> acc(numCols, 0.0);
+        std::vector<int> touched;
+        for (size_t r=lo; r<hi; ++r) {
+            touched.clear();
+            for (int i=a.rowStart[r]; i<a.rowStart[r+1]; ++i) {
+                int mid = a.cols[i];
+                double w = a.weights[i];
+                for (int j=b.rowStart[mid]; j<b.rowStart[mid+1]; ++j) {
+                    int c = b.cols[j];
+                    if (acc[c] == 0.0) touched.push_back(c);
+                    acc[c] += w*b.weights[j];
+                }
+            }
+            std::sort(touched.begin(), touched.end());
+            size_t count = 0;
+            for (size_t t=0; t<touched.size(); ++t) {
+                if (acc[touched[t]] != 0.0) {
+                    cols.push_back(touched[t]);
+                    weights.push_back(float(acc[touched[t]]));
+                    ++count;
+                }
+                acc[touched[t]] = 0.0;
+            }
+            result.rowStart[r+1] = int(count);
+        }
+    });
+
+    for (size_t r=0; r<numRows; ++r) {
+        result.rowStart[r+1] += result.rowStart[r];
+    }
+    for (size_t c=0; c<numChunks; ++c) {
+        result.cols.insert(result.cols.end(), chunkCols[c].begin(), chunkCols[c].end());
+        result.weights.insert(result.weights.end(), chunkWeights[c].begin(), chunkWeights[c].end());
+    }
+    return result;
+}
+
+/*!
+  The two neighbours of v along the boundary, if v is on exactly one
+  boundary loop.  Returns the number of boundary edges touching v.
+*/
+int boundaryNeighbours(const HalfEdgeMesh &m, int v, int nbrs[2]) {
+    int count = 0;
+    for (int i=m.vertStart[v]; i<m.vertStart[v+1]; ++i) {
+        int h = m.vertHes[i];
+        if (m.isBoundary(h)) {
+            if (count < 2) nbrs[count] = m.heVert[m.next(h)];
+            ++count;
+        }
+        int p = m.prev(h);
+        if (m.isBoundary(p)) {
+            if (count < 2) nbrs[count] = m.heVert[p];
+            ++count;
+        }
+    }
+    return count;
+}
+
+/*!
+  Appends face f's centroid weights, scaled by s, to row.
+*/
+void addFace(const HalfEdgeMesh &m, int f, double s, Row &row) {
+    double w = s/m.faceSize(f);
+    for (int h=m.faceStart[f]; h<m.faceStart[f+1]; ++h) {
+        row.push_back(std::make_pair(m.heVert[h], w));
+    }
+}
+
+/*!
+  A representative half-edge for every undirected edge.
+*/
+std::vector<int> edgeHalfEdges(const HalfEdgeMesh &m) {
+    std::vector<int> rval(m.numEdges(), -1);
+    for (size_t h=0; h<m.numHalfEdges(); ++h) {
+        if (rval[m.heEdge[h]] < 0) rval[m.heEdge[h]] = int(h);
+    }
+    return rval;
+}
+
+/*!
+  One level of Catmull-Clark.  New points are ordered face points, then
+  edge points, then vertex points.
+*/
+void refineCatmullClark(const HalfEdgeMesh &m, StencilTable &table,
+                        std::vector<unsigned int> &sizes, std::vector<unsigned int> &faces) {
+    const int nf = int(m.numFaces());
+    const int ne = int(m.numEdges());
+    const int nv = int(m.numVerts());
+    std::vector<int> edgeHe = edgeHalfEdges(m);
+
+    buildTable(nf + ne + nv, [&](size_t r, Row &row) {
+        int i = int(r);
+        if (i < nf) {
+            addFace(m, i, 1.0, row);
+        } else if (i < nf + ne) {
+            int h = edgeHe[i - nf];
+            int a = m.heVert[h];
+            int b = m.heVert[m.next(h)];
+            if (m.isBoundary(h)) {
+                row.push_back(std::make_pair(a, 0.5));
+                row.push_back(std::make_pair(b, 0.5));
+            } else {
+                row.push_back(std::make_pair(a, 0.25));
+                row.push_back(std::make_pair(b, 0.25));
+                addFace(m, m.heFace[h], 0.25, row);
+                addFace(m, m.heFace[m.heTwin[h]], 0.25, row);
+            }
+        } else {
+            int v = i - nf - ne;
+            int nbrs[2];
+            int nb = boundaryNeighbours(m, v, nbrs);
+            if (nb == 2) {
+                row.push_back(std::make_pair(v, 0.75));
+                row.push_back(std::make_pair(nbrs[0], 0.125));
+                row.push_back(std::make_pair(nbrs[1], 0.125));
+                return;
+            }
+            int n = m.vertStart[v+1] - m.vertStart[v];
+            if (nb != 0 || n < 3) {
+                // Corners and non-manifold points stay put
+                row.push_back(std::make_pair(v, 1.0));
+                return;
+            }
+            // (F + 2R + (n-3)P)/n, expanded into cage weights
+            double n2 = double(n)*n;
+            row.push_back(std::make_pair(v, (n - 2.0)/n));
+            for (int k=m.vertStart[v]; k<m.vertStart[v+1]; ++k) {
+                int h = m.vertHes[k];
+                row.push_back(std::make_pair(m.heVert[m.next(h)], 1.0/n2));
+                addFace(m, m.heFace[h], 1.0/n2, row);
+            }
+        }
+    }, table);
+
+    sizes.assign(m.numHalfEdges(), 4);
+    faces.resize(4*m.numHalfEdges());
+    parallelFor(0, nf, 1024, [&](size_t lo, size_t hi) {
+        for (size_t f=lo; f<hi; ++f) {
+            for (int h=m.faceStart[f]; h<m.faceStart[f+1]; ++h) {
+                unsigned int *q = &faces[4*h];
+                q[0] = nf + ne + m.heVert[h];
+                q[1] = nf + m.heEdge[h];
+                q[2] = int(f);
+                q[3] = nf + m.heEdge[m.prev(h)];
+            }
+        }
+    });
+}
+
+/*!
+  One level of Loop subdivision.  New points are ordered vertex points,
+  then edge points.
+*/
+void refineLoop(const HalfEdgeMesh &m, StencilTable &table,
+                std::vector<unsigned int> &sizes, std::vector<unsigned int> &faces) {
+    const int nf = int(m.numFaces());
+    const int ne = int(m.numEdges());
+    const int nv = int(m.numVerts());
+    std::vector<int> edgeHe = edgeHalfEdges(m);
+
+    buildTable(nv + ne, [&](size_t r, Row &row) {
+        int i = int(r);
+        if (i < nv) {
+            int nbrs[2];
+            int nb = boundaryNeighbours(m, i, nbrs);
+            if (nb == 2) {
+                row.push_back(std::make_pair(i, 0.75));
+                row.push_back(std::make_pair(nbrs[0], 0.125));
+                row.push_back(std::make_pair(nbrs[1], 0.125));
+                return;
+            }
+            int n = m.vertStart[i+1] - m.vertStart[i];
+            if (nb != 0 || n < 3) {
+                row.push_back(std::make_pair(i, 1.0));
+                return;
+            }
+            double beta = (n == 3) ? 3.0/16.0 : 3.0/(8.0*n);
+            row.push_back(std::make_pair(i, 1.0 - n*beta));
+            for (int k=m.vertStart[i]; k<m.vertStart[i+1]; ++k) {
+                row.push_back(std::make_pair(m.heVert[m.next(m.vertHes[k])], beta));
+            }
+        } else {
+            int h = edgeHe[i - nv];
+            int a = m.heVert[h];
+            int b = m.heVert[m.next(h)];
+            if (m.isBoundary(h)) {
+                row.push_back(std::make_pair(a, 0.5));
+                row.push_back(std::make_pair(b, 0.5));
+            } else {
+                row.push_back(std::make_pair(a, 0.375));
+                row.push_back(std::make_pair(b, 0.375));
+                row.push_back(std::make_pair(m.heVert[m.prev(h)], 0.125));
+                row.push_back(std::make_pair(m.heVert[m.prev(m.heTwin[h])], 0.125));
+            }
+        }
+    }, table);
+
+    sizes.assign(4*nf, 3);
+    faces.resize(12*nf);
+    parallelFor(0, nf, 1024, [&](size_t lo, size_t hi) {
+        for (size_t f=lo; f<hi; ++f) {
+            int h0 = m.faceStart[f];
+            int h1 = h0 + 1;
+            int h2 = h0 + 2;
+            unsigned int a = m.heVert[h0], b = m.heVert[h1], c = m.heVert[h2];
+            unsigned int e0 = nv + m.heEdge[h0];
+            unsigned int e1 = nv + m.heEdge[h1];
+            unsigned int e2 = nv + m.heEdge[h2];
+            unsigned int tris[12] = { a, e0, e2,  b, e1, e0,  c, e2, e1,  e0, e1, e2 };
+            std::copy(tris, tris + 12, faces.begin() + 12*f);
+        }
+    });
+}
+
+// Preset cages
+const float cubeVerts[] = {
+    -2, -2, -2,   2, -2, -2,   2, 2, -2,   -2, 2, -2,
+    -2, -2, 2,    2, -2, 2,    2, 2, 2,    -2, 2, 2
+};
+const unsigned int cubeFaces[] = {
+    0, 3, 2, 1,   4, 5, 6, 7,   0, 1, 5, 4,
+    1, 2, 6, 5,   2, 3, 7, 6,   3, 0, 4, 7
+};
+const float tetraVerts[] = {
+    3, 3, 3,   -3, -3, 3,   -3, 3, -3,   3, -3, -3
+};
+const unsigned int tetraFaces[] = {
+    0, 1, 3,   0, 2, 1,   0, 3, 2,   1, 2, 3
+};
+const float octaVerts[] = {
+    3, 0, 0,   -3, 0, 0,   0, 3, 0,   0, -3, 0,   0, 0, 3,   0, 0, -3
+};
+const unsigned int octaFaces[] = {
+    0, 2, 4,   2, 1, 4,   1, 3, 4,   3, 0, 4,
+    2, 0, 5,   1, 2, 5,   3, 1, 5,   0, 3, 5
+};
+
+}
+
+void StencilTable::apply(const float *src, float *dst) const {
+    parallelFor(0, numRows(), 4096, [&](size_t lo, size_t hi) {
+        for (size_t r=lo; r<hi; ++r) {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            for (int i=rowStart[r]; i<rowStart[r+1]; ++i) {
+                const float *p = src + 3*cols[i];
+                float w = weights[i];
+                x += w*p[0];
+                y += w*p[1];
+                z += w*p[2];
+            }
+            dst[3*r] = x;
+            dst[3*r+1] = y;
+            dst[3*r+2] = z;
+        }
+    });
+}
+
+SubdivisionSurface::SubdivisionSurface() : preset(CAGE_CUBE), subdivScheme(SUBDIV_CATMULL_CLARK),
+                                           numLevels(4) {
+    setPresetCage(CAGE_CUBE);
+}
+
+void SubdivisionSurface::setCage(const std::vector<float> &verts,
+                                 const std::vector<unsigned int> &faceSizes,
+                                 const std::vector<unsigned int> &faceVerts) {
+    std::vector<float> oldVerts(verts);
+    std::swap(cageVerts, oldVerts);
+    std::vector<unsigned int> oldSizes(faceSizes);
+    std::swap(cageSizes, oldSizes);
+    std::vector<unsigned int> oldFaces(faceVerts);
+    std::swap(cageFaces, oldFaces);
+    try {
+        rebuild(subdivScheme, numLevels);
+    } catch (...) {
+        std::swap(cageVerts, oldVerts);
+        std::swap(cageSizes, oldSizes);
+        std::swap(cageFaces, oldFaces);
+        throw;
+    }
+}
+
+void SubdivisionSurface::setPresetCage(size_t which) {
+    const float *v = cubeVerts;
+    const unsigned int *f = cubeFaces;
+    size_t nv = sizeof(cubeVerts)/sizeof(float)/3;
+    size_t nf = sizeof(cubeFaces)/sizeof(unsigned int)/4;
+    unsigned int sides = 4;
+    if (which == CAGE_TETRAHEDRON) {
+        v = tetraVerts;
+        f = tetraFaces;
+        nv = sizeof(tetraVerts)/sizeof(float)/3;
+        nf = sizeof(tetraFaces)/sizeof(unsigned int)/3;
+        sides = 3;
+    } else if (which == CAGE_OCTAHEDRON) {
+        v = octaVerts;
+        f = octaFaces;
+        nv = sizeof(octaVerts)/sizeof(float)/3;
+        nf = sizeof(octaFaces)/sizeof(unsigned int)/3;
+        sides = 3;
+    } else {
+        which = CAGE_CUBE;
+    }
+    size_t oldScheme = subdivScheme;
+    if (sides == 4 && subdivScheme == SUBDIV_LOOP) {
+        // Loop needs triangles, so quad cages fall back to Catmull-Clark
+        subdivScheme = SUBDIV_CATMULL_CLARK;
+    }
+    try {
+        setCage(std::vector<float>(v, v + 3*nv),
+                std::vector<unsigned int>(nf, sides),
+                std::vector<unsigned int>(f, f + sides*nf));
+    } catch (...) {
+        subdivScheme = oldScheme;
+        throw;
+    }
+    preset = which;
+}
+
+void SubdivisionSurface::setScheme(size_t scheme) {
+    rebuild(scheme, numLevels);
+    subdivScheme = scheme;
+}
+
+void SubdivisionSurface::setLevels(size_t levels) {
+    levels = std::min(levels, SUBDIV_MAX_LEVELS);
+    rebuild(subdivScheme, levels);
+    numLevels = levels;
+}
+
+void SubdivisionSurface::setCagePositions(const std::vector<float> &verts) {
+    if (verts.size() != cageVerts.size()) {
+        throw std::runtime_error("Cage positions don't match the cage");
+    }
+    cageVerts = verts;
+}
+
+void SubdivisionSurface::moveCageVertex(size_t i, float x, float y, float z) {
+    if (i >= cageVerts.size()/3) {
+        throw std::runtime_error("Cage vertex out of range");
+    }
+    cageVerts[3*i] = x;
+    cageVerts[3*i+1] = y;
+    cageVerts[3*i+2] = z;
+}
+
+/*!
+  Refines the cage topology and builds the cage to finest level stencil
+  table.  Only commits if everything succeeds.
+*/
+void SubdivisionSurface::rebuild(size_t scheme, size_t levels) {
+    if (scheme == SUBDIV_LOOP) {
+        for (size_t f=0; f<cageSizes.size(); ++f) {
+            if (cageSizes[f] != 3) {
+                throw std::runtime_error("Loop subdivision needs a triangle mesh");
+            }
+        }
+    }
+
+    size_t numCage = cageVerts.size()/3;
+    HalfEdgeMesh mesh;
+    mesh.build(numCage, cageSizes, cageFaces);
+
+    // Start from the identity
+    StencilTable total;
+    total.rowStart.resize(numCage + 1);
+    total.cols.resize(numCage);
+    total.weights.assign(numCage, 1.0f);
+    for (size_t i=0; i<numCage; ++i) {
+        total.rowStart[i] = int(i);
+        total.cols[i] = int(i);
+    }
+    total.rowStart[numCage] = int(numCage);
+
+    for (size_t level=0; level<levels; ++level) {
+        StencilTable step;
+        std::vector<unsigned int> sizes, faces;
+        if (scheme == SUBDIV_LOOP) {
+            refineLoop(mesh, step, sizes, faces);
+        } else {
+            refineCatmullClark(mesh, step, sizes, faces);
+        }
+        total = compose(step, total, numCage);
+        mesh.build(step.numRows(), sizes, faces);
+    }
+
+    std::vector<unsigned int> tris;
+    for (size_t f=0; f<mesh.numFaces(); ++f) {
+        int h0 = mesh.faceStart[f];
+        for (int h=h0+1; h+1<mesh.faceStart[f+1]; ++h) {
+            tris.push_back(mesh.heVert[h0]);
+            tris.push_back(mesh.heVert[h]);
+            tris.push_back(mesh.heVert[h+1]);
+        }
+    }
+
+    stencil.rowStart.swap(total.rowStart);
+    stencil.cols.swap(total.cols);
+    stencil.weights.swap(total.weights);
+    finest = mesh;
+    triangles.swap(tris);
+}
+
+/*!
+  Applies the stencils to the cage and computes normals from the
+  finest level's one-rings.
+*/
+void SubdivisionSurface::tessellate(Mesh &mesh) const {
+    size_t nv = stencil.numRows();
+    mesh.verts.resize(3*nv);
+    mesh.norms.resize(3*nv);
+    mesh.indices = triangles;
+    if (nv == 0) return;
+
+    stencil.apply(&cageVerts[0], &mesh.verts[0]);
+
+    const HalfEdgeMesh &m = finest;
+    const float *p = &mesh.verts[0];
+    parallelFor(0, nv, 4096, [&](size_t lo, size_t hi) {
+        for (size_t v=lo; v<hi; ++v) {
+            double n[3] = { 0.0, 0.0, 0.0 };
+            const float *pv = p + 3*v;
+            for (int k=m.vertStart[v]; k<m.vertStart[v+1]; ++k) {
+                int h = m.vertHes[k];
+                const float *pa = p + 3*m.heVert[m.next(h)];
+                const float *pb = p + 3*m.heVert[m.prev(h)];
+                double a[3] = { pa[0] - pv[0], pa[1] - pv[1], pa[2] - pv[2] };
+                double b[3] = { pb[0] - pv[0], pb[1] - pv[1], pb[2] - pv[2] };
+                n[0] += a[1]*b[2] - a[2]*b[1];
+                n[1] += a[2]*b[0] - a[0]*b[2];
+                n[2] += a[0]*b[1] - a[1]*b[0];
+            }
+            double len = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+            len = (len > 0.0) ? 1.0/len : 0.0;
+            for (size_t k=0; k<3; ++k) {
+                mesh.norms[3*v+k] = float(n[k]*len);
+            }
+        }
+    });
+}
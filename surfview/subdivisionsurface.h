@@ -0,0 +1,111 @@
+/*
+  subdivisionsurface.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SUBDIVISIONSURFACE_H
+#define SUBDIVISIONSURFACE_H
+
+#include <vector>
+
+#include "halfedgemesh.h"
+#include "mesh.h"
+
+// Subdivision schemes
+static const size_t SUBDIV_CATMULL_CLARK=0;
+static const size_t SUBDIV_LOOP=1;
+
+// Built in control cages
+static const size_t CAGE_CUBE=0;
+static const size_t CAGE_TETRAHEDRON=1;
+static const size_t CAGE_OCTAHEDRON=2;
+static const size_t NUM_CAGES=3;
+
+static const size_t SUBDIV_MAX_LEVELS=8;
+
+/*!
+  Sparse matrix in compressed row form.  Row r gives the weights of the
+  control points that make up refined point r.
+*/
+struct StencilTable {
+    std::vector<int> rowStart;
+    std::vector<int> cols;
+    std::vector<float> weights;
+
+    size_t numRows() const { return rowStart.empty() ? 0 : rowStart.size() - 1; }
+
+    // dst[r] = sum of weights[i]*src[cols[i]], three floats per point
+    void apply(const float *src, float *dst) const;
+};
+
+/*!
+  Catmull-Clark or Loop subdivision of a polygonal control cage.
+
+  Refinement is split into a topology pass and a geometry pass.  The
+  topology pass runs once per cage connectivity: it subdivides the
+  half-edge mesh level by level, records each level's rules as a
+  stencil table, and multiplies the tables together so the finest
+  level is a single sparse matrix applied to the cage.  Moving cage
+  points afterwards only repeats that matrix-vector product.
+*/
+class SubdivisionSurface {
+public:
+    SubdivisionSurface();
+
+    /*!
+      Replaces the cage.  Throws std::runtime_error if the faces are
+      malformed, or if the scheme is Loop and some face isn't a
+      triangle.  The surface is unchanged if an exception is thrown.
+    */
+    void setCage(const std::vector<float> &verts,
+                 const std::vector<unsigned int> &faceSizes,
+                 const std::vector<unsigned int> &faceVerts);
+    void setPresetCage(size_t which);
+    void setScheme(size_t scheme);
+    void setLevels(size_t levels);
+
+    /*!
+      Move cage points without changing connectivity, so only the
+      stencils are re-applied.  Throw std::runtime_error if the sizes or
+      index don't match the cage.
+    */
+    void setCagePositions(const std::vector<float> &verts);
+    void moveCageVertex(size_t i, float x, float y, float z);
+
+    const std::vector<float> &cagePositions() const { return cageVerts; }
+    size_t presetCage() const { return preset; }
+    size_t scheme() const { return subdivScheme; }
+    size_t levels() const { return numLevels; }
+
+    void tessellate(Mesh &mesh) const;
+
+private:
+    void rebuild(size_t scheme, size_t levels);
+
+    std::vector<float> cageVerts;
+    std::vector<unsigned int> cageSizes;
+    std::vector<unsigned int> cageFaces;
+    size_t preset;
+    size_t subdivScheme;
+    size_t numLevels;
+
+    // Cage to finest level
+    StencilTable stencil;
+    HalfEdgeMesh finest;
+    std::vector<unsigned int> triangles;
+};
+
+#endif
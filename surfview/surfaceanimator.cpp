@@ -0,0 +1,136 @@
+/*
+  surfaceanimator.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <chrono>
+
+#include "surfaceanimator.h"
+
+SurfaceAnimator::SurfaceAnimator() : evaluated(0), frameMs(0.0), stopping(false) {
+}
+
+SurfaceAnimator::~SurfaceAnimator() {
+    stop();
+}
+
+void SurfaceAnimator::start(const ParametricSurface &surf, float *const *ring, size_t numSlots) {
+    stop();
+    surface = surf;
+    buffers.assign(ring, ring + numSlots);
+    states.assign(numSlots, SLOT_FREE);
+    times.assign(numSlots, 0.0);
+    evaluated = 0;
+    frameMs = 0.0;
+    stopping = false;
+    worker = std::thread(&SurfaceAnimator::run, this);
+}
+
+/*!
+  Waits for the frame being evaluated to finish.  Slots the caller
+  acquired stay valid, but no more frames are written.
+*/
+void SurfaceAnimator::stop() {
+    if (!worker.joinable()) return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    slotFreed.notify_all();
+    worker.join();
+}
+
+int SurfaceAnimator::acquire(double *t) {
+    int slot = -1;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i=0; i<states.size(); ++i) {
+            if (states[i] == SLOT_READY) {
+                states[i] = SLOT_HELD;
+                if (t) *t = times[i];
+                slot = int(i);
+                break;
+            }
+        }
+    }
+    // The worker waits for the ready frame to be taken
+    if (slot >= 0) slotFreed.notify_all();
+    return slot;
+}
+
+void SurfaceAnimator::release(int slot) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (slot < 0 || size_t(slot) >= states.size() || states[slot] != SLOT_HELD) return;
+        states[slot] = SLOT_FREE;
+    }
+    slotFreed.notify_all();
+}
+
+size_t SurfaceAnimator::framesEvaluated() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return evaluated;
+}
+
+double SurfaceAnimator::lastFrameTime() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return frameMs;
+}
+
+/*!
+  The worker: waits until no frame is ready and a slot is free,
+  evaluates the surface at the current time into it, then makes it the
+  ready frame.
+*/
+void SurfaceAnimator::run() {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point begin = Clock::now();
+    const double t0 = surface.time();
+    const size_t nv = surface.numVerts();
+
+    for (;;) {
+        size_t slot = 0;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            for (;;) {
+                if (stopping) return;
+                size_t ready = 0;
+                for (size_t i=0; i<states.size(); ++i) {
+                    if (states[i] == SLOT_READY) ++ready;
+                }
+                for (slot=0; slot<states.size() && states[slot] != SLOT_FREE; ++slot) {}
+                if (!ready && slot < states.size()) break;
+                slotFreed.wait(guard);
+            }
+            states[slot] = SLOT_FILLING;
+        }
+
+        const Clock::time_point frameStart = Clock::now();
+        double t = t0 + std::chrono::duration<double>(frameStart - begin).count();
+        surface.setTime(t);
+        surface.tessellateVertices(buffers[slot], buffers[slot] + 3*nv);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            states[slot] = SLOT_READY;
+            times[slot] = t;
+            frameMs = ms;
+            ++evaluated;
+        }
+        if (frameReady) frameReady();
+    }
+}
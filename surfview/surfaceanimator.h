@@ -0,0 +1,96 @@
+/*
+  surfaceanimator.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SURFACEANIMATOR_H
+#define SURFACEANIMATOR_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parametricsurface.h"
+
+// Vertex buffers in the animation ring: one being drawn, one the GPU
+// may still be reading, and one being filled
+static const size_t ANIMATION_SLOTS=3;
+
+/*!
+  Evaluates frames of an animated ParametricSurface on a worker thread
+  while the previous one is drawn.
+
+  Frames go into a ring of caller supplied buffers, each big enough for
+  numVerts() positions followed by as many normals, three floats each.
+  They may be mapped GPU buffers; the animator only ever writes to
+  a slot the caller has released.  The surface's time follows the wall
+  clock, one unit of t per second.  The worker stays one frame ahead:
+  once a frame is ready it waits for the caller to pick it up before
+  evaluating the next.
+*/
+class SurfaceAnimator {
+public:
+    SurfaceAnimator();
+    ~SurfaceAnimator();
+
+    // Stops any running animation and starts animating surf into the buffers in ring
+    void start(const ParametricSurface &surf, float *const *ring, size_t numSlots);
+    void stop();
+    bool running() const { return worker.joinable(); }
+
+    /*!
+      Returns the newest finished frame's slot, which then belongs to the
+      caller until release, and sets t to its time.  Returns -1 if no
+      frame has finished since the last call.
+    */
+    int acquire(double *t = 0);
+    void release(int slot);
+
+    /*!
+      Called on the worker thread each time a frame is ready, so it must
+      be thread safe; posting an event is the usual thing to do.  Set it
+      before start.
+    */
+    void setFrameCallback(const std::function<void()> &func) { frameReady = func; }
+
+    // Frames evaluated since start
+    size_t framesEvaluated() const;
+    // Milliseconds the last frame took to evaluate
+    double lastFrameTime() const;
+
+private:
+    enum SlotState { SLOT_FREE, SLOT_FILLING, SLOT_READY, SLOT_HELD };
+
+    void run();
+
+    ParametricSurface surface;
+    std::vector<float*> buffers;
+    std::vector<SlotState> states;
+    std::vector<double> times;
+    std::function<void()> frameReady;
+    size_t evaluated;
+    double frameMs;
+    bool stopping;
+
+    mutable std::mutex lock;
+    std::condition_variable slotFreed;
+    std::thread worker;
+};
+
+#endif
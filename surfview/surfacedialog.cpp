@@ -0,0 +1,107 @@
+/*
+  surfacedialog.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <QtGui>
+
+#include "surfacedialog.h"
+
+/*!
+  Creates a spin box for one end of a parameter range
+*/
+static QDoubleSpinBox *rangeBox(double val, QWidget *parent) {
+    QDoubleSpinBox *box = new QDoubleSpinBox(parent);
+    box->setRange(-1.0e6, 1.0e6);
+    box->setDecimals(4);
+    box->setSingleStep(0.1);
+    box->setValue(val);
+    return box;
+}
+
+/*!
+  Lays out the fields, filled in from surf
+*/
+SurfaceDialog::SurfaceDialog(const ParametricSurface &surf, QWidget *parent) :
+    QDialog(parent), result(surf) {
+
+    setWindowTitle(tr("Edit Surface"));
+
+    xEdit = new QLineEdit(QString::fromStdString(surf.xExpression()), this);
+    yEdit = new QLineEdit(QString::fromStdString(surf.yExpression()), this);
+    zEdit = new QLineEdit(QString::fromStdString(surf.zExpression()), this);
+
+    uMinBox = rangeBox(surf.uMin(), this);
+    uMaxBox = rangeBox(surf.uMax(), this);
+    vMinBox = rangeBox(surf.vMin(), this);
+    vMaxBox = rangeBox(surf.vMax(), this);
+
+    uStepsBox = new QSpinBox(this);
+    uStepsBox->setRange(1, 4096);
+    uStepsBox->setValue(int(surf.uSteps()));
+    vStepsBox = new QSpinBox(this);
+    vStepsBox->setRange(1, 4096);
+    vStepsBox->setValue(int(surf.vSteps()));
+
+    QGridLayout *grid = new QGridLayout;
+    grid->addWidget(new QLabel(tr("x(u,v,t)")), 0, 0);
+    grid->addWidget(xEdit, 0, 1, 1, 3);
+    grid->addWidget(new QLabel(tr("y(u,v,t)")), 1, 0);
+    grid->addWidget(yEdit, 1, 1, 1, 3);
+    grid->addWidget(new QLabel(tr("z(u,v,t)")), 2, 0);
+    grid->addWidget(zEdit, 2, 1, 1, 3);
+
+    grid->addWidget(new QLabel(tr("u range")), 3, 0);
+    grid->addWidget(uMinBox, 3, 1);
+    grid->addWidget(uMaxBox, 3, 2);
+    grid->addWidget(uStepsBox, 3, 3);
+    grid->addWidget(new QLabel(tr("v range")), 4, 0);
+    grid->addWidget(vMinBox, 4, 1);
+    grid->addWidget(vMaxBox, 4, 2);
+    grid->addWidget(vStepsBox, 4, 3);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok |
+                                                     QDialogButtonBox::Cancel);
+    connect(buttons, SIGNAL(accepted()), this, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), this, SLOT(reject()));
+
+    QVBoxLayout *layout = new QVBoxLayout;
+    layout->addLayout(grid);
+    layout->addWidget(buttons);
+    setLayout(layout);
+}
+
+/*!
+  Compiles the expressions and only closes the dialog if they are valid
+*/
+void SurfaceDialog::accept() {
+    ParametricSurface surf(result);
+    try {
+        surf.setExpressions(xEdit->text().toStdString(),
+                            yEdit->text().toStdString(),
+                            zEdit->text().toStdString());
+    } catch (const ExprError &err) {
+        QMessageBox::warning(this, tr("Invalid Expression"),
+                             QString::fromStdString(err.what()));
+        return;
+    }
+    surf.setDomain(uMinBox->value(), uMaxBox->value(),
+                   vMinBox->value(), vMaxBox->value());
+    surf.setResolution(size_t(uStepsBox->value()), size_t(vStepsBox->value()));
+
+    result = surf;
+    QDialog::accept();
+}
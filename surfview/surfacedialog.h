@@ -0,0 +1,62 @@
+/*
+  surfacedialog.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SURFACEDIALOG_H
+#define SURFACEDIALOG_H
+
+#include <QDialog>
+
+#include "parametricsurface.h"
+
+class QLineEdit;
+class QDoubleSpinBox;
+class QSpinBox;
+
+/*!
+  Dialog for entering x(u,v), y(u,v), z(u,v) and the parameter domain.
+  The expressions are compiled when OK is pressed, and the dialog stays
+  open with an error message if they don't parse.
+*/
+class SurfaceDialog : public QDialog {
+    Q_OBJECT;
+
+public:
+    SurfaceDialog(const ParametricSurface &surf, QWidget *parent = 0);
+
+    const ParametricSurface &surface() const { return result; }
+
+public slots:
+    void accept();
+
+private:
+    QLineEdit *xEdit;
+    QLineEdit *yEdit;
+    QLineEdit *zEdit;
+
+    QDoubleSpinBox *uMinBox;
+    QDoubleSpinBox *uMaxBox;
+    QDoubleSpinBox *vMinBox;
+    QDoubleSpinBox *vMaxBox;
+
+    QSpinBox *uStepsBox;
+    QSpinBox *vStepsBox;
+
+    ParametricSurface result;
+};
+
+#endif
@@ -0,0 +1,743 @@
+/*
+  surfacequery.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "parallel.h"
+#include "surfacequery.h"
+
+namespace {
+
+// Queries handled together, sharing batched evaluations
+const size_t QUERY_CHUNK = 256;
+
+// Curve segments handled together
+const size_t SEGMENT_CHUNK = 64;
+
+// Closest point candidates followed up per query
+const size_t CLOSEST_SEEDS = 4;
+
+// How far outside a grid triangle a ray may pass and still start a
+// search, in barycentric units
+const double SEED_SLACK = 0.25;
+
+/*!
+  Inputs and outputs for one batched surface evaluation.
+*/
+struct EvalBuffer {
+    std::vector<double> u, v, buf;
+    double *out[PS_NUM_SECOND_OUTPUTS];
+
+    void resize(size_t n, size_t outputs) {
+        u.resize(n);
+        v.resize(n);
+        buf.resize(n*outputs);
+        for (size_t k=0; k<outputs; ++k) {
+            out[k] = n ? &buf[k*n] : 0;
+        }
+    }
+};
+
+inline double dot3(const double *a, const double *b) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+inline void cross3(const double *a, const double *b, double *c) {
+    c[0] = a[1]*b[2] - a[2]*b[1];
+    c[1] = a[2]*b[0] - a[0]*b[2];
+    c[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+inline double det3(const double *a, const double *b, const double *c) {
+    double bc[3];
+    cross3(b, c, bc);
+    return dot3(a, bc);
+}
+
+bool rayBox(const double *o, const double *d, const double *lo, const double *hi,
+            double tLo, double tHi) {
+    for (size_t k=0; k<3; ++k) {
+        if (d[k] == 0.0) {
+            if (o[k] < lo[k] || o[k] > hi[k]) return false;
+            continue;
+        }
+        double inv = 1.0/d[k];
+        double t1 = (lo[k] - o[k])*inv;
+        double t2 = (hi[k] - o[k])*inv;
+        if (t1 > t2) std::swap(t1, t2);
+        tLo = std::max(tLo, t1);
+        tHi = std::min(tHi, t2);
+        if (tLo > tHi) return false;
+    }
+    return true;
+}
+
+double boxDistance2(const double *p, const double *lo, const double *hi) {
+    double d2 = 0.0;
+    for (size_t k=0; k<3; ++k) {
+        double e = std::max(std::max(lo[k] - p[k], p[k] - hi[k]), 0.0);
+        d2 += e*e;
+    }
+    return d2;
+}
+
+/*!
+  Moller-Trumbore, without rejecting points just outside the triangle.
+  Returns false only if the ray is parallel to the triangle's plane.
+*/
+bool rayTriangle(const double *o, const double *d, const double *a, const double *b,
+                 const double *c, double &t, double &beta, double &gamma) {
+    double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    double pv[3];
+    cross3(d, e2, pv);
+    double det = dot3(e1, pv);
+    if (std::fabs(det) < 1.0e-300) return false;
+    double inv = 1.0/det;
+    double tv[3] = { o[0] - a[0], o[1] - a[1], o[2] - a[2] };
+    beta = dot3(tv, pv)*inv;
+    double qv[3];
+    cross3(tv, e1, qv);
+    gamma = dot3(d, qv)*inv;
+    t = dot3(e2, qv)*inv;
+    return true;
+}
+
+}
+
+SurfaceQuery::SurfaceQuery() : nPatchU(0), nPatchV(0), gridU(0), gridV(0),
+                               cellDu(0.0), cellDv(0.0), scale(0.0) {
+}
+
+void SurfaceQuery::build(const ParametricSurface &surf, size_t pu, size_t pv) {
+    surface = surf;
+    nPatchU = pu ? pu : 1;
+    nPatchV = pv ? pv : 1;
+    gridU = nPatchU*QUERY_PATCH_CELLS + 1;
+    gridV = nPatchV*QUERY_PATCH_CELLS + 1;
+    cellDu = (surface.uMax() - surface.uMin())/(gridU - 1);
+    cellDv = (surface.vMax() - surface.vMin())/(gridV - 1);
+
+    // Grid points, and the middle of every cell to see how much the
+    // surface bulges between them
+    grid.resize(3*gridU*gridV);
+    std::vector<double> bulge((gridU - 1)*(gridV - 1));
+    std::vector<double> centres(3*bulge.size());
+    parallelFor(0, gridV, 4, [&](size_t lo, size_t hi) {
+        EvalBuffer eb;
+        eb.resize(gridU, PS_NUM_OUTPUTS);
+        for (size_t j=lo; j<hi; ++j) {
+            for (size_t i=0; i<gridU; ++i) {
+                eb.u[i] = surface.uMin() + cellDu*i;
+                eb.v[i] = surface.vMin() + cellDv*j;
+            }
+            surface.evaluate(&eb.u[0], &eb.v[0], gridU, eb.out);
+            for (size_t i=0; i<gridU; ++i) {
+                for (size_t k=0; k<3; ++k) {
+                    grid[3*(j*gridU + i) + k] = eb.out[PS_X+k][i];
+                }
+            }
+            if (j + 1 == gridV) continue;
+            for (size_t i=0; i+1<gridU; ++i) {
+                eb.u[i] = surface.uMin() + cellDu*(i + 0.5);
+                eb.v[i] = surface.vMin() + cellDv*(j + 0.5);
+            }
+            surface.evaluate(&eb.u[0], &eb.v[0], gridU - 1, eb.out);
+            for (size_t i=0; i+1<gridU; ++i) {
+                for (size_t k=0; k<3; ++k) {
+                    centres[3*(j*(gridU - 1) + i) + k] = eb.out[PS_X+k][i];
+                }
+            }
+        }
+    });
+
+    double lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL };
+    double hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+    for (size_t i=0; i<grid.size(); i+=3) {
+        for (size_t k=0; k<3; ++k) {
+            // Skip NaNs from points outside the surface's natural domain
+            if (grid[i+k] < lo[k]) lo[k] = grid[i+k];
+            if (grid[i+k] > hi[k]) hi[k] = grid[i+k];
+        }
+    }
+    scale = 0.0;
+    for (size_t k=0; k<3; ++k) {
+        if (hi[k] > lo[k]) scale += (hi[k] - lo[k])*(hi[k] - lo[k]);
+    }
+    scale = (scale > 0.0) ? std::sqrt(scale) : 1.0;
+
+    for (size_t j=0; j+1<gridV; ++j) {
+        for (size_t i=0; i+1<gridU; ++i) {
+            const double *c = &centres[3*(j*(gridU - 1) + i)];
+            const double *a = gridPoint(i, j), *b = gridPoint(i+1, j);
+            const double *d = gridPoint(i, j+1), *e = gridPoint(i+1, j+1);
+            double dist2 = 0.0;
+            for (size_t k=0; k<3; ++k) {
+                double mid = 0.25*(a[k] + b[k] + d[k] + e[k]);
+                dist2 += (c[k] - mid)*(c[k] - mid);
+            }
+            bulge[j*(gridU - 1) + i] = std::sqrt(dist2);
+        }
+    }
+
+    // Patch boxes cover the grid points and cell centres, padded by
+    // the largest bulge in the patch
+    const size_t numPatch = nPatchU*nPatchV;
+    boxes.resize(6*numPatch);
+    std::vector<double> centroids(3*numPatch);
+    for (size_t p=0; p<numPatch; ++p) {
+        size_t pi = p % nPatchU, pj = p / nPatchU;
+        double *blo = &boxes[6*p], *bhi = blo + 3;
+        for (size_t k=0; k<3; ++k) {
+            blo[k] = HUGE_VAL;
+            bhi[k] = -HUGE_VAL;
+        }
+        double pad = 1.0e-9*scale;
+        for (size_t cj=0; cj<=QUERY_PATCH_CELLS; ++cj) {
+            for (size_t ci=0; ci<=QUERY_PATCH_CELLS; ++ci) {
+                size_t i = pi*QUERY_PATCH_CELLS + ci, j = pj*QUERY_PATCH_CELLS + cj;
+                const double *g = gridPoint(i, j);
+                for (size_t k=0; k<3; ++k) {
+                    blo[k] = std::min(blo[k], g[k]);
+                    bhi[k] = std::max(bhi[k], g[k]);
+                }
+                if (ci == QUERY_PATCH_CELLS || cj == QUERY_PATCH_CELLS) continue;
+                const double *c = &centres[3*(j*(gridU - 1) + i)];
+                for (size_t k=0; k<3; ++k) {
+                    blo[k] = std::min(blo[k], c[k]);
+                    bhi[k] = std::max(bhi[k], c[k]);
+                }
+                pad = std::max(pad, 1.5*bulge[j*(gridU - 1) + i]);
+            }
+        }
+        for (size_t k=0; k<3; ++k) {
+            blo[k] -= pad;
+            bhi[k] += pad;
+            centroids[3*p+k] = 0.5*(blo[k] + bhi[k]);
+        }
+    }
+
+    nodes.clear();
+    patchOrder.resize(numPatch);
+    for (size_t p=0; p<numPatch; ++p) {
+        patchOrder[p] = int(p);
+    }
+    buildNode(0, numPatch, centroids);
+}
+
+/*!
+  Median split on the longest axis of the centroids, depth first so a
+  node's left child always follows it.
+*/
+int SurfaceQuery::buildNode(size_t first, size_t count, std::vector<double> &centroids) {
+    BvhNode node;
+    for (size_t k=0; k<3; ++k) {
+        node.lo[k] = HUGE_VAL;
+        node.hi[k] = -HUGE_VAL;
+    }
+    double clo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL };
+    double chi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+    for (size_t i=first; i<first+count; ++i) {
+        const double *b = &boxes[6*patchOrder[i]];
+        const double *c = &centroids[3*patchOrder[i]];
+        for (size_t k=0; k<3; ++k) {
+            node.lo[k] = std::min(node.lo[k], b[k]);
+            node.hi[k] = std::max(node.hi[k], b[k+3]);
+            clo[k] = std::min(clo[k], c[k]);
+            chi[k] = std::max(chi[k], c[k]);
+        }
+    }
+    node.first = int(first);
+    node.count = int(count);
+    node.right = -1;
+
+    int idx = int(nodes.size());
+    nodes.push_back(node);
+    if (count <= 2) {
+        return idx;
+    }
+
+    size_t axis = 0;
+    for (size_t k=1; k<3; ++k) {
+        if (chi[k] - clo[k] > chi[axis] - clo[axis]) axis = k;
+    }
+    size_t half = count/2;
+    std::nth_element(patchOrder.begin() + first, patchOrder.begin() + first + half,
+                     patchOrder.begin() + first + count,
+                     [&](int a, int b) { return centroids[3*a + axis] < centroids[3*b + axis]; });
+    buildNode(first, half, centroids);
+    int right = buildNode(first + half, count - half, centroids);
+    nodes[idx].count = 0;
+    nodes[idx].right = right;
+    return idx;
+}
+
+void SurfaceQuery::patchDomain(size_t patch, double &u0, double &u1, double &v0, double &v1) const {
+    const double pu = cellDu*QUERY_PATCH_CELLS, pv = cellDv*QUERY_PATCH_CELLS;
+    u0 = surface.uMin() + pu*(patch % nPatchU);
+    v0 = surface.vMin() + pv*(patch / nPatchU);
+    u1 = u0 + pu;
+    v1 = v0 + pv;
+}
+
+int SurfaceQuery::patchAt(double u, double v) const {
+    double fu = (u - surface.uMin())/(cellDu*QUERY_PATCH_CELLS);
+    double fv = (v - surface.vMin())/(cellDv*QUERY_PATCH_CELLS);
+    size_t pi = (fu > 0.0) ? std::min(size_t(fu), nPatchU - 1) : 0;
+    size_t pj = (fv > 0.0) ? std::min(size_t(fv), nPatchV - 1) : 0;
+    return int(pj*nPatchU + pi);
+}
+
+/*!
+  Starting points for a ray: wherever it passes through, or close to,
+  a grid triangle in a patch whose box it crosses.
+*/
+void SurfaceQuery::raySeeds(size_t query, const double *o, const double *d, double tLo,
+                            double tHi, std::vector<Seed> &seeds) const {
+    if (nodes.empty()) return;
+    size_t added = 0;
+    int stack[64];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp) {
+        int idx = stack[--sp];
+        const BvhNode &node = nodes[idx];
+        if (!rayBox(o, d, node.lo, node.hi, tLo, tHi)) continue;
+        if (node.count == 0) {
+            stack[sp++] = node.right;
+            stack[sp++] = idx + 1;
+            continue;
+        }
+        for (int n=node.first; n<node.first+node.count; ++n) {
+            int p = patchOrder[n];
+            const double *b = &boxes[6*p];
+            if (!rayBox(o, d, b, b + 3, tLo, tHi)) continue;
+            size_t pi = p % nPatchU, pj = p / nPatchU;
+            for (size_t cj=0; cj<QUERY_PATCH_CELLS; ++cj) {
+                for (size_t ci=0; ci<QUERY_PATCH_CELLS; ++ci) {
+                    size_t i = pi*QUERY_PATCH_CELLS + ci, j = pj*QUERY_PATCH_CELLS + cj;
+                    const double *c00 = gridPoint(i, j), *c10 = gridPoint(i+1, j);
+                    const double *c01 = gridPoint(i, j+1), *c11 = gridPoint(i+1, j+1);
+                    for (size_t tri=0; tri<2; ++tri) {
+                        double t, beta, gamma, lu, lv;
+                        if (tri == 0) {
+                            if (!rayTriangle(o, d, c00, c10, c01, t, beta, gamma)) continue;
+                            lu = beta;
+                            lv = gamma;
+                        } else {
+                            if (!rayTriangle(o, d, c11, c01, c10, t, beta, gamma)) continue;
+                            lu = 1.0 - beta;
+                            lv = 1.0 - gamma;
+                        }
+                        if (beta < -SEED_SLACK || gamma < -SEED_SLACK ||
+                            beta + gamma > 1.0 + SEED_SLACK || t < tLo || t > tHi) {
+                            continue;
+                        }
+                        Seed s;
+                        s.query = query;
+                        s.u = surface.uMin() + cellDu*(i + lu);
+                        s.v = surface.vMin() + cellDv*(j + lv);
+                        s.t = t;
+                        seeds.push_back(s);
+                        if (++added == QUERY_MAX_SEEDS) return;
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <class Target>
+void SurfaceQuery::refineCrossings(Target target, double tol, std::vector<Seed> &seeds,
+                                   std::vector<double> &residual) const {
+    const size_t n = seeds.size();
+    residual.assign(n, HUGE_VAL);
+    if (n == 0) return;
+
+    // Steps are limited to a patch so a seed can't wander off to some
+    // unrelated part of the surface
+    const double maxDu = cellDu*QUERY_PATCH_CELLS, maxDv = cellDv*QUERY_PATCH_CELLS;
+    EvalBuffer eb;
+    eb.resize(n, PS_NUM_OUTPUTS);
+
+    // Seeds drop out of the batch once they converge or get stuck
+    std::vector<size_t> active(n), still;
+    for (size_t s=0; s<n; ++s) {
+        active[s] = s;
+    }
+    for (size_t step=0; step<=QUERY_NEWTON_STEPS && !active.empty(); ++step) {
+        const size_t m = active.size();
+        for (size_t i=0; i<m; ++i) {
+            eb.u[i] = seeds[active[i]].u;
+            eb.v[i] = seeds[active[i]].v;
+        }
+        surface.evaluate(&eb.u[0], &eb.v[0], m, eb.out);
+
+        still.clear();
+        for (size_t i=0; i<m; ++i) {
+            const size_t s = active[i];
+            Seed &seed = seeds[s];
+            double c[3], dc[3];
+            target(seed.query, seed.t, c, dc);
+            double su[3], sv[3], f[3];
+            for (size_t k=0; k<3; ++k) {
+                seed.point[k] = eb.out[PS_X+k][i];
+                su[k] = eb.out[PS_DU+k][i];
+                sv[k] = eb.out[PS_DV+k][i];
+                f[k] = c[k] - seed.point[k];
+                dc[k] = -dc[k];
+            }
+            residual[s] = std::sqrt(dot3(f, f));
+            if (step == QUERY_NEWTON_STEPS || !(residual[s] > 1.0e-3*tol)) continue;
+
+            // Solve [Su Sv -C'] (du, dv, dt) = C - S by Cramer's rule
+            double det = det3(su, sv, dc);
+            if (!(std::fabs(det) > 0.0)) continue;
+            double du = det3(f, sv, dc)/det;
+            double dv = det3(su, f, dc)/det;
+            double dt = det3(su, sv, f)/det;
+            du = std::min(std::max(du, -maxDu), maxDu);
+            dv = std::min(std::max(dv, -maxDv), maxDv);
+            seed.u = std::min(std::max(seed.u + du, surface.uMin()), surface.uMax());
+            seed.v = std::min(std::max(seed.v + dv, surface.vMin()), surface.vMax());
+            seed.t += dt;
+            still.push_back(s);
+        }
+        active.swap(still);
+    }
+}
+
+/*!
+  Walks the hierarchy nearest box first, keeping the closest grid
+  points of the CLOSEST_SEEDS best patches.  Grid points lie on the
+  surface, so the nearest one found so far bounds the answer and any
+  box further away than that can be skipped.
+*/
+void SurfaceQuery::closestSeeds(size_t query, const double *p, std::vector<Seed> &seeds,
+                                SurfaceHit &nearest) const {
+    nearest.patch = -1;
+    nearest.t = HUGE_VAL;
+    if (nodes.empty()) return;
+
+    double best = HUGE_VAL;
+    double candD[CLOSEST_SEEDS];
+    size_t candI[CLOSEST_SEEDS], candJ[CLOSEST_SEEDS];
+    size_t numCand = 0;
+
+    int stack[64];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp) {
+        int idx = stack[--sp];
+        const BvhNode &node = nodes[idx];
+        if (boxDistance2(p, node.lo, node.hi) > best) continue;
+        if (node.count == 0) {
+            const BvhNode &left = nodes[idx+1], &right = nodes[node.right];
+            if (boxDistance2(p, left.lo, left.hi) < boxDistance2(p, right.lo, right.hi)) {
+                stack[sp++] = node.right;
+                stack[sp++] = idx + 1;
+            } else {
+                stack[sp++] = idx + 1;
+                stack[sp++] = node.right;
+            }
+            continue;
+        }
+        for (int n=node.first; n<node.first+node.count; ++n) {
+            int patch = patchOrder[n];
+            const double *b = &boxes[6*patch];
+            if (boxDistance2(p, b, b + 3) > best) continue;
+            size_t pi = patch % nPatchU, pj = patch / nPatchU;
+            double pd = HUGE_VAL;
+            size_t bi = 0, bj = 0;
+            for (size_t cj=0; cj<=QUERY_PATCH_CELLS; ++cj) {
+                for (size_t ci=0; ci<=QUERY_PATCH_CELLS; ++ci) {
+                    size_t i = pi*QUERY_PATCH_CELLS + ci, j = pj*QUERY_PATCH_CELLS + cj;
+                    const double *g = gridPoint(i, j);
+                    double e[3] = { g[0] - p[0], g[1] - p[1], g[2] - p[2] };
+                    double d2 = dot3(e, e);
+                    if (d2 < pd) {
+                        pd = d2;
+                        bi = i;
+                        bj = j;
+                    }
+                }
+            }
+            best = std::min(best, pd);
+
+            // Insertion into the short sorted candidate list
+            if (numCand == CLOSEST_SEEDS && pd >= candD[numCand-1]) continue;
+            size_t at = (numCand < CLOSEST_SEEDS) ? numCand++ : numCand - 1;
+            while (at > 0 && candD[at-1] > pd) {
+                candD[at] = candD[at-1];
+                candI[at] = candI[at-1];
+                candJ[at] = candJ[at-1];
+                --at;
+            }
+            candD[at] = pd;
+            candI[at] = bi;
+            candJ[at] = bj;
+        }
+    }
+
+    for (size_t c=0; c<numCand; ++c) {
+        Seed s;
+        s.query = query;
+        s.u = surface.uMin() + cellDu*candI[c];
+        s.v = surface.vMin() + cellDv*candJ[c];
+        s.t = std::sqrt(candD[c]);
+        seeds.push_back(s);
+    }
+    if (numCand) {
+        // The nearest grid point is the fallback answer
+        const double *g = gridPoint(candI[0], candJ[0]);
+        nearest.u = seeds[seeds.size() - numCand].u;
+        nearest.v = seeds[seeds.size() - numCand].v;
+        nearest.patch = patchAt(nearest.u, nearest.v);
+        nearest.t = std::sqrt(candD[0]);
+        for (size_t k=0; k<3; ++k) {
+            nearest.point[k] = g[k];
+        }
+    }
+}
+
+/*!
+  Newton on |S(u,v) - p|^2, falling back to Gauss-Newton where the
+  Hessian isn't positive definite, and halving back toward the last
+  accepted point whenever a step makes things worse.
+*/
+void SurfaceQuery::refineClosest(const double *points, std::vector<Seed> &seeds) const {
+    const size_t n = seeds.size();
+    if (n == 0) return;
+
+    const double maxDu = cellDu*QUERY_PATCH_CELLS, maxDv = cellDv*QUERY_PATCH_CELLS;
+    // Steps smaller than this, relative to a patch, count as converged
+    const double minStep = 1.0e-12;
+
+    std::vector<double> accU(n), accV(n), accD(n, HUGE_VAL), accP(3*n);
+    std::vector<double> trialU(n), trialV(n);
+    std::vector<size_t> active(n), still;
+    for (size_t s=0; s<n; ++s) {
+        trialU[s] = seeds[s].u;
+        trialV[s] = seeds[s].v;
+        active[s] = s;
+    }
+    EvalBuffer eb;
+    eb.resize(n, PS_NUM_SECOND_OUTPUTS);
+    for (size_t step=0; step<=QUERY_NEWTON_STEPS && !active.empty(); ++step) {
+        const size_t m = active.size();
+        for (size_t i=0; i<m; ++i) {
+            eb.u[i] = trialU[active[i]];
+            eb.v[i] = trialV[active[i]];
+        }
+        surface.evaluateSecond(&eb.u[0], &eb.v[0], m, eb.out);
+
+        still.clear();
+        for (size_t i=0; i<m; ++i) {
+            const size_t s = active[i];
+            const double *p = points + 3*seeds[s].query;
+            double r[3], su[3], sv[3], suu[3], suv[3], svv[3];
+            for (size_t k=0; k<3; ++k) {
+                r[k] = eb.out[PS_X+k][i] - p[k];
+                su[k] = eb.out[PS_DU+k][i];
+                sv[k] = eb.out[PS_DV+k][i];
+                suu[k] = eb.out[PS_DUU+k][i];
+                suv[k] = eb.out[PS_DUV+k][i];
+                svv[k] = eb.out[PS_DVV+k][i];
+            }
+            double d2 = dot3(r, r);
+            if (!(d2 <= accD[s])) {
+                trialU[s] = 0.5*(trialU[s] + accU[s]);
+                trialV[s] = 0.5*(trialV[s] + accV[s]);
+                if (std::fabs(trialU[s] - accU[s]) > minStep*maxDu ||
+                    std::fabs(trialV[s] - accV[s]) > minStep*maxDv) {
+                    still.push_back(s);
+                }
+                continue;
+            }
+            accU[s] = trialU[s];
+            accV[s] = trialV[s];
+            accD[s] = d2;
+            for (size_t k=0; k<3; ++k) {
+                accP[3*s+k] = eb.out[PS_X+k][i];
+            }
+            if (step == QUERY_NEWTON_STEPS) continue;
+
+            double a = dot3(su, su), b = dot3(su, sv), c = dot3(sv, sv);
+            double gu = dot3(su, r), gv = dot3(sv, r);
+            double ha = a + dot3(r, suu), hb = b + dot3(r, suv), hc = c + dot3(r, svv);
+            double det = ha*hc - hb*hb;
+            if (!(ha > 0.0 && det > 1.0e-12*ha*hc)) {
+                ha = a;
+                hb = b;
+                hc = c;
+                det = a*c - b*b;
+                if (!(det > 1.0e-12*a*c)) continue;
+            }
+            double du = (hb*gv - hc*gu)/det;
+            double dv = (hb*gu - ha*gv)/det;
+            du = std::min(std::max(du, -maxDu), maxDu);
+            dv = std::min(std::max(dv, -maxDv), maxDv);
+            trialU[s] = std::min(std::max(accU[s] + du, surface.uMin()), surface.uMax());
+            trialV[s] = std::min(std::max(accV[s] + dv, surface.vMin()), surface.vMax());
+            if (std::fabs(trialU[s] - accU[s]) > minStep*maxDu ||
+                std::fabs(trialV[s] - accV[s]) > minStep*maxDv) {
+                still.push_back(s);
+            }
+        }
+        active.swap(still);
+    }
+    for (size_t s=0; s<n; ++s) {
+        seeds[s].u = accU[s];
+        seeds[s].v = accV[s];
+        seeds[s].t = std::sqrt(accD[s]);
+        for (size_t k=0; k<3; ++k) {
+            seeds[s].point[k] = accP[3*s+k];
+        }
+    }
+}
+
+void SurfaceQuery::closestPoints(const double *points, size_t n, SurfaceHit *hits) const {
+    parallelFor(0, n, QUERY_CHUNK, [&](size_t lo, size_t hi) {
+        std::vector<Seed> seeds;
+        for (size_t q=lo; q<hi; ++q) {
+            closestSeeds(q, points + 3*q, seeds, hits[q]);
+        }
+        refineClosest(points, seeds);
+        for (size_t s=0; s<seeds.size(); ++s) {
+            SurfaceHit &hit = hits[seeds[s].query];
+            if (seeds[s].t < hit.t) {
+                hit.patch = patchAt(seeds[s].u, seeds[s].v);
+                hit.u = seeds[s].u;
+                hit.v = seeds[s].v;
+                hit.t = seeds[s].t;
+                for (size_t k=0; k<3; ++k) {
+                    hit.point[k] = seeds[s].point[k];
+                }
+            }
+        }
+    });
+}
+
+void SurfaceQuery::intersectRays(const double *origins, const double *dirs, size_t n,
+                                 SurfaceHit *hits, double tMax) const {
+    const double tol = 1.0e-9*scale;
+    parallelFor(0, n, QUERY_CHUNK, [&](size_t lo, size_t hi) {
+        std::vector<Seed> seeds;
+        std::vector<double> residual;
+        for (size_t q=lo; q<hi; ++q) {
+            hits[q].patch = -1;
+            hits[q].t = HUGE_VAL;
+            const double *d = dirs + 3*q;
+            double len = std::sqrt(dot3(d, d));
+            if (!(len > 0.0)) continue;
+            // Let seeds start a little behind the origin; hits are still
+            // only reported in [0, tMax]
+            double slack = 0.1*scale/len;
+            raySeeds(q, origins + 3*q, d, -slack, tMax + slack, seeds);
+        }
+        refineCrossings([&](size_t q, double t, double *pos, double *deriv) {
+                const double *o = origins + 3*q, *d = dirs + 3*q;
+                for (size_t k=0; k<3; ++k) {
+                    pos[k] = o[k] + t*d[k];
+                    deriv[k] = d[k];
+                }
+            }, tol, seeds, residual);
+        for (size_t s=0; s<seeds.size(); ++s) {
+            SurfaceHit &hit = hits[seeds[s].query];
+            double t = seeds[s].t;
+            if (!(residual[s] <= tol) || t < 0.0 || t > tMax || t >= hit.t) continue;
+            hit.patch = patchAt(seeds[s].u, seeds[s].v);
+            hit.u = seeds[s].u;
+            hit.v = seeds[s].v;
+            hit.t = t;
+            for (size_t k=0; k<3; ++k) {
+                hit.point[k] = seeds[s].point[k];
+            }
+        }
+    });
+}
+
+void SurfaceQuery::intersectCurve(const SpaceCurve &curve, double s0, double s1, size_t segments,
+                                  std::vector<SurfaceHit> &hits) const {
+    hits.clear();
+    if (segments == 0) segments = 1;
+    const double ds = (s1 - s0)/segments;
+    std::vector<double> pts(3*(segments + 1));
+    double deriv[3];
+    for (size_t i=0; i<=segments; ++i) {
+        curve(s0 + ds*i, &pts[3*i], deriv);
+    }
+
+    const double tol = 1.0e-9*scale;
+    // Crossings at the very ends of the range may converge just outside it
+    const double sLo = std::min(s0, s1) - 1.0e-9*std::fabs(s1 - s0);
+    const double sHi = std::max(s0, s1) + 1.0e-9*std::fabs(s1 - s0);
+    const size_t numChunks = (segments + SEGMENT_CHUNK - 1)/SEGMENT_CHUNK;
+    std::vector<std::vector<SurfaceHit> > found(numChunks);
+    parallelFor(0, segments, SEGMENT_CHUNK, [&](size_t lo, size_t hi) {
+        std::vector<Seed> seeds;
+        std::vector<double> residual;
+        for (size_t i=lo; i<hi; ++i) {
+            const double *a = &pts[3*i], *b = &pts[3*i+3];
+            double d[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            size_t first = seeds.size();
+            raySeeds(i, a, d, -SEED_SLACK, 1.0 + SEED_SLACK, seeds);
+            for (size_t s=first; s<seeds.size(); ++s) {
+                seeds[s].t = s0 + ds*(i + seeds[s].t);
+            }
+        }
+        refineCrossings([&](size_t, double s, double *pos, double *der) {
+                curve(s, pos, der);
+            }, tol, seeds, residual);
+
+        std::vector<SurfaceHit> &out = found[lo/SEGMENT_CHUNK];
+        for (size_t s=0; s<seeds.size(); ++s) {
+            if (!(residual[s] <= tol) || seeds[s].t < sLo || seeds[s].t > sHi) continue;
+            SurfaceHit hit;
+            hit.patch = patchAt(seeds[s].u, seeds[s].v);
+            hit.u = seeds[s].u;
+            hit.v = seeds[s].v;
+            hit.t = std::min(std::max(seeds[s].t, std::min(s0, s1)), std::max(s0, s1));
+            for (size_t k=0; k<3; ++k) {
+                hit.point[k] = seeds[s].point[k];
+            }
+            out.push_back(hit);
+        }
+    });
+
+    std::vector<SurfaceHit> all;
+    for (size_t c=0; c<numChunks; ++c) {
+        all.insert(all.end(), found[c].begin(), found[c].end());
+    }
+    std::sort(all.begin(), all.end(),
+              [](const SurfaceHit &a, const SurfaceHit &b) { return a.t < b.t; });
+
+    // Neighbouring seeds usually converge to the same crossing
+    const double sameS = 1.0e-7*(sHi - sLo);
+    const double samePoint = 1.0e-6*scale;
+    for (size_t i=0; i<all.size(); ++i) {
+        if (!hits.empty()) {
+            const SurfaceHit &last = hits.back();
+            double e[3] = { all[i].point[0] - last.point[0], all[i].point[1] - last.point[1],
+                            all[i].point[2] - last.point[2] };
+            if (all[i].t - last.t <= sameS && std::sqrt(dot3(e, e)) <= samePoint) continue;
+        }
+        hits.push_back(all[i]);
+    }
+}
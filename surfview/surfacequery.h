@@ -0,0 +1,140 @@
+/*
+  surfacequery.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef SURFACEQUERY_H
+#define SURFACEQUERY_H
+
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include "parametricsurface.h"
+
+// Grid cells along each side of a patch
+static const size_t QUERY_PATCH_CELLS=4;
+
+// Newton iterations used to refine each candidate
+static const size_t QUERY_NEWTON_STEPS=16;
+
+// Most candidates followed up per query
+static const size_t QUERY_MAX_SEEDS=32;
+
+/*!
+  Where a query met the surface.  t is the ray or curve parameter for
+  intersections and the distance for closest point queries.  patch is
+  -1 if nothing was found.
+*/
+struct SurfaceHit {
+    int patch;
+    double u;
+    double v;
+    double point[3];
+    double t;
+};
+
+/*!
+  A curve in space for curve/surface intersection: fills pos and deriv
+  with C(s) and C'(s).  Called from several threads at once.
+*/
+typedef std::function<void (double s, double *pos, double *deriv)> SpaceCurve;
+
+/*!
+  Bulk geometric queries against a parametric surface.
+
+  The domain is cut into patches of QUERY_PATCH_CELLS x QUERY_PATCH_CELLS
+  grid cells.  Each patch gets a bounding box, padded by how far the
+  surface bulges away from its grid between samples, and the boxes go
+  in a bounding volume hierarchy.  Queries walk the hierarchy, take
+  starting points from the sampled grid in the patches that survive,
+  and polish them with Newton iterations in (u,v) on the exact surface.
+  Candidates for a whole batch of queries are iterated together so each
+  step is one batched evaluation.
+
+  Batched queries are split across threads.  The hierarchy keeps its own
+  copy of the surface, so it stays valid if the original changes.
+*/
+class SurfaceQuery {
+public:
+    SurfaceQuery();
+
+    void build(const ParametricSurface &surf, size_t patchesU = 32, size_t patchesV = 32);
+
+    bool empty() const { return nodes.empty(); }
+    size_t numPatches() const { return nPatchU*nPatchV; }
+    void patchDomain(size_t patch, double &u0, double &u1, double &v0, double &v1) const;
+
+    // Closest surface points to n points, xyz each
+    void closestPoints(const double *points, size_t n, SurfaceHit *hits) const;
+
+    // First hit along each of n rays with t in [0, tMax], xyz each
+    void intersectRays(const double *origins, const double *dirs, size_t n,
+                       SurfaceHit *hits, double tMax = HUGE_VAL) const;
+
+    /*!
+      Every crossing of curve over [s0, s1] with the surface, in order of
+      s.  The curve is sampled into segments pieces to find candidates,
+      so it needs enough of them to follow its shape.
+    */
+    void intersectCurve(const SpaceCurve &curve, double s0, double s1, size_t segments,
+                        std::vector<SurfaceHit> &hits) const;
+
+private:
+    struct BvhNode {
+        double lo[3];
+        double hi[3];
+        // Leaves list count patches from first in patchOrder.  Inner
+        // nodes have count 0, their left child next and right child at right.
+        int first;
+        int count;
+        int right;
+    };
+
+    struct Seed {
+        size_t query;
+        double u, v, t;
+        double point[3];
+    };
+
+    int buildNode(size_t first, size_t count, std::vector<double> &centroids);
+    const double *gridPoint(size_t i, size_t j) const { return &grid[3*(j*gridU + i)]; }
+    int patchAt(double u, double v) const;
+
+    void raySeeds(size_t query, const double *o, const double *d, double tLo, double tHi,
+                  std::vector<Seed> &seeds) const;
+    void closestSeeds(size_t query, const double *p, std::vector<Seed> &seeds,
+                      SurfaceHit &nearest) const;
+
+    // Newton on S(u,v) = target(t), which fills in the target and its derivative
+    template <class Target>
+    void refineCrossings(Target target, double tol, std::vector<Seed> &seeds,
+                         std::vector<double> &residual) const;
+    void refineClosest(const double *points, std::vector<Seed> &seeds) const;
+
+    ParametricSurface surface;
+    size_t nPatchU, nPatchV;
+    size_t gridU, gridV;
+    double cellDu, cellDv;
+    double scale;
+
+    std::vector<double> grid;
+    std::vector<double> boxes;
+    std::vector<BvhNode> nodes;
+    std::vector<int> patchOrder;
+};
+
+#endif
@@ -18,96 +18,357 @@
 
 #include <QMainWindow>
 
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <stdexcept>
 
 #include "surfaceviewer.h"
 
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#define GL_TIMEOUT_EXPIRED 0x911B
+#endif
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+namespace {
+
+/*
+  The shaders share one preamble, added by initShaders, which sets the
+  version and defines NUM_LIGHTS, MAX_MATERIALS and ZEBRA_STRIPES.
+
+  The vertex shader takes the model transform from a per-instance
+  attribute.  Normals are transformed by its upper 3x3, which is right
+  for rigid motions with uniform scale.  curvatureMask picks the
+  curvature being shown out of the vertex's four.
+*/
+const char *surfaceVertexShader =
+    "in mat4 instanceMatrix;\n"
+    "in vec4 curvature;\n"
+    "uniform vec4 curvatureMask;\n"
+    "out vec3 vPos;\n"
+    "out vec3 vNormal;\n"
+    "out float vCurvature;\n"
+    "void main() {\n"
+    "    vec4 pos = instanceMatrix * gl_Vertex;\n"
+    "    vPos = pos.xyz;\n"
+    "    vNormal = mat3(instanceMatrix) * gl_Normal;\n"
+    "    vCurvature = dot(curvature, curvatureMask);\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * pos;\n"
+    "}\n";
+
+/*
+  Gives each corner its distance in pixels from the opposite edge, so
+  the fragment shader can draw outlines without a second pass.
+*/
+const char *surfaceGeometryShader =
+    "layout(triangles) in;\n"
+    "layout(triangle_strip, max_vertices=3) out;\n"
+    "uniform vec2 viewport;\n"
+    "in vec3 vPos[];\n"
+    "in vec3 vNormal[];\n"
+    "in float vCurvature[];\n"
+    "out vec3 gPos;\n"
+    "out vec3 gNormal;\n"
+    "out float gCurvature;\n"
+    "noperspective out vec3 gEdge;\n"
+    "void main() {\n"
+    "    vec2 p[3];\n"
+    "    for (int i=0; i<3; ++i) {\n"
+    "        p[i] = 0.5*viewport*gl_in[i].gl_Position.xy/gl_in[i].gl_Position.w;\n"
+    "    }\n"
+    "    vec2 e0 = p[2] - p[1];\n"
+    "    vec2 e1 = p[2] - p[0];\n"
+    "    vec2 e2 = p[1] - p[0];\n"
+    "    float area = abs(e1.x*e2.y - e1.y*e2.x);\n"
+    "    vec3 h = vec3(area/length(e0), area/length(e1), area/length(e2));\n"
+    "    for (int i=0; i<3; ++i) {\n"
+    "        gl_Position = gl_in[i].gl_Position;\n"
+    "        gPos = vPos[i];\n"
+    "        gNormal = vNormal[i];\n"
+    "        gCurvature = vCurvature[i];\n"
+    "        gEdge = vec3(0.0);\n"
+    "        gEdge[i] = h[i];\n"
+    "        EmitVertex();\n"
+    "    }\n"
+    "    EndPrimitive();\n"
+    "}\n";
+
+/*
+  Two sided per-pixel lighting with the same terms as the fixed function
+  pipeline, then the outline blended over the top.  fillMode has bit 0
+  set to fill triangles and bit 1 to outline them.
+
+  shading 1 replaces the material's diffuse colour with a blue, white,
+  red map of the curvature, scaled so curvatureScale*curvature runs -1
+  to 1.  shading 2 draws unlit zebra stripes from the reflected view
+  direction, which show kinks in the surface as kinks in the stripes.
+*/
+const char *surfaceFragmentShader =
+    "layout(std140) uniform Lights {\n"
+    "    vec4 lightPosition[NUM_LIGHTS];\n"
+    "    vec4 lightColor[NUM_LIGHTS];\n"
+    "    vec4 modelAmbient;\n"
+    "};\n"
+    "struct Material {\n"
+    "    vec4 diffuse;\n"
+    "    vec4 specular;\n"
+    "    vec4 ambient;\n"
+    "    vec4 shininess;\n"
+    "};\n"
+    "layout(std140) uniform Materials {\n"
+    "    Material materials[MAX_MATERIALS];\n"
+    "};\n"
+    "uniform int material;\n"
+    "uniform vec4 outlineColor;\n"
+    "uniform float outlineWidth;\n"
+    "uniform int fillMode;\n"
+    "uniform int shading;\n"
+    "uniform float curvatureScale;\n"
+    "in vec3 gPos;\n"
+    "in vec3 gNormal;\n"
+    "in float gCurvature;\n"
+    "noperspective in vec3 gEdge;\n"
+    "void main() {\n"
+    "    float edge = min(gEdge.x, min(gEdge.y, gEdge.z));\n"
+    "    float outline = ((fillMode & 2) != 0) ? 1.0 - smoothstep(outlineWidth - 1.0, outlineWidth, edge) : 0.0;\n"
+    "    if ((fillMode & 1) == 0) {\n"
+    "        if (outline < 0.5) discard;\n"
+    "        gl_FragColor = outlineColor;\n"
+    "        return;\n"
+    "    }\n"
+    "    Material m = materials[material];\n"
+    "    vec3 n = normalize(gNormal);\n"
+    "    if (!gl_FrontFacing) n = -n;\n"
+    "    if (shading == 2) {\n"
+    "        vec3 r = reflect(vec3(0.0, 0.0, -1.0), n);\n"
+    "        float s = ZEBRA_STRIPES*0.5*(r.y + 1.0);\n"
+    "        float w = max(fwidth(s), 1.0e-4);\n"
+    "        float stripe = smoothstep(-w, w, abs(fract(s) - 0.5) - 0.25);\n"
+    "        gl_FragColor = vec4(mix(vec3(stripe), outlineColor.rgb, outline), 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    vec3 diffuse = m.diffuse.rgb;\n"
+    "    if (shading == 1) {\n"
+    "        float c = clamp(gCurvature*curvatureScale, -1.0, 1.0);\n"
+    "        diffuse = (c < 0.0) ? mix(vec3(1.0), vec3(0.2, 0.3, 1.0), -c)\n"
+    "                            : mix(vec3(1.0), vec3(1.0, 0.2, 0.1), c);\n"
+    "    }\n"
+    "    vec3 color = modelAmbient.rgb*m.ambient.rgb;\n"
+    "    for (int i=0; i<NUM_LIGHTS; ++i) {\n"
+    "        vec3 l = normalize(lightPosition[i].xyz - gPos*lightPosition[i].w);\n"
+    "        float d = max(dot(n, l), 0.0);\n"
+    "        color += d*lightColor[i].rgb*diffuse;\n"
+    "        if (d > 0.0) {\n"
+    "            float h = max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0);\n"
+    "            color += pow(h, m.shininess.x)*lightColor[i].rgb*m.specular.rgb;\n"
+    "        }\n"
+    "    }\n"
+    "    gl_FragColor = vec4(mix(color, outlineColor.rgb, outline), m.diffuse.a);\n"
+    "}\n";
+
+/*
+  GLSL 1.20 versions of the shaders, for drivers with instancing but
+  without geometry shaders or uniform blocks.  Lights and materials come
+  from the fixed function state, and outlines are a second pass drawn
+  with glPolygonMode(GL_LINE), which sets fillMode to 2.
+*/
+const char *legacyVertexShader =
+    "attribute mat4 instanceMatrix;\n"
+    "attribute vec4 curvature;\n"
+    "uniform vec4 curvatureMask;\n"
+    "varying vec3 vPos;\n"
+    "varying vec3 vNormal;\n"
+    "varying float vCurvature;\n"
+    "void main() {\n"
+    "    vec4 pos = instanceMatrix * gl_Vertex;\n"
+    "    vPos = pos.xyz;\n"
+    "    vNormal = mat3(instanceMatrix) * gl_Normal;\n"
+    "    vCurvature = dot(curvature, curvatureMask);\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * pos;\n"
+    "}\n";
+
+const char *legacyFragmentShader =
+    "uniform vec4 outlineColor;\n"
+    "uniform int fillMode;\n"
+    "uniform int shading;\n"
+    "uniform float curvatureScale;\n"
+    "varying vec3 vPos;\n"
+    "varying vec3 vNormal;\n"
+    "varying float vCurvature;\n"
+    "void main() {\n"
+    "    if (fillMode == 2) {\n"
+    "        gl_FragColor = outlineColor;\n"
+    "        return;\n"
+    "    }\n"
+    "    vec3 n = normalize(vNormal);\n"
+    "    if (!gl_FrontFacing) n = -n;\n"
+    "    if (shading == 2) {\n"
+    "        vec3 r = reflect(vec3(0.0, 0.0, -1.0), n);\n"
+    "        float s = float(ZEBRA_STRIPES)*0.5*(r.y + 1.0);\n"
+    "        float w = max(fwidth(s), 1.0e-4);\n"
+    "        gl_FragColor = vec4(vec3(smoothstep(-w, w, abs(fract(s) - 0.5) - 0.25)), 1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    vec3 diffuse = gl_FrontMaterial.diffuse.rgb;\n"
+    "    if (shading == 1) {\n"
+    "        float c = clamp(vCurvature*curvatureScale, -1.0, 1.0);\n"
+    "        diffuse = (c < 0.0) ? mix(vec3(1.0), vec3(0.2, 0.3, 1.0), -c)\n"
+    "                            : mix(vec3(1.0), vec3(1.0, 0.2, 0.1), c);\n"
+    "    }\n"
+    "    vec3 color = gl_LightModel.ambient.rgb*gl_FrontMaterial.ambient.rgb;\n"
+    "    for (int i=0; i<NUM_LIGHTS; ++i) {\n"
+    "        vec4 p = gl_LightSource[i].position;\n"
+    "        vec3 l = normalize(p.xyz - vPos*p.w);\n"
+    "        float d = max(dot(n, l), 0.0);\n"
+    "        color += d*gl_LightSource[i].diffuse.rgb*diffuse;\n"
+    "        if (d > 0.0) {\n"
+    "            float h = max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0);\n"
+    "            color += pow(h, gl_FrontMaterial.shininess)*gl_LightSource[i].specular.rgb*\n"
+    "                gl_FrontMaterial.specular.rgb;\n"
+    "        }\n"
+    "    }\n"
+    "    gl_FragColor = vec4(color, gl_FrontMaterial.diffuse.a);\n"
+    "}\n";
+
+/*!
+  Inverts the affine column major transform m into inv, also column
+  major with an implied last row of 0 0 0 1.  Returns false if it's
+  singular.
+*/
+bool invertAffine(const float *m, double inv[16]) {
+    double a = m[0], b = m[4], c = m[8];
+    double d = m[1], e = m[5], f = m[9];
+    double g = m[2], h = m[6], k = m[10];
+    double c0 = e*k - f*h, c1 = f*g - d*k, c2 = d*h - e*g;
+    double det = a*c0 + b*c1 + c*c2;
+    if (det == 0.0) return false;
+    double s = 1.0/det;
+    inv[0] = s*c0;  inv[4] = s*(c*h - b*k);  inv[8] = s*(b*f - c*e);
+    inv[1] = s*c1;  inv[5] = s*(a*k - c*g);  inv[9] = s*(c*d - a*f);
+    inv[2] = s*c2;  inv[6] = s*(b*g - a*h);  inv[10] = s*(a*e - b*d);
+    for (size_t r=0; r<3; ++r) {
+        inv[12+r] = -(inv[r]*m[12] + inv[4+r]*m[13] + inv[8+r]*m[14]);
+        inv[3+4*r] = 0.0;
+    }
+    inv[15] = 1.0;
+    return true;
+}
+
+}
+
 /*!
   Initializes the object and sets the OpenGL format.
 */
-SurfaceViewer::SurfaceViewer(QWidget*) : rotationX(0.0), rotationY(0.0),
+SurfaceViewer::SurfaceViewer(QWidget*) : lightsDirty(true), instanceBuffer(QGLBuffer::VertexBuffer),
+                                 instanceVersion(0), instanceProgram(0), instanceMatrixLoc(-1),
+                                 drawElementsInstanced(0), vertexAttribDivisor(0), drawCalls(0),
+                                 lightBuffer(QGLBuffer::VertexBuffer),
+                                 materialBuffer(QGLBuffer::VertexBuffer), materialVersion(0),
+                                 materialLoc(-1), outlineColorLoc(-1), outlineWidthLoc(-1),
+                                 fillModeLoc(-1), viewportLoc(-1), shadingLoc(-1),
+                                 curvatureMaskLoc(-1), curvatureScaleLoc(-1), curvatureLoc(-1),
+                                 uniformsDirty(true), legacyInstancing(false),
+                                 rotationX(0.0), rotationY(0.0),
                                  rotationZ(0.0), translate(250.0),
-                                 num_tris(0), verts(0), norms(0), indices(0), showPolygons(true), showFacets(true) {
+                                 surfaceType(PARAMETRIC_SURFACE), dirty(true), queryDirty(true),
+                                 queryTime(0.0),
+                                 animating(false), animSlot(-1), animTime(0.0), bufferStorage(0),
+                                 mapBufferRange(0), fenceSync(0), clientWaitSync(0), deleteSync(0),
+                                 shading(SHADE_MATERIAL), meshBias(0), fullTriangles(0),
+                                 nextTimer(0), activeTimer(-1), genQueries(0), deleteQueries(0),
+                                 beginQuery(0), endQuery(0), getQueryObjectuiv(0),
+                                 getQueryObjectui64v(0), statsFrames(0), statsBytes(0.0),
+                                 showPolygons(true), showFacets(true), showIsolines(false) {
     QGLFormat theFormat(QGL::DoubleBuffer | QGL::DepthBuffer | QGL::SampleBuffers);
     theFormat.setSamples(2);
     setFormat(theFormat);
+
+    initMaterials();
+    // Repaint when there's something new to show, rather than continuously
+    animator.setFrameCallback([this]() {
+        QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+    });
+    scene.addMesh(Mesh());
+    surfaceObject = scene.addObject(SURFACE_MESH, SURFACE_MATERIAL);
+    governor.setTarget(GOVERNOR_DEFAULT_TARGET);
 }
 
 /*!
   Frees memory and cleans up OpenGL state
 */
 SurfaceViewer::~SurfaceViewer() {
-    for (size_t i=1;i<NUM_LISTS; ++i) {
-        glDeleteLists(dispLists[i], 1);
-    }
-    if (verts) {
-        delete [] verts;
-        verts = 0;
-    }
-    if (norms) {
-        delete [] norms;
-        norms = 0;
+    makeCurrent();
+    // The animator may be writing into mapped buffers
+    stopAnimation();
+    for (size_t i=0; i<meshBuffers.size(); ++i) {
+        meshBuffers[i].vertexBuffer.destroy();
+        meshBuffers[i].indexBuffer.destroy();
     }
-    if (indices) {
-        delete [] indices;
-        indices = 0;
+    instanceBuffer.destroy();
+    lightBuffer.destroy();
+    materialBuffer.destroy();
+    if (deleteQueries) {
+        for (size_t i=0; i<FRAME_TIMERS; ++i) {
+            deleteQueries(1, &frameTimers[i].query);
+        }
     }
 }
 
 /*!
-  Loads the material arrays
+  Sets up the outline material and the scene's materials: the surface's
+  own, followed by the colours for copies
 */
 void SurfaceViewer::initMaterials() {
-    // line material
-    mat_specular[LINE_MAT][0]=0.0f;
-    mat_specular[LINE_MAT][1]=0.0f;
-    mat_specular[LINE_MAT][2]=0.0f;
-    mat_specular[LINE_MAT][3]=1.0f;
-  
-    mat_shininess[LINE_MAT][0]=80.0f;
-
-    mat_diffuse[LINE_MAT][0]=0.0f;
-    mat_diffuse[LINE_MAT][1]=0.0f;
-    mat_diffuse[LINE_MAT][2]=0.0f;
-    mat_diffuse[LINE_MAT][3]=1.0f;
-  
-    mat_ambient[LINE_MAT][0] = 0.0f;
-    mat_ambient[LINE_MAT][1] = 0.0f;
-    mat_ambient[LINE_MAT][2] = 0.0f;
-    mat_ambient[LINE_MAT][3] = 1.0f;
-
-    // surface material
-    mat_specular[SURF_MAT][0]=1.0f;
-    mat_specular[SURF_MAT][1]=1.0f;
-    mat_specular[SURF_MAT][2]=1.0f;
-    mat_specular[SURF_MAT][3]=1.0f;
-
-    mat_shininess[SURF_MAT][0]=100.0f;
-  
-    mat_diffuse[SURF_MAT][0]=0.0f;
-    mat_diffuse[SURF_MAT][1]=0.0f;
-    mat_diffuse[SURF_MAT][2]=1.0f;
-    mat_diffuse[SURF_MAT][3]=1.0f;
-  
-    mat_ambient[SURF_MAT][0] = 0.10f;
-    mat_ambient[SURF_MAT][1] = 0.10f;
-    mat_ambient[SURF_MAT][2] = 0.10f;
-    mat_ambient[SURF_MAT][3] = 1.0f;
+    lineMaterial = makeMaterial(0.0f, 0.0f, 0.0f);
+    for (size_t i=0; i<3; ++i) {
+        lineMaterial.specular[i] = 0.0f;
+        lineMaterial.ambient[i] = 0.0f;
+    }
+    lineMaterial.shininess = 80.0f;
+
+    scene.addMaterial(makeMaterial(0.0f, 0.0f, 1.0f));
+
+    const float colors[NUM_COPY_MATERIALS][3] = { { 0.8f, 0.1f, 0.1f },
+                                                  { 0.1f, 0.6f, 0.1f },
+                                                  { 0.9f, 0.6f, 0.0f },
+                                                  { 0.5f, 0.1f, 0.7f },
+                                                  { 0.0f, 0.6f, 0.7f },
+                                                  { 0.5f, 0.5f, 0.5f } };
+    for (size_t i=0; i<NUM_COPY_MATERIALS; ++i) {
+        scene.addMaterial(makeMaterial(colors[i][0], colors[i][1], colors[i][2]));
+    }
 }
 
 /*!
-  Initializes the light arrays
+  Initializes the light arrays.  They're sent to OpenGL by updateLights
+  on the next paint, and again only if they change.
 */
 void SurfaceViewer::initLights() {
-    light_position[0][0]=0.0f;
-    light_position[0][1]=0.0f;
-    light_position[0][2]=30.0f;
+    float minz = calculateMinimumZoom();
+    light_position[0][0]=2.0*minz;
+    light_position[0][1]=2.0*minz;
+    light_position[0][2]=2.0*minz;
     light_position[0][3]=1.0f;
   
-    light_position[1][0]=0.0f;
-    light_position[1][1]=0.0f;
-    light_position[1][2]=-30.0f;
+    light_position[1][0]=2.0*minz;
+    light_position[1][1]=2.0*minz;
+    light_position[1][2]=-2.0*minz;
     light_position[1][3]=1.0f;
   
     for (size_t i=0;i<NUM_LIGHTS; ++i) {
@@ -125,82 +386,793 @@ void SurfaceViewer::initLights() {
     
     glEnable(GL_LIGHT0);
     glEnable(GL_LIGHT1);
+    lightsDirty = true;
 }
 
-void SurfaceViewer::regenList() {
-    glDeleteLists(dispLists[0], 1);
-    glDeleteLists(dispLists[1], 1);
+void SurfaceViewer::regenMesh() {
+    Mesh mesh;
+    for (size_t i=0; i<NUM_CURVATURES; ++i) {
+        curvatureHistograms[i].clear();
+    }
+    if (surfaceType == IMPLICIT_SURFACE) {
+        implicitSurface.polygonize(mesh);
+    } else if (surfaceType == SUBDIVISION_SURFACE) {
+        subdivSurface.tessellate(mesh);
+    } else {
+        fullTriangles = 2*surface.uSteps()*surface.vSteps();
+        meshBias = governor.lodBias();
+        if (meshBias) {
+            // Each direction gets half the bias, keeping the cells' shape
+            const double scale = std::pow(2.0, 0.5*meshBias);
+            lodSurface = surface;
+            lodSurface.setResolution(
+                std::max(size_t(surface.uSteps()*scale + 0.5), std::min(surface.uSteps(), MIN_LOD_STEPS)),
+                std::max(size_t(surface.vSteps()*scale + 0.5), std::min(surface.vSteps(), MIN_LOD_STEPS)));
+        }
+        typedef std::chrono::steady_clock Clock;
+        const Clock::time_point start = Clock::now();
+        if (showsCurvature()) {
+            tessellatedSurface().tessellate(mesh, true, curvatureHistograms);
+        } else {
+            tessellatedSurface().tessellate(mesh);
+            governor.addRegenSample(mesh.numTris(),
+                                    std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+    }
 
-    dispLists[0] = glGenLists(1);
-    dispLists[1] = glGenLists(1);
-    
-    
-    if (verts) {
-        delete [] verts;
-        verts = 0;
+    // Other surfaces are brought down to the governor's detail by the simplifier
+    size_t budget = simplifier.triangleBudget();
+    if (surfaceType != PARAMETRIC_SURFACE) {
+        fullTriangles = mesh.numTris();
+        meshBias = governor.lodBias();
+        if (meshBias) {
+            size_t lod = governor.scaledTriangles(fullTriangles);
+            budget = budget ? std::min(budget, lod) : lod;
+        }
+    }
+    if ((budget || simplifier.maxError() > 0.0) && !canAnimate()) {
+        MeshSimplifier lodSimplifier(simplifier);
+        lodSimplifier.setTriangleBudget(budget);
+        lodSimplifier.simplify(mesh);
+    }
+    scene.swapMesh(SURFACE_MESH, mesh);
+    layoutCopies(copyIds.size());
+    regenIsolines();
+    // The colour map is scaled to the new curvatures
+    uniformsDirty = true;
+}
+
+/*!
+  Samples the isolines at equal arc lengths, ISOLINE_COUNT in each
+  direction from one edge of the domain to the other
+*/
+void SurfaceViewer::regenIsolines() {
+    isolineVerts.clear();
+    if (!showIsolines || surfaceType != PARAMETRIC_SURFACE || canAnimate()) return;
+
+    std::vector<float> pts;
+    for (size_t dir=ISOLINE_U; dir<=ISOLINE_V; ++dir) {
+        // ISOLINE_U lines run along u, so they're spread over v
+        double lo = (dir == ISOLINE_U) ? surface.vMin() : surface.uMin();
+        double hi = (dir == ISOLINE_U) ? surface.vMax() : surface.uMax();
+        for (size_t i=0; i<ISOLINE_COUNT; ++i) {
+            double value = lo + (hi - lo)*double(i)/double(ISOLINE_COUNT - 1);
+            surface.isolinePoints(dir, value, ISOLINE_POINTS, pts);
+            isolineVerts.insert(isolineVerts.end(), pts.begin(), pts.end());
+        }
+    }
+}
+
+/*!
+  True when the surface should be tessellated with its curvatures
+*/
+bool SurfaceViewer::showsCurvature() const {
+    return shading >= SHADE_GAUSSIAN && shading <= SHADE_MIN && instanceProgram &&
+        surfaceType == PARAMETRIC_SURFACE && !canAnimate();
+}
+
+/*!
+  Puts copies of the surface on a square grid centred on the original,
+  spaced so they don't overlap, each turned a little further about z
+  and in the next colour.  Copies that already exist are moved rather
+  than replaced, so their ids stay valid across rebuilds.
+*/
+void SurfaceViewer::layoutCopies(size_t copies) {
+    while (copyIds.size() > copies) {
+        scene.removeObject(copyIds.back());
+        copyIds.pop_back();
+    }
+    if (copies == 0) return;
+
+    float lo[3] = { 0.0f, 0.0f, 0.0f }, hi[3] = { 0.0f, 0.0f, 0.0f };
+    scene.mesh(SURFACE_MESH).bounds(lo, hi);
+    float spacing = 1.25f*std::max(std::max(hi[0] - lo[0], hi[1] - lo[1]), hi[2] - lo[2]);
+    if (!(spacing > 0.0f)) spacing = 1.0f;
+
+    const size_t side = size_t(std::ceil(std::sqrt(double(copies + 1))));
+    const size_t centre = (side/2)*side + side/2;
+    size_t n = 0;
+    for (size_t cell=0; n < copies; ++cell) {
+        if (cell == centre) continue;
+        float angle = 0.37f*cell;
+        float c = std::cos(angle), s = std::sin(angle);
+        float xf[16] = { c, s, 0.0f, 0.0f,
+                         -s, c, 0.0f, 0.0f,
+                         0.0f, 0.0f, 1.0f, 0.0f,
+                         spacing*(float(cell % side) - float(side/2)),
+                         spacing*(float(cell / side) - float(side/2)), 0.0f, 1.0f };
+        size_t material = 1 + cell % NUM_COPY_MATERIALS;
+        if (n < copyIds.size()) {
+            scene.setTransform(copyIds[n], xf);
+            scene.setObjectMaterial(copyIds[n], material);
+        } else {
+            copyIds.push_back(scene.addObject(SURFACE_MESH, material, xf));
+        }
+        ++n;
+    }
+}
+
+/*!
+  Sets how many copies of the surface to show around it
+*/
+void SurfaceViewer::setSurfaceCopies(size_t copies) {
+    if (copies == copyIds.size()) return;
+    layoutCopies(copies);
+    update();
+}
+
+/*!
+  Turns animation of the parametric surface on or off.  Turning it off
+  leaves the surface showing the time of the last frame drawn.
+*/
+void SurfaceViewer::setAnimating(bool animate) {
+    if (animate == animating) return;
+    animating = animate;
+    if (!animating && animator.running()) {
+        makeCurrent();
+        stopAnimation();
+        surface.setTime(animTime);
+        queryDirty = true;
+    }
+    // Rebuilt either way, since the budget only applies while not animating
+    dirty = true;
+    update();
+}
+
+bool SurfaceViewer::canAnimate() const {
+    return animating && surfaceType == PARAMETRIC_SURFACE && surface.isAnimated();
+}
+
+/*!
+  The parametric surface at the resolution the mesh was built with
+*/
+const ParametricSurface &SurfaceViewer::tessellatedSurface() const {
+    return meshBias ? lodSurface : surface;
+}
+
+/*!
+  Sets up the ring of vertex buffers and starts the animator filling
+  them.  The surface mesh has to be the unsimplified tessellation, so
+  its normal offset and indices match the frames.
+*/
+void SurfaceViewer::startAnimation() {
+    const ParametricSurface &surf = tessellatedSurface();
+    const size_t nv = surf.numVerts();
+    if (scene.mesh(SURFACE_MESH).numVerts() != nv) return;
+
+    const size_t floats = 6*nv;
+    float *ring[ANIMATION_SLOTS];
+    for (size_t i=0; i<ANIMATION_SLOTS; ++i) {
+        AnimationBuffer &buf = animBuffers[i];
+        buf.data = 0;
+        if (bufferStorage) {
+            // Storage is immutable, so each run gets new buffers
+            buf.vertexBuffer.destroy();
+            buf.vertexBuffer.create();
+            buf.vertexBuffer.bind();
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(GL_ARRAY_BUFFER, ptrdiff_t(floats*sizeof(float)), 0, flags);
+            buf.data = (float*)mapBufferRange(GL_ARRAY_BUFFER, 0, ptrdiff_t(floats*sizeof(float)), flags);
+            buf.vertexBuffer.release();
+        }
+        if (!buf.data) {
+            buf.vertexBuffer.destroy();
+            buf.staging.resize(floats);
+            buf.data = &buf.staging[0];
+        }
+        ring[i] = buf.data;
     }
-    if (norms) {
-        delete [] norms;
-        norms = 0;
+    animSlot = -1;
+    animTime = surface.time();
+    animator.start(surf, ring, ANIMATION_SLOTS);
+    statsClock.start();
+    statsFrames = 0;
+    statsBytes = 0.0;
+}
+
+/*!
+  Stops the animator and gives the mapped buffers back to GL
+*/
+void SurfaceViewer::stopAnimation() {
+    if (!animator.running()) return;
+    animator.stop();
+    for (size_t i=0; i<ANIMATION_SLOTS; ++i) {
+        AnimationBuffer &buf = animBuffers[i];
+        if (buf.fence) {
+            deleteSync(buf.fence);
+            buf.fence = 0;
+        }
+        // Deleting a buffer unmaps it
+        buf.vertexBuffer.destroy();
+        buf.data = 0;
+        std::vector<float>().swap(buf.staging);
     }
-    if (indices) {
-        delete [] indices;
-        indices = 0;
+    animSlot = -1;
+    // The unmapped path wrote frames over the surface's own buffer
+    meshBuffers[SURFACE_MESH].version = 0;
+}
+
+/*!
+  Picks up the newest frame the animator has finished, if any.  Mapped
+  slots are drawn in place, and handed back once a fence shows the GPU
+  is done with them; otherwise the frame is copied into the surface's
+  buffer and its slot handed back at once.
+*/
+void SurfaceViewer::updateAnimation() {
+    if (!animator.running()) {
+        startAnimation();
+        if (!animator.running()) return;
     }
 
-    num_tris = 1;
-    verts = new float[num_tris*3*3];
-    norms = new float[num_tris*3*3];
-    indices = new unsigned int[num_tris*3];
+    for (size_t i=0; i<ANIMATION_SLOTS; ++i) {
+        AnimationBuffer &buf = animBuffers[i];
+        if (!buf.fence) continue;
+        GLenum status = clientWaitSync(buf.fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) continue;
+        deleteSync(buf.fence);
+        buf.fence = 0;
+        animator.release(int(i));
+    }
 
-    verts[0] = 0.0f;
-    verts[1] = 0.0f;
-    verts[2] = 0.0f;
+    double t = 0.0;
+    int slot = animator.acquire(&t);
+    if (slot >= 0) {
+        const size_t bytes = 6*tessellatedSurface().numVerts()*sizeof(float);
+        governor.addRegenSample(scene.mesh(SURFACE_MESH).numTris(), animator.lastFrameTime());
+        AnimationBuffer &buf = animBuffers[slot];
+        if (buf.vertexBuffer.isCreated()) {
+            if (animSlot >= 0) {
+                animBuffers[animSlot].fence = fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+            animSlot = slot;
+        } else {
+            MeshBuffers &mesh = meshBuffers[SURFACE_MESH];
+            mesh.vertexBuffer.bind();
+            mesh.vertexBuffer.write(0, buf.data, int(bytes));
+            mesh.vertexBuffer.release();
+            animator.release(slot);
+        }
+        animTime = t;
+        ++statsFrames;
+        statsBytes += bytes;
+    }
 
-    verts[3] = 1.0f;
-    verts[4] = 0.0f;
-    verts[5] = 0.0f;
+    int ms = statsClock.elapsed();
+    if (ms >= 1000) {
+        emit animationStats(1000.0*statsFrames/ms, 1000.0*statsBytes/ms);
+        statsClock.restart();
+        statsFrames = 0;
+        statsBytes = 0.0;
+    }
+}
 
-    verts[6] = 0.0f;
-    verts[7] = 1.0f;
-    verts[8] = 0.0f;
+/*!
+  Looks up the instancing and uniform buffer entry points and compiles
+  the shaders that use them.  Without uniform buffers or geometry shaders
+  the GLSL 1.20 shaders are used instead, and without instancing every
+  object is drawn on its own through the fixed function pipeline.
+*/
+void SurfaceViewer::initShaders() {
+    const QGLContext *ctx = context();
+    bufferStorage = (BufferStorageFunc)ctx->getProcAddress("glBufferStorage");
+    mapBufferRange = (MapBufferRangeFunc)ctx->getProcAddress("glMapBufferRange");
+    fenceSync = (FenceSyncFunc)ctx->getProcAddress("glFenceSync");
+    clientWaitSync = (ClientWaitSyncFunc)ctx->getProcAddress("glClientWaitSync");
+    deleteSync = (DeleteSyncFunc)ctx->getProcAddress("glDeleteSync");
+    if (!mapBufferRange || !fenceSync || !clientWaitSync || !deleteSync) {
+        // Animation falls back to copying each frame
+        bufferStorage = 0;
+    }
 
-    norms[0] = 0.0f;
-    norms[1] = 0.0f;
-    norms[2] = 1.0f;
+    genQueries = (GenQueriesFunc)ctx->getProcAddress("glGenQueries");
+    deleteQueries = (DeleteQueriesFunc)ctx->getProcAddress("glDeleteQueries");
+    beginQuery = (BeginQueryFunc)ctx->getProcAddress("glBeginQuery");
+    endQuery = (EndQueryFunc)ctx->getProcAddress("glEndQuery");
+    getQueryObjectuiv = (GetQueryObjectuivFunc)ctx->getProcAddress("glGetQueryObjectuiv");
+    getQueryObjectui64v = (GetQueryObjectui64vFunc)ctx->getProcAddress("glGetQueryObjectui64v");
+    if (genQueries && deleteQueries && beginQuery && endQuery && getQueryObjectuiv &&
+        getQueryObjectui64v) {
+        for (size_t i=0; i<FRAME_TIMERS; ++i) {
+            genQueries(1, &frameTimers[i].query);
+        }
+    } else {
+        // The governor falls back to timing frames with glFinish
+        genQueries = 0;
+        deleteQueries = 0;
+    }
 
-    norms[3] = 0.0f;
-    norms[4] = 0.0f;
-    norms[5] = 1.0f;
+    drawElementsInstanced = (DrawElementsInstancedFunc)ctx->getProcAddress("glDrawElementsInstanced");
+    if (!drawElementsInstanced) {
+        drawElementsInstanced = (DrawElementsInstancedFunc)ctx->getProcAddress("glDrawElementsInstancedARB");
+    }
+    vertexAttribDivisor = (VertexAttribDivisorFunc)ctx->getProcAddress("glVertexAttribDivisor");
+    if (!vertexAttribDivisor) {
+        vertexAttribDivisor = (VertexAttribDivisorFunc)ctx->getProcAddress("glVertexAttribDivisorARB");
+    }
+    GetUniformBlockIndexFunc getUniformBlockIndex =
+        (GetUniformBlockIndexFunc)ctx->getProcAddress("glGetUniformBlockIndex");
+    UniformBlockBindingFunc uniformBlockBinding =
+        (UniformBlockBindingFunc)ctx->getProcAddress("glUniformBlockBinding");
+    BindBufferBaseFunc bindBufferBase = (BindBufferBaseFunc)ctx->getProcAddress("glBindBufferBase");
+    if (!drawElementsInstanced || !vertexAttribDivisor) {
+        return;
+    }
 
-    norms[6] = 0.0f;
-    norms[7] = 0.0f;
-    norms[8] = 1.0f;
+    QByteArray defines;
+    defines += "#define NUM_LIGHTS " + QByteArray::number(int(NUM_LIGHTS)) + "\n";
+    defines += "#define MAX_MATERIALS " + QByteArray::number(int(MAX_SHADER_MATERIALS)) + "\n";
+    defines += "#define ZEBRA_STRIPES " + QByteArray::number(int(ZEBRA_STRIPES)) + "\n";
+
+    if (getUniformBlockIndex && uniformBlockBinding && bindBufferBase &&
+        QGLShader::hasOpenGLShaders(QGLShader::Geometry, ctx)) {
+        QByteArray preamble = "#version 150 compatibility\n" + defines;
+        instanceProgram = new QGLShaderProgram(this);
+        instanceProgram->setGeometryInputType(GL_TRIANGLES);
+        instanceProgram->setGeometryOutputType(GL_TRIANGLE_STRIP);
+        instanceProgram->setGeometryOutputVertexCount(3);
+        if (!instanceProgram->addShaderFromSourceCode(QGLShader::Vertex, preamble + surfaceVertexShader) ||
+            !instanceProgram->addShaderFromSourceCode(QGLShader::Geometry, preamble + surfaceGeometryShader) ||
+            !instanceProgram->addShaderFromSourceCode(QGLShader::Fragment, preamble + surfaceFragmentShader) ||
+            !instanceProgram->link()) {
+            delete instanceProgram;
+            instanceProgram = 0;
+        }
+    }
+    legacyInstancing = !instanceProgram;
+    if (legacyInstancing) {
+        QByteArray preamble = "#version 120\n" + defines;
+        instanceProgram = new QGLShaderProgram(this);
+        if (!instanceProgram->addShaderFromSourceCode(QGLShader::Vertex, preamble + legacyVertexShader) ||
+            !instanceProgram->addShaderFromSourceCode(QGLShader::Fragment, preamble + legacyFragmentShader) ||
+            !instanceProgram->link()) {
+            delete instanceProgram;
+            instanceProgram = 0;
+            return;
+        }
+    }
+    instanceMatrixLoc = instanceProgram->attributeLocation("instanceMatrix");
+    materialLoc = instanceProgram->uniformLocation("material");
+    outlineColorLoc = instanceProgram->uniformLocation("outlineColor");
+    outlineWidthLoc = instanceProgram->uniformLocation("outlineWidth");
+    fillModeLoc = instanceProgram->uniformLocation("fillMode");
+    viewportLoc = instanceProgram->uniformLocation("viewport");
+    shadingLoc = instanceProgram->uniformLocation("shading");
+    curvatureMaskLoc = instanceProgram->uniformLocation("curvatureMask");
+    curvatureScaleLoc = instanceProgram->uniformLocation("curvatureScale");
+    curvatureLoc = instanceProgram->attributeLocation("curvature");
+    instanceBuffer.create();
+    if (legacyInstancing) return;
+
+    // The blocks stay attached to their binding points for good, so the
+    // buffers are bound once and shared by every draw
+    GLuint prog = instanceProgram->programId();
+    uniformBlockBinding(prog, getUniformBlockIndex(prog, "Lights"), LIGHTS_BINDING);
+    uniformBlockBinding(prog, getUniformBlockIndex(prog, "Materials"), MATERIALS_BINDING);
+
+    lightBuffer.create();
+    lightBuffer.setUsagePattern(QGLBuffer::DynamicDraw);
+    lightBuffer.bind();
+    lightBuffer.allocate(int((2*NUM_LIGHTS + 1)*4*sizeof(float)));
+    lightBuffer.release();
+    materialBuffer.create();
+    materialBuffer.setUsagePattern(QGLBuffer::DynamicDraw);
+    materialBuffer.bind();
+    materialBuffer.allocate(int(MAX_SHADER_MATERIALS*16*sizeof(float)));
+    materialBuffer.release();
+    bindBufferBase(GL_UNIFORM_BUFFER, LIGHTS_BINDING, lightBuffer.bufferId());
+    bindBufferBase(GL_UNIFORM_BUFFER, MATERIALS_BINDING, materialBuffer.bufferId());
+    lightsDirty = true;
+    materialVersion = 0;
+}
 
-    indices[0] = 0;
-    indices[1] = 1;
-    indices[2] = 2;
-    
-    glEnableClientState( GL_VERTEX_ARRAY);
+/*!
+  Copies meshes and instance transforms that changed since the last
+  paint to the GPU
+*/
+void SurfaceViewer::uploadScene() {
+    if (meshBuffers.size() < scene.numMeshes()) {
+        meshBuffers.resize(scene.numMeshes());
+    }
+    for (size_t i=0; i<scene.numMeshes(); ++i) {
+        MeshBuffers &buf = meshBuffers[i];
+        if (buf.version == scene.meshVersion(i)) continue;
+
+        const Mesh &mesh = scene.mesh(i);
+        if (!buf.vertexBuffer.isCreated()) {
+            buf.vertexBuffer.create();
+            buf.indexBuffer.create();
+        }
+        size_t bytes = mesh.verts.size()*sizeof(float);
+        size_t curvBytes = mesh.curvature.size()*sizeof(float);
+        buf.vertexBuffer.bind();
+        buf.vertexBuffer.allocate(int(2*bytes + curvBytes));
+        if (bytes) {
+            buf.vertexBuffer.write(0, &mesh.verts[0], int(bytes));
+            buf.vertexBuffer.write(int(bytes), &mesh.norms[0], int(bytes));
+        }
+        if (curvBytes) {
+            buf.vertexBuffer.write(int(2*bytes), &mesh.curvature[0], int(curvBytes));
+        }
+        buf.vertexBuffer.release();
+        buf.indexBuffer.bind();
+        buf.indexBuffer.allocate(mesh.indices.empty() ? 0 : &mesh.indices[0],
+                                 int(mesh.indices.size()*sizeof(unsigned int)));
+        buf.indexBuffer.release();
+        buf.normalOffset = bytes;
+        buf.curvatureOffset = curvBytes ? 2*bytes : 0;
+        buf.numIndices = mesh.indices.size();
+        buf.version = scene.meshVersion(i);
+    }
+
+    if (instanceProgram && !legacyInstancing && materialVersion != scene.materialVersion()) {
+        // Laid out as the shader's std140 Material struct
+        size_t count = std::min(scene.numMaterials(), MAX_SHADER_MATERIALS);
+        std::vector<float> data(16*count, 0.0f);
+        for (size_t i=0; i<count; ++i) {
+            const SceneMaterial &mat = scene.material(i);
+            std::copy(mat.diffuse, mat.diffuse + 4, &data[16*i]);
+            std::copy(mat.specular, mat.specular + 4, &data[16*i + 4]);
+            std::copy(mat.ambient, mat.ambient + 4, &data[16*i + 8]);
+            data[16*i + 12] = mat.shininess;
+        }
+        if (count) {
+            materialBuffer.bind();
+            materialBuffer.write(0, &data[0], int(data.size()*sizeof(float)));
+            materialBuffer.release();
+        }
+        materialVersion = scene.materialVersion();
+    }
+
+    if (instanceProgram && instanceVersion != scene.instanceVersion()) {
+        const std::vector<float> &xf = scene.instanceTransforms();
+        instanceBuffer.bind();
+        instanceBuffer.allocate(xf.empty() ? 0 : &xf[0], int(xf.size()*sizeof(float)));
+        instanceBuffer.release();
+        instanceVersion = scene.instanceVersion();
+    }
+}
+
+void SurfaceViewer::applyMaterial(const SceneMaterial &mat) {
+    glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat.diffuse);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, mat.specular);
+    glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, mat.shininess);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, mat.ambient);
+}
+
+/*!
+  Points the vertex, normal and index arrays at a mesh's buffers
+*/
+void SurfaceViewer::bindMesh(size_t mesh) {
+    MeshBuffers &buf = meshBuffers[mesh];
+    if (mesh == SURFACE_MESH && animSlot >= 0) {
+        animBuffers[animSlot].vertexBuffer.bind();
+    } else {
+        buf.vertexBuffer.bind();
+    }
+    glVertexPointer(3, GL_FLOAT, 0, 0);
+    glNormalPointer(GL_FLOAT, 0, (const GLvoid*)buf.normalOffset);
+    buf.indexBuffer.bind();
+}
+
+/*!
+  Sends the light arrays to the fixed function pipeline and the shader's
+  uniform block, if they've changed.  The modelview matrix has to be the
+  identity, since fixed function light positions are transformed by it.
+*/
+void SurfaceViewer::updateLights() {
+    if (!lightsDirty) return;
+
+    for (size_t i=0; i<NUM_LIGHTS; ++i) {
+        GLenum light = GLenum(GL_LIGHT0 + i);
+        glLightfv(light, GL_POSITION, light_position[i]);
+        glLightfv(light, GL_DIFFUSE, light_color[i]);
+        glLightfv(light, GL_SPECULAR, light_color[i]);
+    }
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, lmodel_ambient[0]);
+
+    if (instanceProgram && !legacyInstancing) {
+        // Laid out as the shader's std140 Lights block
+        float data[(2*NUM_LIGHTS + 1)*4];
+        for (size_t i=0; i<NUM_LIGHTS; ++i) {
+            std::copy(light_position[i], light_position[i] + 4, &data[4*i]);
+            std::copy(light_color[i], light_color[i] + 4, &data[4*(NUM_LIGHTS + i)]);
+        }
+        std::copy(lmodel_ambient[0], lmodel_ambient[0] + 4, &data[8*NUM_LIGHTS]);
+        lightBuffer.bind();
+        lightBuffer.write(0, data, int(sizeof(data)));
+        lightBuffer.release();
+    }
+    lightsDirty = false;
+}
+
+/*!
+  Draws the scene one batch at a time, each batch with a single
+  instanced call that fills and outlines the triangles together.  The
+  legacy program can't find the edges, so it draws every batch again
+  as lines for the outlines.
+  Batches come sorted by material and then mesh, so each only changes
+  the state that differs from the one before.
+*/
+void SurfaceViewer::drawInstanced() {
+    glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
+    instanceProgram->bind();
+    if (uniformsDirty) {
+        instanceProgram->setUniformValue(outlineColorLoc, lineMaterial.diffuse[0],
+                                         lineMaterial.diffuse[1], lineMaterial.diffuse[2],
+                                         lineMaterial.diffuse[3]);
+        instanceProgram->setUniformValue(outlineWidthLoc, OUTLINE_WIDTH);
+        if (!legacyInstancing) {
+            instanceProgram->setUniformValue(fillModeLoc, (showPolygons ? 1 : 0) | (showFacets ? 2 : 0));
+        }
+        instanceProgram->setUniformValue(viewportLoc, GLfloat(width()), GLfloat(height()));
+        GLfloat mask[NUM_CURVATURES] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        if (shading >= SHADE_GAUSSIAN && shading <= SHADE_MIN) {
+            mask[shading - SHADE_GAUSSIAN] = 1.0f;
+        }
+        instanceProgram->setUniformValue(curvatureMaskLoc, mask[0], mask[1], mask[2], mask[3]);
+        instanceProgram->setUniformValue(curvatureScaleLoc, GLfloat(1.0f/curvatureRange()));
+        uniformsDirty = false;
+    }
+    for (int i=0; i<4; ++i) {
+        instanceProgram->enableAttributeArray(instanceMatrixLoc + i);
+        vertexAttribDivisor(instanceMatrixLoc + i, 1);
+    }
+
+    if (!legacyInstancing) {
+        drawBatches(false);
+    } else {
+        if (showPolygons) {
+            instanceProgram->setUniformValue(fillModeLoc, 1);
+            drawBatches(false);
+        }
+        if (showFacets) {
+            // Same batches, drawn as outlines
+            instanceProgram->setUniformValue(fillModeLoc, 2);
+            glLineWidth(OUTLINE_WIDTH);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            drawBatches(true);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        }
+    }
+
+    for (int i=0; i<4; ++i) {
+        vertexAttribDivisor(instanceMatrixLoc + i, 0);
+        instanceProgram->disableAttributeArray(instanceMatrixLoc + i);
+    }
+    instanceProgram->disableAttributeArray(curvatureLoc);
+    instanceProgram->release();
+    QGLBuffer::release(QGLBuffer::VertexBuffer);
+    QGLBuffer::release(QGLBuffer::IndexBuffer);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
 
-    glNewList(dispLists[0], GL_COMPILE);        
-    glVertexPointer( 3, GL_FLOAT, 0, verts );
-    glNormalPointer( GL_FLOAT, 0, norms );
-    glDrawElements( GL_TRIANGLES, 3*num_tris, GL_UNSIGNED_INT, indices);
-    glEndList();
+/*!
+  Issues one instanced call per batch with instanceProgram bound.  The
+  legacy program takes its material from the fixed function state,
+  which outlines leave alone.
+*/
+void SurfaceViewer::drawBatches(bool outlines) {
+    const std::vector<SceneBatch> &batches = scene.batches();
+    size_t material = scene.numMaterials();
+    size_t mesh = scene.numMeshes();
+    for (size_t b=0; b<batches.size(); ++b) {
+        const SceneBatch &batch = batches[b];
+        if (meshBuffers[batch.mesh].numIndices == 0) continue;
+        if (batch.material != material) {
+            if (!legacyInstancing) {
+                instanceProgram->setUniformValue(materialLoc, int(batch.material));
+            } else if (!outlines) {
+                applyMaterial(scene.material(batch.material));
+            }
+            material = batch.material;
+        }
+        if (batch.mesh != mesh) {
+            bindMesh(batch.mesh);
+            mesh = batch.mesh;
+            // Meshes without curvatures keep their material
+            size_t offset = meshBuffers[mesh].curvatureOffset;
+            int mode = (shading == SHADE_ZEBRA) ? 2 : (offset && shading != SHADE_MATERIAL) ? 1 : 0;
+            if (offset) {
+                instanceProgram->enableAttributeArray(curvatureLoc);
+                instanceProgram->setAttributeBuffer(curvatureLoc, GL_FLOAT, int(offset),
+                                                    int(NUM_CURVATURES));
+            } else {
+                instanceProgram->disableAttributeArray(curvatureLoc);
+                instanceProgram->setAttributeValue(curvatureLoc, 0.0f, 0.0f, 0.0f, 0.0f);
+            }
+            instanceProgram->setUniformValue(shadingLoc, mode);
+        }
+        // Each column of the matrix is its own attribute
+        instanceBuffer.bind();
+        for (int i=0; i<4; ++i) {
+            instanceProgram->setAttributeBuffer(instanceMatrixLoc + i, GL_FLOAT,
+                                                int(sizeof(float)*(16*batch.first + 4*i)), 4,
+                                                int(16*sizeof(float)));
+        }
+        drawElementsInstanced(GL_TRIANGLES, GLsizei(meshBuffers[mesh].numIndices),
+                              GL_UNSIGNED_INT, 0, GLsizei(batch.count));
+        ++drawCalls;
+    }
+}
 
-        
-    glNewList(dispLists[1], GL_COMPILE);
-    glLineWidth(1.5);
-    for (size_t i=0;i<num_tris;++i) {
-        glDrawElements( GL_LINE_LOOP, 3, GL_UNSIGNED_INT, indices+3*i);
+/*!
+  Triangles the batches draw, counting every instance
+*/
+size_t SurfaceViewer::drawnTriangles() const {
+    const std::vector<SceneBatch> &batches = scene.batches();
+    size_t tris = 0;
+    for (size_t b=0; b<batches.size(); ++b) {
+        tris += meshBuffers[batches[b].mesh].numIndices/3*batches[b].count;
     }
-    glEndList();
+    return tris;
+}
 
+/*!
+  Starts timing the frame's drawing for the governor.  A timer query
+  measures the GPU's time without waiting for it; if there are none, or
+  they're all still in flight, this frame isn't timed.
+*/
+void SurfaceViewer::startFrameTimer() {
+    activeTimer = -1;
+    if (!governor.enabled()) return;
+    if (genQueries) {
+        FrameTimer &timer = frameTimers[nextTimer];
+        if (timer.pending) return;
+        beginQuery(GL_TIME_ELAPSED, timer.query);
+        activeTimer = int(nextTimer);
+        nextTimer = (nextTimer + 1) % FRAME_TIMERS;
+    } else {
+        frameStart = std::chrono::steady_clock::now();
+    }
+}
+
+/*!
+  Stops timing the frame.  Without timer queries the only way to know
+  when the GPU is done is to wait for it, which costs some overlap
+  between frames but only while the governor is on.
+*/
+void SurfaceViewer::finishFrameTimer() {
+    if (!governor.enabled()) return;
+    if (genQueries) {
+        if (activeTimer < 0) return;
+        endQuery(GL_TIME_ELAPSED);
+        frameTimers[activeTimer].pending = true;
+        frameTimers[activeTimer].triangles = drawnTriangles();
+        activeTimer = -1;
+    } else {
+        glFinish();
+        std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - frameStart;
+        governor.addDrawSample(drawnTriangles(), ms.count());
+    }
+}
+
+/*!
+  Collects finished frame timings and lets the governor judge them.  A
+  change of detail rebuilds the mesh on this paint.
+*/
+void SurfaceViewer::updateGovernor() {
+    if (!governor.enabled()) return;
+    if (genQueries) {
+        for (size_t i=0; i<FRAME_TIMERS; ++i) {
+            FrameTimer &timer = frameTimers[i];
+            if (!timer.pending) continue;
+            GLuint available = 0;
+            getQueryObjectuiv(timer.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+            unsigned long long ns = 0;
+            getQueryObjectui64v(timer.query, GL_QUERY_RESULT, &ns);
+            timer.pending = false;
+            governor.addDrawSample(timer.triangles, 1.0e-6*ns);
+        }
+    }
+
+    const size_t instances = 1 + copyIds.size();
+    if (fullTriangles && governor.update(fullTriangles, instances, canAnimate())) {
+        dirty = true;
+        emit detailChanged(governor.lodBias(),
+                           governor.predict(governor.lodBias(), fullTriangles, instances, canAnimate()));
+    }
+}
+
+/*!
+  Draws the objects one at a time through the fixed function pipeline,
+  in batch order.  Used for picking, since a name can't change in the
+  middle of an instanced draw, and when instancing isn't available.
+*/
+void SurfaceViewer::drawObjects(bool lines, bool names) {
+    const std::vector<SceneBatch> &batches = scene.batches();
+    const std::vector<float> &xf = scene.instanceTransforms();
+    const std::vector<int> &ids = scene.instanceIds();
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glMatrixMode(GL_MODELVIEW);
+
+    size_t material = scene.numMaterials();
+    size_t mesh = scene.numMeshes();
+    for (size_t b=0; b<batches.size(); ++b) {
+        const SceneBatch &batch = batches[b];
+        if (meshBuffers[batch.mesh].numIndices == 0) continue;
+        if (!lines && batch.material != material) {
+            applyMaterial(scene.material(batch.material));
+            material = batch.material;
+        }
+        if (batch.mesh != mesh) {
+            bindMesh(batch.mesh);
+            mesh = batch.mesh;
+        }
+        for (size_t i=batch.first; i<batch.first + batch.count; ++i) {
+            if (names) glLoadName(ids[i]);
+            glPushMatrix();
+            glMultMatrixf(&xf[16*i]);
+            glDrawElements(GL_TRIANGLES, GLsizei(meshBuffers[mesh].numIndices),
+                           GL_UNSIGNED_INT, 0);
+            glPopMatrix();
+            ++drawCalls;
+        }
+    }
+
+    QGLBuffer::release(QGLBuffer::VertexBuffer);
+    QGLBuffer::release(QGLBuffer::IndexBuffer);
     glDisableClientState(GL_NORMAL_ARRAY);
     glDisableClientState(GL_VERTEX_ARRAY);
 }
+
+/*!
+  Draws the isolines as line strips over every object showing the
+  surface.  The surface's fill is pushed back by the polygon offset, so
+  the lines aren't hidden by it.
+*/
+void SurfaceViewer::drawIsolines() {
+    if (isolineVerts.empty()) return;
+    const std::vector<SceneBatch> &batches = scene.batches();
+    const std::vector<float> &xf = scene.instanceTransforms();
+    const GLsizei numLines = GLsizei(isolineVerts.size()/(3*ISOLINE_POINTS));
+
+    glDisable(GL_LIGHTING);
+    glColor4fv(lineMaterial.diffuse);
+    glLineWidth(OUTLINE_WIDTH);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, &isolineVerts[0]);
+    glMatrixMode(GL_MODELVIEW);
+    for (size_t b=0; b<batches.size(); ++b) {
+        const SceneBatch &batch = batches[b];
+        if (batch.mesh != SURFACE_MESH) continue;
+        for (size_t i=batch.first; i<batch.first + batch.count; ++i) {
+            glPushMatrix();
+            glMultMatrixf(&xf[16*i]);
+            for (GLsizei line=0; line<numLines; ++line) {
+                glDrawArrays(GL_LINE_STRIP, line*GLsizei(ISOLINE_POINTS), GLsizei(ISOLINE_POINTS));
+            }
+            glPopMatrix();
+            ++drawCalls;
+        }
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glEnable(GL_LIGHTING);
+}
+
 /*!
   Initializes OpenGL by enabling required features and loading materials/lights/display lists
 */
@@ -213,6 +1185,10 @@ void SurfaceViewer::initializeGL() {
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     
     glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.0, 1.0);
+
+    // Copies may be scaled
+    glEnable(GL_NORMALIZE);
     
     glEnable(GL_DEPTH_TEST);
     
@@ -222,12 +1198,9 @@ void SurfaceViewer::initializeGL() {
     
     //   glBlendFunc(GL_ONE, GL_ZERO);
   
-    // Load materials/lights/textures
-    initMaterials();
+    // Load lights and find out what the driver supports
     initLights();
-
-    // Generate display lists
-    regenList();
+    initShaders();
 }
 
 /*!
@@ -235,6 +1208,7 @@ void SurfaceViewer::initializeGL() {
 */
 void SurfaceViewer::resizeGL(int width, int height) {
     glViewport(0,0, (GLsizei) width, (GLsizei)height);
+    uniformsDirty = true;
   
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
@@ -284,7 +1258,7 @@ int SurfaceViewer::nameAtPos(const QPoint &pos) {
     gluPickMatrix(GLdouble(pos.x()), GLdouble(viewport[3]-pos.y()),
                   2.0,2.0, viewport);
     // The regular view transformation
-    gluPerspective(80, 1.0, 1.0, 180);
+    gluPerspective(80, 1.0, 1.0, 1000);
 
     // Switch to GL_MODELVIEW and draw the scene
     glMatrixMode(GL_MODELVIEW);
@@ -308,10 +1282,10 @@ int SurfaceViewer::nameAtPos(const QPoint &pos) {
 
     int closest = 0;
 
-    // Loop through the returned hits to determine the closest one
+    // Loop through the returned hits to determine the closest one.
+    // Every hit has exactly one name, so records are four words long.
     for (int i=0;i<numHits;++i) {
-        if (buffer[4*i+1]<buffer[4*closest+1] ||
-            buffer[4*i+2]<buffer[4*closest+2]) {
+        if (buffer[4*i+1]<buffer[4*closest+1]) {
             closest = i;
         }
     }
@@ -325,6 +1299,22 @@ int SurfaceViewer::nameAtPos(const QPoint &pos) {
 */
 void SurfaceViewer::paintGL() {
 
+    // Picking draws in selection mode, which isn't timed
+    GLint renderMode = GL_RENDER;
+    glGetIntegerv(GL_RENDER_MODE, &renderMode);
+    if (renderMode != GL_SELECT) {
+        updateGovernor();
+    }
+    if (dirty) {
+        stopAnimation();
+        regenMesh();
+        dirty = false;
+    }
+    uploadScene();
+    if (canAnimate()) {
+        updateAnimation();
+    }
+
     // Rotate/translate the projection matrix
     glMatrixMode(GL_PROJECTION);
     glPushMatrix();
@@ -341,49 +1331,38 @@ void SurfaceViewer::paintGL() {
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    
-    float minz = calculateMinimumZoom();
-    light_position[0][0]=2.0*minz;
-    light_position[0][1]=2.0*minz;
-    light_position[0][2]=2.0*minz;
-        
-    light_position[1][0]=2.0*minz;
-    light_position[1][1]=2.0*minz;
-    light_position[1][2]=-2.0*minz;
-
-    light_position[0][3]=1.0f;
-    light_position[1][3]=1.0f;
-
-    // Setup the lights
-    glLightfv(GL_LIGHT0, GL_POSITION, light_position[0]);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_color[0]);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, light_color[0]);
-  
-    glLightfv(GL_LIGHT1, GL_POSITION, light_position[1]);
-    glLightfv(GL_LIGHT1, GL_DIFFUSE, light_color[1]);
-    glLightfv(GL_LIGHT1, GL_SPECULAR, light_color[1]);
-  
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, lmodel_ambient[0]);
     glLoadIdentity();
+    updateLights();
 
-    glLoadName(1);
-    // TODO: See about reusing the display list by changing the polygon fill mode.
-    if (showPolygons) {
-        glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat_diffuse[SURF_MAT]);
-        glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, mat_specular[SURF_MAT]);
-        glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, mat_shininess[SURF_MAT]);
-        glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, mat_ambient[SURF_MAT]);
-
-        glCallList(dispLists[0]);
+    drawCalls = 0;
+    if (renderMode != GL_SELECT) {
+        startFrameTimer();
     }
-        
-    if (showFacets) {
-        glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, mat_diffuse[LINE_MAT]);
-        glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, mat_specular[LINE_MAT]);
-        glMaterialfv(GL_FRONT_AND_BACK, GL_SHININESS, mat_shininess[LINE_MAT]);
-        glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, mat_ambient[LINE_MAT]);
-
-        glCallList(dispLists[1]);
+    if (renderMode == GL_SELECT) {
+        drawObjects(false, true);
+    } else if (instanceProgram &&
+               (legacyInstancing || scene.numMaterials() <= MAX_SHADER_MATERIALS)) {
+        if (showPolygons || showFacets) {
+            drawInstanced();
+        }
+    } else {
+        if (showPolygons) {
+            drawObjects(false, false);
+        }
+        if (showFacets) {
+            // Same buffers, drawn as outlines
+            applyMaterial(lineMaterial);
+            glLineWidth(OUTLINE_WIDTH);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            drawObjects(true, false);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        }
+    }
+    if (renderMode != GL_SELECT) {
+        drawIsolines();
+    }
+    if (renderMode != GL_SELECT) {
+        finishFrameTimer();
     }
 
     // Reset to how we found things
@@ -393,6 +1372,15 @@ void SurfaceViewer::paintGL() {
     
     glMatrixMode(GL_MODELVIEW);
     glFlush();
+
+    // New frames ask for their own repaint, but the animator can't reuse
+    // a buffer until the GPU is done with it, so keep checking till then
+    for (size_t i=0; i<ANIMATION_SLOTS; ++i) {
+        if (animBuffers[i].fence) {
+            update();
+            break;
+        }
+    }
 }
 
 /*!
@@ -401,9 +1389,19 @@ void SurfaceViewer::paintGL() {
 void SurfaceViewer::mousePressEvent(QMouseEvent *event) {
     clicked = true;
 
-    // Used for picking, which isn't used
-    // Try to get the name at this position
-    // int temp = nameAtPos(event->pos());
+    // Ctrl+click picks an object from the scene
+    if (event->modifiers() & Qt::ControlModifier) {
+        int id = nameAtPos(event->pos());
+        if (id > 0) {
+            emit objectPicked(id);
+        }
+    }
+
+    // Shift+click measures the surface instead
+    SurfaceHit hit;
+    if ((event->modifiers() & Qt::ShiftModifier) && surfacePointAt(event->pos(), hit)) {
+        emit surfacePicked(hit.patch, hit.u, hit.v, hit.point[0], hit.point[1], hit.point[2]);
+    }
   
     // Set the last postion for rotations
     lastPos = event->pos();
@@ -484,9 +1482,197 @@ inline void SurfaceViewer::handleGLError(size_t ln) {
 
 void SurfaceViewer::setShowPolygons(bool show) {
     showPolygons = show;
+    uniformsDirty = true;
     updateGL();
 }
 void SurfaceViewer::setShowFacets(bool show) {
     showFacets = show;
+    uniformsDirty = true;
     updateGL();
 }
+void SurfaceViewer::setShowIsolines(bool show) {
+    if (show == showIsolines) return;
+    showIsolines = show;
+    regenIsolines();
+    update();
+}
+
+/*!
+  Changes the shading.  The mesh is only rebuilt when a curvature mode
+  needs curvatures it doesn't have.
+*/
+void SurfaceViewer::setShading(size_t mode) {
+    if (mode >= NUM_SHADINGS || mode == shading) return;
+    shading = mode;
+    if (showsCurvature() && scene.mesh(SURFACE_MESH).curvature.empty()) {
+        dirty = true;
+    }
+    uniformsDirty = true;
+    update();
+}
+
+/*!
+  The larger magnitude of the curvature percentiles at either end of
+  the colour map, so zero stays white and both signs share a scale
+*/
+float SurfaceViewer::curvatureRange() const {
+    if (shading < SHADE_GAUSSIAN || shading > SHADE_MIN) return 1.0f;
+    const CurvatureHistogram &hist = curvatureHistograms[shading - SHADE_GAUSSIAN];
+    if (hist.count() == 0) return 1.0f;
+    float range = std::max(std::fabs(hist.percentile(CURVATURE_CLIP)),
+                           std::fabs(hist.percentile(1.0 - CURVATURE_CLIP)));
+    return (range > 0.0f) ? range : 1.0f;
+}
+
+/*!
+  Replaces the displayed surface.  The display lists are rebuilt on the
+  next paint, so several changes in a row only pay for one rebuild.
+*/
+void SurfaceViewer::setSurface(const ParametricSurface &surf) {
+    surface = surf;
+    surfaceType = PARAMETRIC_SURFACE;
+    dirty = true;
+    queryDirty = true;
+    update();
+}
+
+/*!
+  Switches to displaying the implicit surface surf
+*/
+void SurfaceViewer::setImplicitSurface(const ImplicitSurface &surf) {
+    implicitSurface = surf;
+    surfaceType = IMPLICIT_SURFACE;
+    dirty = true;
+    update();
+}
+
+/*!
+  Switches to displaying the subdivision surface surf
+*/
+void SurfaceViewer::setSubdivisionSurface(const SubdivisionSurface &surf) {
+    subdivSurface = surf;
+    surfaceType = SUBDIVISION_SURFACE;
+    dirty = true;
+    update();
+}
+
+/*!
+  Changes the triangle budget and rebuilds the mesh if it matters
+*/
+void SurfaceViewer::setTriangleBudget(size_t tris) {
+    if (tris == simplifier.triangleBudget()) return;
+    simplifier.setTriangleBudget(tris);
+    dirty = true;
+    update();
+}
+
+void SurfaceViewer::setSimplifyError(double err) {
+    if (err == simplifier.maxError()) return;
+    simplifier.setMaxError(err);
+    dirty = true;
+    update();
+}
+
+/*!
+  Replaces the governor.  Its detail is applied on the next paint.
+*/
+void SurfaceViewer::setGovernor(const FrameGovernor &gov) {
+    governor = gov;
+    if (governor.lodBias() != meshBias) {
+        dirty = true;
+    }
+    update();
+}
+
+/*!
+  Builds the query hierarchy the first time it's needed after the
+  parametric surface changes.  While animating it's built at the time
+  of the frame on screen, so picks land on what was clicked.
+*/
+const SurfaceQuery &SurfaceViewer::surfaceQuery() {
+    double t = animator.running() ? animTime : surface.time();
+    if (queryDirty || t != queryTime) {
+        // The animator has its own copy, so this doesn't disturb it
+        double oldTime = surface.time();
+        surface.setTime(t);
+        query.build(surface);
+        surface.setTime(oldTime);
+        queryTime = t;
+        queryDirty = false;
+    }
+    return query;
+}
+
+/*!
+  Casts a ray through pos with the same transformation paintGL uses and
+  intersects it with the exact surface
+*/
+bool SurfaceViewer::surfacePointAt(const QPoint &pos, SurfaceHit &hit) {
+    if (surfaceType != PARAMETRIC_SURFACE) {
+        return false;
+    }
+
+    makeCurrent();
+    GLint viewport[4];
+    GLdouble model[16];
+    GLdouble proj[16];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glTranslatef(0.0,0.0,-translate);
+    glRotatef(rotationX, 1.0, 0.0, 0.0);
+    glRotatef(rotationY, 0.0, 1.0, 0.0);
+    glRotatef(rotationZ, 0.0, 0.0, 1.0);
+    glGetDoublev(GL_PROJECTION_MATRIX, proj);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glGetDoublev(GL_MODELVIEW_MATRIX, model);
+
+    // Unproject the cursor on the near and far planes
+    GLdouble winX = pos.x();
+    GLdouble winY = viewport[3] - pos.y();
+    GLdouble nearPt[3], farPt[3];
+    if (!gluUnProject(winX, winY, 0.0, model, proj, viewport, &nearPt[0], &nearPt[1], &nearPt[2]) ||
+        !gluUnProject(winX, winY, 1.0, model, proj, viewport, &farPt[0], &farPt[1], &farPt[2])) {
+        return false;
+    }
+    double dir[3] = { farPt[0] - nearPt[0], farPt[1] - nearPt[1], farPt[2] - nearPt[2] };
+
+    // The ray goes into each copy's own coordinates, where the query
+    // is, and all of them are cast in one batch.  Affine maps keep the
+    // ray parameter, so the nearest hit is still the smallest t.
+    const std::vector<SceneBatch> &batches = scene.batches();
+    const std::vector<float> &xf = scene.instanceTransforms();
+    std::vector<double> origins, dirs;
+    std::vector<size_t> instances;
+    for (size_t b=0; b<batches.size(); ++b) {
+        if (batches[b].mesh != SURFACE_MESH) continue;
+        for (size_t i=batches[b].first; i<batches[b].first + batches[b].count; ++i) {
+            double inv[16];
+            if (!invertAffine(&xf[16*i], inv)) continue;
+            for (size_t r=0; r<3; ++r) {
+                origins.push_back(inv[r]*nearPt[0] + inv[4+r]*nearPt[1] + inv[8+r]*nearPt[2] + inv[12+r]);
+                dirs.push_back(inv[r]*dir[0] + inv[4+r]*dir[1] + inv[8+r]*dir[2]);
+            }
+            instances.push_back(i);
+        }
+    }
+    if (instances.empty()) return false;
+
+    std::vector<SurfaceHit> hits(instances.size());
+    surfaceQuery().intersectRays(&origins[0], &dirs[0], instances.size(), &hits[0], 1.0);
+    int best = -1;
+    for (size_t k=0; k<hits.size(); ++k) {
+        if (hits[k].patch >= 0 && (best < 0 || hits[k].t < hits[best].t)) best = int(k);
+    }
+    if (best < 0) return false;
+
+    hit = hits[best];
+    const float *m = &xf[16*instances[best]];
+    const double *p = hits[best].point;
+    for (size_t r=0; r<3; ++r) {
+        hit.point[r] = m[r]*p[0] + m[4+r]*p[1] + m[8+r]*p[2] + m[12+r];
+    }
+    return true;
+}
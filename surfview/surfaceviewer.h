@@ -20,6 +20,8 @@
 #include <QtOpenGL>
 #include <QGLWidget>
 
+#include <chrono>
+
 #ifdef __APPLE_CC__
 #include <OpenGL/gl.h>
 #include <OpenGL/glu.h>
@@ -28,12 +30,158 @@
 #include <GL/glu.h>
 #endif
 
+#include "mesh.h"
+#include "parametricsurface.h"
+#include "implicitsurface.h"
+#include "subdivisionsurface.h"
+#include "surfacequery.h"
+#include "meshsimplifier.h"
+#include "scene.h"
+#include "surfaceanimator.h"
+#include "curvature.h"
+#include "framegovernor.h"
+
 // Some constants...
-static const size_t NUM_MATERIALS=2;
 static const size_t NUM_LIGHTS=2;
-static const size_t NUM_LISTS=2;
-static const size_t LINE_MAT=0;
-static const size_t SURF_MAT=1;
+
+// Scene slots the displayed surface always uses
+static const size_t SURFACE_MESH=0;
+static const size_t SURFACE_MATERIAL=0;
+
+// Colours handed out to copies of the surface
+static const size_t NUM_COPY_MATERIALS=6;
+
+// Uniform block binding points for the shader path
+static const size_t LIGHTS_BINDING=0;
+static const size_t MATERIALS_BINDING=1;
+
+// Materials that fit in the shader's uniform block; 64 bytes each, and
+// 16k is the smallest block size GL allows.  Scenes with more are drawn
+// through the fixed function pipeline.
+static const size_t MAX_SHADER_MATERIALS=256;
+
+// Width of facet outlines in pixels
+static const float OUTLINE_WIDTH=1.5f;
+
+// Isolines shown in each direction over a parametric surface, and the
+// points each is drawn with
+static const size_t ISOLINE_COUNT=11;
+static const size_t ISOLINE_POINTS=128;
+
+// Ways of shading the surface.  The curvature modes show
+// Mesh::curvature component shading - SHADE_GAUSSIAN.
+static const size_t SHADE_MATERIAL=0;
+static const size_t SHADE_GAUSSIAN=1;
+static const size_t SHADE_MEAN=2;
+static const size_t SHADE_MAX=3;
+static const size_t SHADE_MIN=4;
+static const size_t SHADE_ZEBRA=5;
+static const size_t NUM_SHADINGS=6;
+
+// Fraction of vertices at each end of the curvature colour map that are
+// clipped, so a few extreme points don't wash out the rest
+static const double CURVATURE_CLIP=0.02;
+
+// Zebra stripes across the reflected view directions
+static const size_t ZEBRA_STRIPES=12;
+
+// Timer queries in flight at once for timing frames
+static const size_t FRAME_TIMERS=4;
+
+// The governor doesn't take parametric surfaces below this many steps
+// in either direction, unless they were asked for
+static const size_t MIN_LOD_STEPS=4;
+
+// Kinds of surface the viewer can display
+static const size_t PARAMETRIC_SURFACE=0;
+static const size_t IMPLICIT_SURFACE=1;
+static const size_t SUBDIVISION_SURFACE=2;
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER 0x8A11
+#endif
+
+// Instancing entry points, looked up at run time
+typedef void (APIENTRY *DrawElementsInstancedFunc)(GLenum mode, GLsizei count, GLenum type,
+                                                   const GLvoid *indices, GLsizei primcount);
+typedef void (APIENTRY *VertexAttribDivisorFunc)(GLuint index, GLuint divisor);
+
+// Uniform buffer entry points, looked up at run time
+typedef GLuint (APIENTRY *GetUniformBlockIndexFunc)(GLuint program, const char *name);
+typedef void (APIENTRY *UniformBlockBindingFunc)(GLuint program, GLuint index, GLuint binding);
+typedef void (APIENTRY *BindBufferBaseFunc)(GLenum target, GLuint index, GLuint buffer);
+
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+typedef struct __GLsync *GLsync;
+#endif
+
+// Persistent mapping and fence entry points for animation, looked up at run time
+typedef void (APIENTRY *BufferStorageFunc)(GLenum target, ptrdiff_t size, const void *data,
+                                           GLbitfield flags);
+typedef void *(APIENTRY *MapBufferRangeFunc)(GLenum target, ptrdiff_t offset, ptrdiff_t length,
+                                             GLbitfield access);
+typedef GLsync (APIENTRY *FenceSyncFunc)(GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRY *ClientWaitSyncFunc)(GLsync sync, GLbitfield flags,
+                                              unsigned long long timeout);
+typedef void (APIENTRY *DeleteSyncFunc)(GLsync sync);
+
+// Timer query entry points for the frame governor, looked up at run time
+typedef void (APIENTRY *GenQueriesFunc)(GLsizei n, GLuint *ids);
+typedef void (APIENTRY *DeleteQueriesFunc)(GLsizei n, const GLuint *ids);
+typedef void (APIENTRY *BeginQueryFunc)(GLenum target, GLuint id);
+typedef void (APIENTRY *EndQueryFunc)(GLenum target);
+typedef void (APIENTRY *GetQueryObjectuivFunc)(GLuint id, GLenum pname, GLuint *params);
+typedef void (APIENTRY *GetQueryObjectui64vFunc)(GLuint id, GLenum pname, unsigned long long *params);
+
+/*!
+  GPU copy of one of the scene's meshes: positions followed by normals
+  and, if the mesh has them, curvatures in one vertex buffer, and the
+  triangle indices.  curvatureOffset is 0 without curvatures.
+*/
+struct MeshBuffers {
+    MeshBuffers() : vertexBuffer(QGLBuffer::VertexBuffer), indexBuffer(QGLBuffer::IndexBuffer),
+                    version(0), numIndices(0), normalOffset(0), curvatureOffset(0) {}
+
+    QGLBuffer vertexBuffer;
+    QGLBuffer indexBuffer;
+    unsigned int version;
+    size_t numIndices;
+    size_t normalOffset;
+    size_t curvatureOffset;
+};
+
+/*!
+  One slot of the animation ring.  With buffer storage the vertex
+  buffer stays mapped and the animator writes straight into data;
+  otherwise data points at staging, which is copied into the surface's
+  own buffer.  fence is set once the GPU may still be reading the
+  buffer after it stops being drawn.
+*/
+struct AnimationBuffer {
+    AnimationBuffer() : vertexBuffer(QGLBuffer::VertexBuffer), data(0), fence(0) {}
+
+    QGLBuffer vertexBuffer;
+    float *data;
+    std::vector<float> staging;
+    GLsync fence;
+};
+
+/*!
+  A timer query around one frame's drawing, and the triangles drawn
+  while it ran.  Results come back a frame or two later.
+*/
+struct FrameTimer {
+    FrameTimer() : query(0), pending(false), triangles(0) {}
+
+    GLuint query;
+    bool pending;
+    size_t triangles;
+};
 
 /*!
   STLViewer is the QT widget that displays an STL file
@@ -50,6 +198,109 @@ public:
     void setShowPolygons(bool show);
     void setShowFacets(bool show);
 
+    /*!
+      Draws u and v isolines over a parametric surface, each through
+      points spaced equally by arc length.  The surface caches the arc
+      length tables, so they aren't redone when only the level of detail
+      changes.  Not shown while animating.
+    */
+    bool getShowIsolines() const { return showIsolines; }
+    void setShowIsolines(bool show);
+
+    const ParametricSurface &getSurface() const { return surface; }
+    void setSurface(const ParametricSurface &surf);
+
+    const ImplicitSurface &getImplicitSurface() const { return implicitSurface; }
+    void setImplicitSurface(const ImplicitSurface &surf);
+
+    const SubdivisionSurface &getSubdivisionSurface() const { return subdivSurface; }
+    void setSubdivisionSurface(const SubdivisionSurface &surf);
+
+    size_t getSurfaceType() const { return surfaceType; }
+
+    // Meshes with more triangles than this are simplified before drawing; 0 for no limit
+    size_t getTriangleBudget() const { return simplifier.triangleBudget(); }
+    void setTriangleBudget(size_t tris);
+    // Collapses adding more error than this distance are refused, and meshes are
+    // simplified as far as that allows even without a budget; 0 for no bound
+    double getSimplifyError() const { return simplifier.maxError(); }
+    void setSimplifyError(double err);
+    size_t numTriangles() const { return scene.mesh(SURFACE_MESH).numTris(); }
+
+    /*!
+      Everything drawn.  The displayed surface is object
+      getSurfaceObject(), using mesh SURFACE_MESH.  Call update() after
+      changing the scene.
+    */
+    const Scene &getScene() const { return scene; }
+    Scene &getScene() { return scene; }
+    int getSurfaceObject() const { return surfaceObject; }
+
+    // Extra copies of the surface, laid out on a grid around it
+    size_t getSurfaceCopies() const { return copyIds.size(); }
+    void setSurfaceCopies(size_t copies);
+
+    /*!
+      While animating, a parametric surface that uses t is re-evaluated
+      in the background at the current time and each new frame's
+      vertices are streamed to the GPU.  The triangle budget is ignored
+      for it, since the triangles must stay the same.
+    */
+    bool isAnimating() const { return animating; }
+    void setAnimating(bool animate);
+
+    /*!
+      How the surface is shaded: one of the SHADE_ constants.  The
+      curvature modes need the shader path and a parametric surface,
+      whose curvatures are computed from its exact second partials;
+      anything else is drawn with its material.  Curvatures aren't
+      recomputed for animation frames, so animated surfaces fall back to
+      their material too.  Zebra stripes work for every surface.
+    */
+    size_t getShading() const { return shading; }
+    void setShading(size_t mode);
+
+    // Distribution of curvature component over the surface's vertices, from the last tessellation
+    const CurvatureHistogram &curvatureHistogram(size_t component) const {
+        return curvatureHistograms[component];
+    }
+    // Curvature at the ends of the colour map for the current shading
+    float curvatureRange() const;
+
+    /*!
+      The frame governor times every frame drawn and lowers the detail
+      of the surface until frames fit its target.  Parametric surfaces
+      are tessellated with fewer steps; other surfaces are simplified
+      to a triangle budget.  Setting it keeps its cost models, so a
+      calibration saved from an earlier run takes effect at once.
+    */
+    const FrameGovernor &getGovernor() const { return governor; }
+    void setGovernor(const FrameGovernor &gov);
+
+    // Draw calls made by the last paint
+    size_t numDrawCalls() const { return drawCalls; }
+
+    /*!
+      Finds the point of the parametric surface, or of the nearest copy
+      of it, under pos.  (u,v) are on the surface and the point is where
+      that copy puts it.  Returns false if a different kind of surface
+      is showing or nothing is there.
+    */
+    bool surfacePointAt(const QPoint &pos, SurfaceHit &hit);
+
+    // Queries against the parametric surface, rebuilt when it changes
+    const SurfaceQuery &surfaceQuery();
+
+signals:
+    // Sent on shift+click with the point picked by surfacePointAt
+    void surfacePicked(int patch, double u, double v, double x, double y, double z);
+    // Sent on ctrl+click with the id of the scene object clicked
+    void objectPicked(int id);
+    // Sent about once a second while animating: new frames drawn per second and bytes uploaded per second
+    void animationStats(double fps, double bytesPerSec);
+    // Sent when the governor changes the detail, with the frame time it expects
+    void detailChanged(int lodBias, double frameMs);
+
 protected:
     void initializeGL();
     void resizeGL(int width, int height);
@@ -66,26 +317,73 @@ private:
     // Initialization functions
     void initMaterials();
     void initLights();
-    void initLists();
-    void regenList();
+    void initShaders();
+    void regenMesh();
+    void regenIsolines();
+    void layoutCopies(size_t copies);
+    bool canAnimate() const;
+    bool showsCurvature() const;
+    void startAnimation();
+    void stopAnimation();
+    void updateAnimation();
+    const ParametricSurface &tessellatedSurface() const;
+    void updateGovernor();
+    void startFrameTimer();
+    void finishFrameTimer();
+    size_t drawnTriangles() const;
+
+    // Drawing helpers
+    void uploadScene();
+    void updateLights();
+    void applyMaterial(const SceneMaterial &mat);
+    void bindMesh(size_t mesh);
+    void drawInstanced();
+    void drawBatches(bool outlines);
+    void drawObjects(bool lines, bool names);
+    void drawIsolines();
     
     // Error handler for OpenGL errors
     void handleGLError(size_t ln);
 
     float calculateMinimumZoom();
-    // Arrays to hold material properties
-    GLfloat mat_specular[NUM_MATERIALS][4];
-    GLfloat mat_shininess[NUM_MATERIALS][1];
-    GLfloat mat_diffuse[NUM_MATERIALS][4];
-    GLfloat mat_ambient[NUM_MATERIALS][4];
+    // Material for facet outlines; the rest are in the scene
+    SceneMaterial lineMaterial;
 
-    // Arrays to hold light properties
+    // Arrays to hold light properties; set lightsDirty after changing them
     GLfloat light_position[NUM_LIGHTS][4];
     GLfloat light_color[NUM_LIGHTS][4];
     GLfloat lmodel_ambient[NUM_LIGHTS][4];
+    bool lightsDirty;
+
+    // GPU side of the scene
+    std::vector<MeshBuffers> meshBuffers;
+    QGLBuffer instanceBuffer;
+    unsigned int instanceVersion;
+    QGLShaderProgram *instanceProgram;
+    int instanceMatrixLoc;
+    DrawElementsInstancedFunc drawElementsInstanced;
+    VertexAttribDivisorFunc vertexAttribDivisor;
+    size_t drawCalls;
 
-    // Array of display lists
-    GLuint dispLists[NUM_LISTS];
+    // Lights and materials for the shader, rewritten only when they change
+    QGLBuffer lightBuffer;
+    QGLBuffer materialBuffer;
+    unsigned int materialVersion;
+
+    // Uniforms set on the program only when they change
+    int materialLoc;
+    int outlineColorLoc;
+    int outlineWidthLoc;
+    int fillModeLoc;
+    int viewportLoc;
+    int shadingLoc;
+    int curvatureMaskLoc;
+    int curvatureScaleLoc;
+    int curvatureLoc;
+    bool uniformsDirty;
+
+    // Set when instanceProgram is the GLSL 1.20 program without geometry shaders
+    bool legacyInstancing;
 
     // Stores last mouse position for rotation
     QPoint lastPos;
@@ -100,11 +398,63 @@ private:
 
     bool clicked;
     
-    size_t num_tris;
-    float *verts;
-    float *norms;
-    unsigned int *indices;
+    size_t surfaceType;
+    // True when the surface mesh is out of date
+    bool dirty;
+    ParametricSurface surface;
+    SurfaceQuery query;
+    bool queryDirty;
+    // Time of the surface the query was built at
+    double queryTime;
+    ImplicitSurface implicitSurface;
+    SubdivisionSurface subdivSurface;
+    MeshSimplifier simplifier;
+
+    Scene scene;
+    int surfaceObject;
+    std::vector<int> copyIds;
+
+    // Animation of the parametric surface; animSlot is the slot drawn, or -1
+    bool animating;
+    SurfaceAnimator animator;
+    AnimationBuffer animBuffers[ANIMATION_SLOTS];
+    int animSlot;
+    double animTime;
+    BufferStorageFunc bufferStorage;
+    MapBufferRangeFunc mapBufferRange;
+    FenceSyncFunc fenceSync;
+    ClientWaitSyncFunc clientWaitSync;
+    DeleteSyncFunc deleteSync;
+
+    size_t shading;
+    CurvatureHistogram curvatureHistograms[NUM_CURVATURES];
+
+    // Level of detail; the parametric surface is tessellated from
+    // lodSurface when the mesh was built at a bias
+    FrameGovernor governor;
+    ParametricSurface lodSurface;
+    int meshBias;
+    size_t fullTriangles;
+    FrameTimer frameTimers[FRAME_TIMERS];
+    size_t nextTimer;
+    int activeTimer;
+    std::chrono::steady_clock::time_point frameStart;
+    GenQueriesFunc genQueries;
+    DeleteQueriesFunc deleteQueries;
+    BeginQueryFunc beginQuery;
+    EndQueryFunc endQuery;
+    GetQueryObjectuivFunc getQueryObjectuiv;
+    GetQueryObjectui64vFunc getQueryObjectui64v;
+
+    // Frames and bytes since the last animationStats
+    QTime statsClock;
+    size_t statsFrames;
+    double statsBytes;
 
     bool showPolygons;
     bool showFacets;
+
+    // ISOLINE_POINTS points per isoline, xyz each, in the surface's own space
+    bool showIsolines;
+    std::vector<float> isolineVerts;
 };
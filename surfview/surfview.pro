@@ -7,9 +7,21 @@ TARGET =
 DEPENDPATH += .
 INCLUDEPATH += .
 QT += opengl
+QMAKE_CXXFLAGS += -std=c++0x
+LIBS += -lpthread
 
 # Input
-HEADERS += mainwindow.h surfaceviewer.h
-SOURCES += main.cpp mainwindow.cpp surfaceviewer.cpp
+HEADERS += mainwindow.h surfaceviewer.h surfacedialog.h implicitdialog.h subdivisiondialog.h \
+           simplifydialog.h \
+           expression.h parametricsurface.h implicitsurface.h mesh.h parallel.h \
+           halfedgemesh.h subdivisionsurface.h arclength.h surfacequery.h \
+           meshsimplifier.h scene.h surfaceanimator.h curvature.h \
+           framegovernor.h
+SOURCES += main.cpp mainwindow.cpp surfaceviewer.cpp surfacedialog.cpp implicitdialog.cpp \
+           simplifydialog.cpp \
+           subdivisiondialog.cpp expression.cpp parametricsurface.cpp implicitsurface.cpp \
+           halfedgemesh.cpp subdivisionsurface.cpp arclength.cpp surfacequery.cpp \
+           meshsimplifier.cpp scene.cpp surfaceanimator.cpp curvature.cpp \
+           framegovernor.cpp
 RESOURCES += surfaceviewer.qrc
 
@@ -0,0 +1,80 @@
+/*
+  arclengthtest.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cmath>
+#include <vector>
+
+#include "tests.h"
+#include "arclength.h"
+#include "parametricsurface.h"
+
+namespace {
+
+// Length between consecutive points, xyz each
+std::vector<double> segmentLengths(const std::vector<float> &pts) {
+    std::vector<double> lens;
+    for (size_t i=3; i<pts.size(); i+=3) {
+        double dx = pts[i] - pts[i-3], dy = pts[i+1] - pts[i-2], dz = pts[i+2] - pts[i-1];
+        lens.push_back(std::sqrt(dx*dx + dy*dy + dz*dz));
+    }
+    return lens;
+}
+
+}
+
+void testArcLength() {
+    // A speed that varies enough to need many pieces
+    ArcLengthTable table;
+    table.build([](const double *t, double *speed, size_t n) {
+            for (size_t i=0; i<n; ++i) speed[i] = 1.0 + 0.9*std::sin(40.0*t[i]);
+        }, 0.0, 1.0);
+    CHECK(table.numPieces() > 16);
+
+    // The batch inverse matches the scalar one, across several blocks and past both ends
+    const size_t n = 1000;
+    std::vector<double> s(n), t(n);
+    for (size_t i=0; i<n; ++i) {
+        s[i] = table.length()*(double(i*7919 % n)/double(n - 1)*1.2 - 0.1);
+    }
+    table.paramsAt(&s[0], &t[0], n);
+    for (size_t i=0; i<n; ++i) {
+        CHECK(t[i] == table.paramAt(s[i]));
+        double clamped = std::min(std::max(s[i], 0.0), table.length());
+        CHECK(std::fabs(table.lengthAt(t[i]) - clamped) < 1.0e-9*table.length());
+    }
+
+    // In place
+    std::vector<double> same(s);
+    table.paramsAt(&same[0], &same[0], n);
+    CHECK(same == t);
+
+    // Isoline points are spaced equally along the curve, though not in u
+    ParametricSurface surf;
+    surf.setExpressions("u", "u^3", "0");
+    surf.setDomain(0.0, 1.0, 0.0, 1.0);
+    std::vector<float> pts;
+    surf.isolinePoints(ISOLINE_U, 0.5, 64, pts);
+    CHECK(pts.size() == 3*64);
+    std::vector<double> lens = segmentLengths(pts);
+    double total = 0.0;
+    for (size_t i=0; i<lens.size(); ++i) total += lens[i];
+    for (size_t i=0; i<lens.size(); ++i) {
+        CHECK(std::fabs(lens[i] - total/lens.size()) < 1.0e-3*total/lens.size());
+    }
+    CHECK(std::fabs(pts[0]) < 1.0e-6f && std::fabs(pts[3*63] - 1.0f) < 1.0e-6f);
+}
@@ -0,0 +1,80 @@
+/*
+  expressiontest.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <clocale>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "tests.h"
+#include "expression.h"
+
+namespace {
+
+// Parses src in u and v and evaluates it at one point; NaN if it doesn't parse
+double evalAt(const std::string &src, double u, double v) {
+    std::vector<std::string> vars;
+    vars.push_back("u");
+    vars.push_back("v");
+    ExprGraph graph(vars);
+    std::vector<int> roots;
+    try {
+        roots.push_back(graph.parse(src));
+    } catch (const ExprError &) {
+        return std::nan("");
+    }
+    ExprProgram prog;
+    prog.compile(graph, roots);
+    const double *in[2] = { &u, &v };
+    double out = 0.0;
+    double *outs[1] = { &out };
+    prog.eval(in, outs, 1);
+    return out;
+}
+
+// Switches to a locale that writes 1.5 as "1,5", if one is installed
+bool useCommaLocale() {
+    const char *names[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8",
+                            "fr_FR", "nl_NL.UTF-8", "ru_RU.UTF-8" };
+    for (size_t i=0; i<sizeof(names)/sizeof(names[0]); ++i) {
+        if (std::setlocale(LC_ALL, names[i]) && std::localeconv()->decimal_point[0] == ',') {
+            return true;
+        }
+    }
+    std::setlocale(LC_ALL, "C");
+    return false;
+}
+
+}
+
+void testExpressionLocale() {
+    // QApplication sets the locale from the environment, as this does
+    if (!useCommaLocale()) {
+        std::cerr << "No comma decimal locale installed; parsing under C only" << std::endl;
+    }
+
+    CHECK(std::fabs(evalAt("1.5*u", 2.0, 0.0) - 3.0) < 1.0e-12);
+    CHECK(std::fabs(evalAt("1.5*u + .25 + 2.5e-1*v", 2.0, 4.0) - 4.25) < 1.0e-12);
+    CHECK(std::fabs(evalAt("u*0.5", 3.0, 0.0) - 1.5) < 1.0e-12);
+    CHECK(evalAt("7", 0.0, 0.0) == 7.0);
+
+    CHECK(std::isnan(evalAt("1,5*u", 2.0, 0.0)));
+
+    std::setlocale(LC_ALL, "C");
+}
@@ -0,0 +1,51 @@
+/*
+  main.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <iostream>
+
+#include "tests.h"
+
+namespace {
+
+size_t numFailed = 0;
+
+}
+
+void checkFailed(const char *expr, const char *file, int line) {
+    std::cerr << file << ":" << line << ": CHECK(" << expr << ") failed" << std::endl;
+    ++numFailed;
+}
+
+/*!
+  Runs the tests that don't need Qt or OpenGL
+*/
+int main() {
+    testSubdivisionCageEdits();
+    testArcLength();
+    testSceneBatching();
+    testExpressionLocale();
+    testSurfaceQuery();
+    testMeshSimplifier();
+
+    if (numFailed) {
+        std::cerr << numFailed << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All tests passed" << std::endl;
+    return 0;
+}
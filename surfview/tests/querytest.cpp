@@ -0,0 +1,116 @@
+/*
+  querytest.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cmath>
+#include <vector>
+
+#include "tests.h"
+#include "surfacequery.h"
+
+namespace {
+
+// The default surface is a torus about z with these radii
+const double MAJOR_RADIUS = 4.0;
+const double MINOR_RADIUS = 1.0;
+
+// Exact distance from p to the torus
+double torusDistance(const double *p) {
+    double rho = std::sqrt(p[0]*p[0] + p[1]*p[1]) - MAJOR_RADIUS;
+    return std::fabs(std::sqrt(rho*rho + p[2]*p[2]) - MINOR_RADIUS);
+}
+
+// True if hit's point is on the torus at its (u,v)
+bool onSurface(const ParametricSurface &surf, const SurfaceHit &hit) {
+    double u = hit.u, v = hit.v;
+    std::vector<double> vals(PS_NUM_OUTPUTS);
+    double *out[PS_NUM_OUTPUTS];
+    for (size_t i=0; i<PS_NUM_OUTPUTS; ++i) out[i] = &vals[i];
+    surf.evaluate(&u, &v, 1, out);
+    for (size_t k=0; k<3; ++k) {
+        if (std::fabs(vals[PS_X+k] - hit.point[k]) > 1.0e-8) return false;
+    }
+    return torusDistance(hit.point) < 1.0e-8;
+}
+
+}
+
+void testSurfaceQuery() {
+    ParametricSurface torus;
+    SurfaceQuery query;
+    query.build(torus);
+    CHECK(!query.empty());
+
+    // Rays: straight at the outer equator, one that passes above the
+    // torus, one stopped short by tMax's scaling, and one from inside
+    // the tube that hits it from within
+    const double origins[] = { 10.0, 0.0, 0.0,
+                               10.0, 0.0, 2.0,
+                               0.0, 10.0, 0.0,
+                               4.0, 0.0, 0.0 };
+    const double dirs[] = { -1.0, 0.0, 0.0,
+                            -1.0, 0.0, 0.0,
+                            0.0, -0.1, 0.0,
+                            0.0, 0.0, 1.0 };
+    SurfaceHit rays[4];
+    query.intersectRays(origins, dirs, 4, rays, 40.0);
+    CHECK(rays[0].patch >= 0);
+    CHECK(std::fabs(rays[0].t - 5.0) < 1.0e-9);
+    CHECK(std::fabs(rays[0].point[0] - 5.0) < 1.0e-9);
+    CHECK(onSurface(torus, rays[0]));
+    CHECK(rays[1].patch < 0);
+    CHECK(rays[2].patch < 0);
+    CHECK(rays[3].patch >= 0);
+    CHECK(std::fabs(rays[3].t - MINOR_RADIUS) < 1.0e-9);
+    CHECK(onSurface(torus, rays[3]));
+
+    // Closest points, off the surface on both sides of the tube and in the hole
+    const double points[] = { 9.0, 0.0, 3.0,
+                              0.0, -4.5, 0.25,
+                              -2.0, 1.0, 0.5,
+                              3.0, 3.0, -1.5 };
+    SurfaceHit closest[4];
+    query.closestPoints(points, 4, closest);
+    CHECK(std::fabs(closest[0].t - (std::sqrt(34.0) - 1.0)) < 1.0e-9);
+    for (size_t i=0; i<4; ++i) {
+        CHECK(closest[i].patch >= 0);
+        CHECK(onSurface(torus, closest[i]));
+        CHECK(std::fabs(closest[i].t - torusDistance(&points[3*i])) < 1.0e-9);
+        double d = 0.0;
+        for (size_t k=0; k<3; ++k) {
+            d += (closest[i].point[k] - points[3*i+k])*(closest[i].point[k] - points[3*i+k]);
+        }
+        CHECK(std::fabs(std::sqrt(d) - closest[i].t) < 1.0e-9);
+    }
+
+    // A line through the hole crosses the tube four times, in order
+    std::vector<SurfaceHit> crossings;
+    query.intersectCurve([](double s, double *pos, double *deriv) {
+            pos[0] = -10.0 + 20.0*s;
+            pos[1] = 0.0;
+            pos[2] = 0.0;
+            deriv[0] = 20.0;
+            deriv[1] = 0.0;
+            deriv[2] = 0.0;
+        }, 0.0, 1.0, 64, crossings);
+    const double expected[] = { 0.25, 0.35, 0.65, 0.75 };
+    CHECK(crossings.size() == 4);
+    for (size_t i=0; i<crossings.size() && i<4; ++i) {
+        CHECK(std::fabs(crossings[i].t - expected[i]) < 1.0e-9);
+        CHECK(onSurface(torus, crossings[i]));
+    }
+}
@@ -0,0 +1,122 @@
+/*
+  scenetest.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "tests.h"
+#include "scene.h"
+
+namespace {
+
+const size_t NUM_OBJECTS = 10000;
+const size_t NUM_MESHES = 5;
+const size_t NUM_MATERIALS = 7;
+
+/*!
+  Checks that the batches cover every object once, are sorted by
+  material then mesh with one batch per distinct pair, and that each
+  instance carries its own object's id and transform.
+*/
+void checkBatches(const Scene &scene) {
+    const std::vector<SceneBatch> &batches = scene.batches();
+    const std::vector<float> &xf = scene.instanceTransforms();
+    const std::vector<int> &ids = scene.instanceIds();
+    CHECK(ids.size() == scene.numObjects());
+    CHECK(xf.size() == 16*scene.numObjects());
+
+    std::set<std::pair<size_t, size_t> > pairs;
+    for (size_t i=0; i<scene.numObjects(); ++i) {
+        pairs.insert(std::make_pair(scene.object(i).material, scene.object(i).mesh));
+    }
+    CHECK(batches.size() == pairs.size());
+
+    size_t next = 0;
+    for (size_t b=0; b<batches.size(); ++b) {
+        const SceneBatch &batch = batches[b];
+        CHECK(batch.first == next);
+        CHECK(batch.count > 0);
+        next += batch.count;
+        if (b > 0) {
+            CHECK(std::make_pair(batches[b-1].material, batches[b-1].mesh) <
+                  std::make_pair(batch.material, batch.mesh));
+        }
+        for (size_t i=batch.first; i<batch.first + batch.count && i<ids.size(); ++i) {
+            const SceneObject *obj = scene.findObject(ids[i]);
+            CHECK(obj != 0);
+            if (!obj) continue;
+            CHECK(obj->material == batch.material && obj->mesh == batch.mesh);
+            CHECK(std::equal(obj->transform, obj->transform + 16, &xf[16*i]));
+        }
+    }
+    CHECK(next == scene.numObjects());
+
+    std::vector<int> sorted(ids);
+    std::sort(sorted.begin(), sorted.end());
+    CHECK(std::unique(sorted.begin(), sorted.end()) == sorted.end());
+}
+
+}
+
+void testSceneBatching() {
+    Scene scene;
+    for (size_t i=0; i<NUM_MESHES; ++i) {
+        scene.addMesh(Mesh());
+    }
+    for (size_t i=0; i<NUM_MATERIALS; ++i) {
+        scene.addMaterial(makeMaterial(float(i)/NUM_MATERIALS, 0.5f, 0.5f));
+    }
+
+    // Objects added in an order unrelated to their batches
+    std::vector<int> objIds;
+    for (size_t i=0; i<NUM_OBJECTS; ++i) {
+        float xf[16] = { 1.0f, 0.0f, 0.0f, 0.0f,
+                         0.0f, 1.0f, 0.0f, 0.0f,
+                         0.0f, 0.0f, 1.0f, 0.0f,
+                         float(i), float(i % 97), float(i % 13), 1.0f };
+        objIds.push_back(scene.addObject((i*7) % NUM_MESHES, (i*11 + i/3) % NUM_MATERIALS, xf));
+    }
+    CHECK(scene.numObjects() == NUM_OBJECTS);
+    CHECK(scene.batches().size() == NUM_MESHES*NUM_MATERIALS);
+    checkBatches(scene);
+
+    // Batches are only rebuilt after a change
+    unsigned int version = scene.instanceVersion();
+    scene.batches();
+    CHECK(scene.instanceVersion() == version);
+
+    // Removing every object of one material drops its batches, and ids stay put
+    for (size_t i=0; i<NUM_OBJECTS; ++i) {
+        const SceneObject *obj = scene.findObject(objIds[i]);
+        if (obj && obj->material == 3) scene.removeObject(objIds[i]);
+    }
+    CHECK(scene.instanceVersion() != version);
+    CHECK(scene.batches().size() == NUM_MESHES*(NUM_MATERIALS - 1));
+    checkBatches(scene);
+    for (size_t i=0; i<NUM_OBJECTS; ++i) {
+        const SceneObject *obj = scene.findObject(objIds[i]);
+        CHECK(!obj || (obj->id == objIds[i] && obj->transform[12] == float(i)));
+    }
+
+    // Moving objects between materials regroups them
+    scene.setObjectMaterial(objIds[1], 3);
+    scene.setObjectMaterial(objIds[2], 3);
+    checkBatches(scene);
+    CHECK(scene.findObject(-1) == 0 && scene.findObject(int(NUM_OBJECTS) + 1) == 0);
+}
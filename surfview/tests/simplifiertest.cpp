@@ -0,0 +1,118 @@
+/*
+  simplifiertest.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "tests.h"
+#include "meshsimplifier.h"
+#include "parametricsurface.h"
+
+namespace {
+
+typedef std::vector<float> Position;
+
+// Positions of the vertices on edges used by only one triangle
+std::set<Position> boundaryPositions(const Mesh &mesh) {
+    std::map<std::pair<unsigned int, unsigned int>, size_t> edges;
+    for (size_t t=0; t<mesh.numTris(); ++t) {
+        for (size_t k=0; k<3; ++k) {
+            unsigned int a = mesh.indices[3*t+k], b = mesh.indices[3*t + (k+1)%3];
+            ++edges[std::make_pair(std::min(a, b), std::max(a, b))];
+        }
+    }
+    std::set<Position> pts;
+    for (std::map<std::pair<unsigned int, unsigned int>, size_t>::const_iterator i=edges.begin();
+         i!=edges.end(); ++i) {
+        if (i->second != 1) continue;
+        unsigned int ends[2] = { i->first.first, i->first.second };
+        for (size_t e=0; e<2; ++e) {
+            pts.insert(Position(&mesh.verts[3*ends[e]], &mesh.verts[3*ends[e]] + 3));
+        }
+    }
+    return pts;
+}
+
+// Twice the area of triangle t
+double doubleArea(const Mesh &mesh, size_t t) {
+    const float *p0 = &mesh.verts[3*mesh.indices[3*t]];
+    const float *p1 = &mesh.verts[3*mesh.indices[3*t+1]];
+    const float *p2 = &mesh.verts[3*mesh.indices[3*t+2]];
+    double e1[3], e2[3];
+    for (size_t k=0; k<3; ++k) {
+        e1[k] = p1[k] - p0[k];
+        e2[k] = p2[k] - p0[k];
+    }
+    double c[3] = { e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2],
+                    e1[0]*e2[1] - e1[1]*e2[0] };
+    return std::sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]);
+}
+
+}
+
+void testMeshSimplifier() {
+    // Three quarters of a torus, so it has an open boundary as well as the v seam
+    ParametricSurface torus;
+    torus.setDomain(0.0, 1.5*M_PI, 0.0, 2.0*M_PI);
+    torus.setResolution(192, 96);
+    Mesh mesh;
+    torus.tessellate(mesh, true);
+    const size_t before = mesh.numTris();
+    const std::set<Position> boundary = boundaryPositions(mesh);
+    CHECK(!boundary.empty());
+
+    MeshSimplifier simplifier;
+    const size_t budget = before/8;
+    simplifier.setTriangleBudget(budget);
+    size_t removed = simplifier.simplify(mesh);
+
+    CHECK(mesh.numTris() <= budget);
+    CHECK(removed == before - mesh.numTris());
+    CHECK(mesh.norms.size() == mesh.verts.size());
+    CHECK(mesh.curvature.size() == NUM_CURVATURES*mesh.numVerts());
+
+    for (size_t t=0; t<mesh.numTris(); ++t) {
+        unsigned int a = mesh.indices[3*t], b = mesh.indices[3*t+1], c = mesh.indices[3*t+2];
+        CHECK(a < mesh.numVerts() && b < mesh.numVerts() && c < mesh.numVerts());
+        if (a >= mesh.numVerts() || b >= mesh.numVerts() || c >= mesh.numVerts()) continue;
+        CHECK(a != b && b != c && c != a);
+        CHECK(doubleArea(mesh, t) > 0.0);
+    }
+
+    // Every vertex is used, so compaction dropped the collapsed ones
+    std::vector<bool> used(mesh.numVerts(), false);
+    for (size_t i=0; i<mesh.indices.size(); ++i) {
+        if (mesh.indices[i] < used.size()) used[mesh.indices[i]] = true;
+    }
+    CHECK(std::find(used.begin(), used.end(), false) == used.end());
+
+    // The open boundary and seam stay exactly where they were
+    CHECK(boundaryPositions(mesh) == boundary);
+
+    // An error bound with no budget also simplifies, but less
+    Mesh bounded;
+    torus.tessellate(bounded, true);
+    MeshSimplifier errorOnly;
+    errorOnly.setMaxError(1.0e-3);
+    errorOnly.simplify(bounded);
+    CHECK(bounded.numTris() < before);
+    CHECK(bounded.numTris() > budget);
+}
@@ -0,0 +1,118 @@
+/*
+  subdivisiontest.cpp
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "tests.h"
+#include "subdivisionsurface.h"
+
+namespace {
+
+// A unit cube of quads and a tetrahedron, independent of the presets
+const float cubeVerts[] = { 0,0,0, 1,0,0, 1,1,0, 0,1,0, 0,0,1, 1,0,1, 1,1,1, 0,1,1 };
+const unsigned int cubeFaces[] = { 0,3,2,1, 4,5,6,7, 0,1,5,4, 1,2,6,5, 2,3,7,6, 3,0,4,7 };
+const float tetraVerts[] = { 1,1,1, -1,-1,1, -1,1,-1, 1,-1,-1 };
+const unsigned int tetraFaces[] = { 0,1,2, 0,3,1, 0,2,3, 1,3,2 };
+
+bool sameMesh(const Mesh &a, const Mesh &b) {
+    if (a.verts.size() != b.verts.size() || a.indices != b.indices) return false;
+    for (size_t i=0; i<a.verts.size(); ++i) {
+        if (std::fabs(a.verts[i] - b.verts[i]) > 1.0e-5f) return false;
+        if (std::fabs(a.norms[i] - b.norms[i]) > 1.0e-4f) return false;
+    }
+    return true;
+}
+
+SubdivisionSurface makeSurface(const std::vector<float> &verts, size_t sides,
+                               const std::vector<unsigned int> &faces,
+                               size_t scheme, size_t levels) {
+    SubdivisionSurface surf;
+    surf.setLevels(0);
+    surf.setCage(verts, std::vector<unsigned int>(faces.size()/sides, sides), faces);
+    surf.setScheme(scheme);
+    surf.setLevels(levels);
+    return surf;
+}
+
+/*!
+  Edits the cage of one surface in place, builds a second surface from
+  scratch on the edited cage, and checks that re-applying the first
+  one's stencils gives the same mesh.
+*/
+void checkCageEdits(const std::vector<float> &cage, size_t sides,
+                    const std::vector<unsigned int> &faces,
+                    size_t scheme, size_t levels) {
+    SubdivisionSurface edited = makeSurface(cage, sides, faces, scheme, levels);
+    Mesh before;
+    edited.tessellate(before);
+
+    // Shrink all but the first vertex, then pull that one out
+    std::vector<float> verts(cage);
+    for (size_t i=3; i<verts.size(); ++i) {
+        verts[i] *= 0.75f;
+    }
+    edited.setCagePositions(verts);
+    for (size_t i=0; i<3; ++i) {
+        verts[i] *= 2.0f;
+    }
+    edited.moveCageVertex(0, verts[0], verts[1], verts[2]);
+    CHECK(edited.cagePositions() == verts);
+
+    Mesh after;
+    edited.tessellate(after);
+    CHECK(after.indices == before.indices);
+    CHECK(!sameMesh(after, before));
+
+    Mesh rebuilt;
+    makeSurface(verts, sides, faces, scheme, levels).tessellate(rebuilt);
+    CHECK(sameMesh(after, rebuilt));
+}
+
+}
+
+void testSubdivisionCageEdits() {
+    std::vector<float> cube(cubeVerts, cubeVerts + sizeof(cubeVerts)/sizeof(float));
+    std::vector<unsigned int> quads(cubeFaces, cubeFaces + sizeof(cubeFaces)/sizeof(unsigned int));
+    std::vector<float> tetra(tetraVerts, tetraVerts + sizeof(tetraVerts)/sizeof(float));
+    std::vector<unsigned int> tris(tetraFaces, tetraFaces + sizeof(tetraFaces)/sizeof(unsigned int));
+
+    checkCageEdits(cube, 4, quads, SUBDIV_CATMULL_CLARK, 3);
+    checkCageEdits(tetra, 3, tris, SUBDIV_LOOP, 3);
+    checkCageEdits(tetra, 3, tris, SUBDIV_CATMULL_CLARK, 2);
+
+    // Out of range edits throw and leave the cage alone
+    SubdivisionSurface surf;
+    std::vector<float> cage(surf.cagePositions());
+    bool threw = false;
+    try {
+        surf.moveCageVertex(cage.size()/3, 1.0f, 2.0f, 3.0f);
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    CHECK(threw);
+    threw = false;
+    try {
+        surf.setCagePositions(std::vector<float>(cage.size() + 3, 0.0f));
+    } catch (const std::runtime_error &) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(surf.cagePositions() == cage);
+}
@@ -0,0 +1,40 @@
+/*
+  tests.h
+
+  Copyright (c) 2012, Jeremiah LaRocco jeremiah.larocco@gmail.com
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef TESTS_H
+#define TESTS_H
+
+#include <cstddef>
+
+/*!
+  Records a failed check, printing the expression and where it was
+*/
+void checkFailed(const char *expr, const char *file, int line);
+
+#define CHECK(expr) \
+    do { if (!(expr)) checkFailed(#expr, __FILE__, __LINE__); } while (0)
+
+// Each returns normally; failures are counted by CHECK
+void testSubdivisionCageEdits();
+void testArcLength();
+void testSceneBatching();
+void testExpressionLocale();
+void testSurfaceQuery();
+void testMeshSimplifier();
+
+#endif
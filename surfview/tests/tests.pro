@@ -0,0 +1,23 @@
+######################################################################
+# Tests for the parts of surfview that don't need Qt or OpenGL
+######################################################################
+
+TEMPLATE = app
+TARGET = surftests
+CONFIG += console
+CONFIG -= qt app_bundle
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+QMAKE_CXXFLAGS += -std=c++0x
+LIBS += -lpthread
+
+# Input
+HEADERS += tests.h ../subdivisionsurface.h ../halfedgemesh.h ../mesh.h ../parallel.h \
+           ../arclength.h ../parametricsurface.h ../expression.h ../curvature.h \
+           ../scene.h ../surfacequery.h \
+           ../meshsimplifier.h
+SOURCES += main.cpp subdivisiontest.cpp arclengthtest.cpp scenetest.cpp expressiontest.cpp \
+           querytest.cpp simplifiertest.cpp \
+           ../subdivisionsurface.cpp ../halfedgemesh.cpp ../arclength.cpp \
+           ../parametricsurface.cpp ../expression.cpp ../curvature.cpp \
+           ../scene.cpp ../surfacequery.cpp ../meshsimplifier.cpp